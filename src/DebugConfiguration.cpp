@@ -30,6 +30,8 @@ SOFTWARE.*/
 #include "platform/portduino/PortduinoGlue.h"
 #endif
 
+uint32_t logSubsystems = LOG_SUBSYS_ALL;
+
 /// A C wrapper for LOG_DEBUG that can be used from arduino C libs that don't know about C++ or meshtastic
 extern "C" void logLegacy(const char *level, const char *fmt, ...)
 {
@@ -112,12 +114,12 @@ bool Syslog::isEnabled()
     return this->_enabled;
 }
 
-bool Syslog::vlogf(uint16_t pri, const char *fmt, va_list args)
+bool Syslog::vlogf(uint16_t pri, uint32_t msec, const char *fmt, va_list args)
 {
-    return this->vlogf(pri, this->_appName, fmt, args);
+    return this->vlogf(pri, msec, this->_appName, fmt, args);
 }
 
-bool Syslog::vlogf(uint16_t pri, const char *appName, const char *fmt, va_list args)
+bool Syslog::vlogf(uint16_t pri, uint32_t msec, const char *appName, const char *fmt, va_list args)
 {
     char *message;
     size_t initialLen;
@@ -136,13 +138,13 @@ bool Syslog::vlogf(uint16_t pri, const char *appName, const char *fmt, va_list a
         vsnprintf(message, len + 1, fmt, args);
     }
 
-    result = this->_sendLog(pri, appName, message);
+    result = this->_sendLog(pri, msec, appName, message);
 
     delete[] message;
     return result;
 }
 
-inline bool Syslog::_sendLog(uint16_t pri, const char *appName, const char *message)
+inline bool Syslog::_sendLog(uint16_t pri, uint32_t msec, const char *appName, const char *message)
 {
     int result;
 #ifdef ARCH_PORTDUINO
@@ -187,7 +189,7 @@ inline bool Syslog::_sendLog(uint16_t pri, const char *appName, const char *mess
         this->_client->print(F(" "));
     }
     this->_client->print(F("["));
-    this->_client->print(int(millis() / 1000));
+    this->_client->print(int(msec / 1000));
     this->_client->print(F("]: "));
     this->_client->print(message);
     this->_client->endPacket();
@@ -53,10 +53,23 @@ extern MemGet memGet;
 #define LOG_TRACE(...) SEGGER_RTT_printf(0, __VA_ARGS__)
 #else
 #if defined(DEBUG_PORT) && !defined(DEBUG_MUTE)
+#if LOG_DEFERRED
+// Only a literal format is sure to still be there when the message is printed, anything else is logged right away
+#define LOG_FIRST_ARG(first, ...) first
+#define LOG_MAYBE_DEFERRED(level, ...)                                                                                           \
+    (__builtin_constant_p(LOG_FIRST_ARG(__VA_ARGS__, 0)) ? DEBUG_PORT.logDeferred(level, __VA_ARGS__)                            \
+                                                         : DEBUG_PORT.log(level, __VA_ARGS__))
+#define LOG_DEBUG(...) LOG_MAYBE_DEFERRED(MESHTASTIC_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_MAYBE_DEFERRED(MESHTASTIC_LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_MAYBE_DEFERRED(MESHTASTIC_LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_MAYBE_DEFERRED(MESHTASTIC_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
 #define LOG_DEBUG(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_DEBUG, __VA_ARGS__)
 #define LOG_INFO(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_INFO, __VA_ARGS__)
 #define LOG_WARN(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_WARN, __VA_ARGS__)
 #define LOG_ERROR(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_ERROR, __VA_ARGS__)
+#endif
+// Never deferred: a CRIT may be the last thing before a reboot, TRACE has its own path on Portduino
 #define LOG_CRIT(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_CRIT, __VA_ARGS__)
 #define LOG_TRACE(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_TRACE, __VA_ARGS__)
 #else
@@ -66,8 +79,72 @@ extern MemGet memGet;
 #define LOG_ERROR(...)
 #define LOG_CRIT(...)
 #define LOG_TRACE(...)
+// Nothing goes out, so nothing is worth working out
+#undef MESHTASTIC_LOG_MIN_LEVEL
+#define MESHTASTIC_LOG_MIN_LEVEL (MESHTASTIC_LOG_LEVEL_NUM_CRIT + 1)
+#endif
+#endif
+
+// Log levels by number, least important first
+#define MESHTASTIC_LOG_LEVEL_NUM_TRACE 0
+#define MESHTASTIC_LOG_LEVEL_NUM_DEBUG 1
+#define MESHTASTIC_LOG_LEVEL_NUM_INFO 2
+#define MESHTASTIC_LOG_LEVEL_NUM_WARN 3
+#define MESHTASTIC_LOG_LEVEL_NUM_ERROR 4
+#define MESHTASTIC_LOG_LEVEL_NUM_CRIT 5
+
+/**
+ * Messages below MESHTASTIC_LOG_MIN_LEVEL are compiled out, arguments and all, e.g.
+ * -D MESHTASTIC_LOG_MIN_LEVEL=MESHTASTIC_LOG_LEVEL_NUM_INFO. Everything is kept by default, Portduino's LogLevel setting
+ * still filters at runtime. The names stay clear of NimBLE's LOG_LEVEL_* macros, which have other values.
+ */
+#ifndef MESHTASTIC_LOG_MIN_LEVEL
+#define MESHTASTIC_LOG_MIN_LEVEL MESHTASTIC_LOG_LEVEL_NUM_TRACE
+#endif
+#define LOG_LEVEL_ENABLED(level) (MESHTASTIC_LOG_LEVEL_NUM_##level >= MESHTASTIC_LOG_MIN_LEVEL)
+
+#if !LOG_LEVEL_ENABLED(TRACE)
+#undef LOG_TRACE
+#define LOG_TRACE(...)
+#endif
+#if !LOG_LEVEL_ENABLED(DEBUG)
+#undef LOG_DEBUG
+#define LOG_DEBUG(...)
 #endif
+#if !LOG_LEVEL_ENABLED(INFO)
+#undef LOG_INFO
+#define LOG_INFO(...)
+#endif
+#if !LOG_LEVEL_ENABLED(WARN)
+#undef LOG_WARN
+#define LOG_WARN(...)
+#endif
+#if !LOG_LEVEL_ENABLED(ERROR)
+#undef LOG_ERROR
+#define LOG_ERROR(...)
 #endif
+#if !LOG_LEVEL_ENABLED(CRIT)
+#undef LOG_CRIT
+#define LOG_CRIT(...)
+#endif
+
+// Subsystems whose log output is costly to work out, each can be turned off at runtime in logSubsystems
+#define LOG_SUBSYS_PACKETS 0x01        // printPacket()
+#define LOG_SUBSYS_JSON 0x02           // Packets as JSON, at TRACE
+#define LOG_SUBSYS_PACKET_HISTORY 0x04 // Slot reuse in the packet history
+#define LOG_SUBSYS_RADIO 0x08          // Raw received bytes
+#define LOG_SUBSYS_CRYPTO 0x10         // Nonces and keys
+#define LOG_SUBSYS_ALL 0xffffffff
+
+extern uint32_t logSubsystems;
+
+/**
+ * Whether a subsystem's message at this level is wanted. Check it before working out costly arguments:
+ *   if (LOG_ENABLED(TRACE, LOG_SUBSYS_JSON))
+ *       LOG_TRACE("%s", MeshPacketSerializer::JsonSerialize(p).c_str());
+ * A level that's compiled out makes the whole block dead code.
+ */
+#define LOG_ENABLED(level, subsystem) (LOG_LEVEL_ENABLED(level) && (logSubsystems & (subsystem)) != 0)
 
 #if defined(DEBUG_HEAP)
 #define LOG_HEAP(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_HEAP, __VA_ARGS__)
@@ -175,7 +252,7 @@ class Syslog
     uint8_t _priMask = 0xff;
     bool _enabled = false;
 
-    bool _sendLog(uint16_t pri, const char *appName, const char *message);
+    bool _sendLog(uint16_t pri, uint32_t msec, const char *appName, const char *message);
 
   public:
     explicit Syslog(UDP &client);
@@ -191,8 +268,10 @@ class Syslog
     void disable();
     bool isEnabled();
 
-    bool vlogf(uint16_t pri, const char *fmt, va_list args) __attribute__((format(printf, 3, 0)));
-    bool vlogf(uint16_t pri, const char *appName, const char *fmt, va_list args) __attribute__((format(printf, 3, 0)));
+    /// @param msec when the message was logged, millis()
+    bool vlogf(uint16_t pri, uint32_t msec, const char *fmt, va_list args) __attribute__((format(printf, 4, 0)));
+    bool vlogf(uint16_t pri, uint32_t msec, const char *appName, const char *fmt, va_list args)
+        __attribute__((format(printf, 5, 0)));
 };
 
 #endif // HAS_NETWORKING
\ No newline at end of file
@@ -0,0 +1,353 @@
+#include "DeferredLog.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+static_assert((LOG_DEFERRED_BUFFER_SIZE & (LOG_DEFERRED_BUFFER_SIZE - 1)) == 0,
+              "LOG_DEFERRED_BUFFER_SIZE must be a power of two, so positions wrap around with the uint32_t counters");
+static_assert(LOG_DEFERRED_MAX_RECORD <= LOG_DEFERRED_BUFFER_SIZE, "A record must fit in the buffer");
+
+// Record: size (2 bytes, header included), state, unused, msecs, log level, format, thread name, arguments.
+// Records start 4 byte aligned, so a record header never straddles the end of the buffer.
+#define RECORD_HEADER_LEN 4
+#define RECORD_STATE_OFFSET 2
+
+enum RecordState : uint8_t {
+    STATE_EMPTY = 0, // Free, or still being written
+    STATE_READY,
+    STATE_PADDING // Skipped, the next record didn't fit before the end of the buffer
+};
+
+enum ArgType : uint8_t { ARG_NONE, ARG_INT, ARG_LONG, ARG_LONG_LONG, ARG_SIZE, ARG_DOUBLE, ARG_POINTER, ARG_STRING, ARG_UNSUPPORTED };
+
+struct Conversion {
+    const char *start;  // The '%'
+    const char *end;    // Just past the conversion character
+    uint8_t stars;      // '*' width and precision, each an int argument before the value
+    bool starPrecision; // The last '*' is the precision
+    int precision;      // A literal precision, -1 for none
+    ArgType type;
+};
+
+/// Find the next conversion in the format from p on. @return false if there is none.
+static bool nextConversion(const char *p, Conversion &c)
+{
+    while (*p && *p != '%')
+        p++;
+    if (!*p)
+        return false;
+    c.start = p++;
+    c.stars = 0;
+    c.starPrecision = false;
+    c.precision = -1;
+    if (*p == '%') {
+        c.end = p + 1;
+        c.type = ARG_NONE;
+        return true;
+    }
+
+    while (*p && strchr("-+ #0", *p))
+        p++;
+    if (*p == '*') {
+        c.stars++;
+        p++;
+    }
+    while (isdigit((unsigned char)*p))
+        p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            c.stars++;
+            c.starPrecision = true;
+            p++;
+        } else {
+            c.precision = 0;
+        }
+        while (isdigit((unsigned char)*p))
+            c.precision = c.precision * 10 + (*p++ - '0');
+    }
+
+    int longs = 0;
+    bool isSize = false, isLongDouble = false;
+    for (;; p++) {
+        if (*p == 'l')
+            longs++;
+        else if (*p == 'j' || *p == 'q')
+            longs = 2;
+        else if (*p == 'z' || *p == 't')
+            isSize = true;
+        else if (*p == 'L')
+            isLongDouble = true;
+        else if (*p != 'h')
+            break;
+    }
+
+    c.end = *p ? p + 1 : p;
+    switch (*p) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        c.type = isSize ? ARG_SIZE : longs >= 2 ? ARG_LONG_LONG : longs ? ARG_LONG : ARG_INT;
+        break;
+    case 'c':
+        c.type = longs ? ARG_UNSUPPORTED : ARG_INT;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        c.type = isLongDouble ? ARG_UNSUPPORTED : ARG_DOUBLE;
+        break;
+    case 's':
+        c.type = longs ? ARG_UNSUPPORTED : ARG_STRING;
+        break;
+    case 'p':
+        c.type = ARG_POINTER;
+        break;
+    default: // %n, or a format that ends in the middle of a conversion
+        c.type = ARG_UNSUPPORTED;
+    }
+    return true;
+}
+
+/// Bounded writes into a record being built
+class RecordWriter
+{
+  public:
+    uint8_t *buf;
+    size_t len;
+    bool overflow = false;
+
+    RecordWriter(uint8_t *buf, size_t len) : buf(buf), len(len) {}
+
+    void put(const void *p, size_t n)
+    {
+        if (len + n > LOG_DEFERRED_MAX_RECORD) {
+            overflow = true;
+            return;
+        }
+        memcpy(buf + len, p, n);
+        len += n;
+    }
+
+    template <typename T> void put(T v) { put(&v, sizeof(v)); }
+
+    /// A string of up to max bytes, as its length, the bytes and a NUL
+    void putString(const char *s, size_t max)
+    {
+        if (!s)
+            s = "(null)";
+        uint8_t n = strnlen(s, max);
+        put(n);
+        put(s, n);
+        put((char)0);
+    }
+};
+
+template <typename T> static T get(const uint8_t *buf, size_t &pos)
+{
+    T v;
+    memcpy(&v, buf + pos, sizeof(v));
+    pos += sizeof(v);
+    return v;
+}
+
+static const char *getString(const uint8_t *buf, size_t &pos)
+{
+    uint8_t n = buf[pos];
+    const char *s = (const char *)buf + pos + 1;
+    pos += 1 + n + 1;
+    return s;
+}
+
+DeferredLog::PushResult DeferredLog::push(const char *logLevel, const char *threadName, const char *format, va_list arg)
+{
+    uint8_t rec[LOG_DEFERRED_MAX_RECORD];
+    RecordWriter w(rec, RECORD_HEADER_LEN);
+    w.put((uint32_t)millis());
+    w.put(logLevel);
+    w.put(format);
+    w.putString(threadName ? threadName : "", LOG_DEFERRED_THREAD_NAME - 1);
+
+    va_list ap;
+    va_copy(ap, arg);
+    Conversion c;
+    bool supported = true;
+    for (const char *p = format; nextConversion(p, c); p = c.end) {
+        if (c.type == ARG_UNSUPPORTED) {
+            supported = false;
+            break;
+        }
+        int precision = c.precision;
+        for (int i = 0; i < c.stars; i++) {
+            int star = va_arg(ap, int);
+            w.put(star);
+            if (c.starPrecision && i == c.stars - 1)
+                precision = star; // Negative means none, as for printf
+        }
+        switch (c.type) {
+        case ARG_INT:
+            w.put(va_arg(ap, int));
+            break;
+        case ARG_LONG:
+            w.put(va_arg(ap, long));
+            break;
+        case ARG_LONG_LONG:
+            w.put(va_arg(ap, long long));
+            break;
+        case ARG_SIZE:
+            w.put(va_arg(ap, size_t));
+            break;
+        case ARG_DOUBLE:
+            w.put(va_arg(ap, double));
+            break;
+        case ARG_POINTER:
+            w.put(va_arg(ap, void *));
+            break;
+        case ARG_STRING:
+            // With a precision, the string need not be NUL terminated: never look past it
+            w.putString(va_arg(ap, const char *),
+                        precision >= 0 ? std::min(precision, LOG_DEFERRED_MAX_STRING) : LOG_DEFERRED_MAX_STRING);
+            break;
+        default:
+            break;
+        }
+    }
+    va_end(ap);
+    // Something we can't capture, or too much of it: the caller prints it right away instead
+    if (!supported || w.overflow)
+        return UNSUPPORTED;
+
+    uint16_t len = (w.len + 3) & ~3;
+    uint32_t pos = reserved.load(std::memory_order_relaxed);
+    uint32_t off, pad;
+    do {
+        off = pos % LOG_DEFERRED_BUFFER_SIZE;
+        pad = (off + len > LOG_DEFERRED_BUFFER_SIZE) ? LOG_DEFERRED_BUFFER_SIZE - off : 0;
+        if (pos + pad + len - released.load(std::memory_order_acquire) > LOG_DEFERRED_BUFFER_SIZE) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return DROPPED;
+        }
+    } while (!reserved.compare_exchange_weak(pos, pos + pad + len, std::memory_order_relaxed));
+
+    if (pad) {
+        uint16_t padLen = pad;
+        memcpy(buf + off, &padLen, sizeof(padLen));
+        __atomic_store_n(&buf[off + RECORD_STATE_OFFSET], (uint8_t)STATE_PADDING, __ATOMIC_RELEASE);
+        off = 0;
+    }
+    memcpy(buf + off, &len, sizeof(len));
+    memcpy(buf + off + RECORD_HEADER_LEN, rec + RECORD_HEADER_LEN, w.len - RECORD_HEADER_LEN);
+    __atomic_store_n(&buf[off + RECORD_STATE_OFFSET], (uint8_t)STATE_READY, __ATOMIC_RELEASE);
+    return PUSHED;
+}
+
+/// snprintf one conversion with its '*' arguments
+template <typename T> static int formatArg(char *out, size_t size, const char *spec, const int *stars, uint8_t nStars, T v)
+{
+    switch (nStars) {
+    case 0:
+        return snprintf(out, size, spec, v);
+    case 1:
+        return snprintf(out, size, spec, stars[0], v);
+    default:
+        return snprintf(out, size, spec, stars[0], stars[1], v);
+    }
+}
+
+/// Format a record the same way vsnprintf would have when it was pushed
+static void formatRecord(const uint8_t *rec, DeferredLog::Message &m)
+{
+    size_t pos = RECORD_HEADER_LEN;
+    m.msec = get<uint32_t>(rec, pos);
+    m.logLevel = get<const char *>(rec, pos);
+    const char *format = get<const char *>(rec, pos);
+    strncpy(m.threadName, getString(rec, pos), sizeof(m.threadName) - 1);
+    m.threadName[sizeof(m.threadName) - 1] = '\0';
+
+    const size_t size = sizeof(m.text);
+    size_t len = 0;
+    auto advance = [&](int n) {
+        if (n > 0)
+            len = std::min(len + n, size - 1);
+    };
+
+    Conversion c;
+    const char *p = format;
+    for (; nextConversion(p, c); p = c.end) {
+        advance(snprintf(m.text + len, size - len, "%.*s", (int)(c.start - p), p));
+
+        char spec[24];
+        size_t specLen = std::min<size_t>(c.end - c.start, sizeof(spec) - 1);
+        memcpy(spec, c.start, specLen);
+        spec[specLen] = '\0';
+
+        int stars[2];
+        for (int i = 0; i < c.stars; i++)
+            stars[i] = get<int>(rec, pos);
+
+        char *out = m.text + len;
+        size_t room = size - len;
+        switch (c.type) {
+        case ARG_NONE:
+            advance(snprintf(out, room, "%%"));
+            break;
+        case ARG_INT:
+            advance(formatArg(out, room, spec, stars, c.stars, get<int>(rec, pos)));
+            break;
+        case ARG_LONG:
+            advance(formatArg(out, room, spec, stars, c.stars, get<long>(rec, pos)));
+            break;
+        case ARG_LONG_LONG:
+            advance(formatArg(out, room, spec, stars, c.stars, get<long long>(rec, pos)));
+            break;
+        case ARG_SIZE:
+            advance(formatArg(out, room, spec, stars, c.stars, get<size_t>(rec, pos)));
+            break;
+        case ARG_DOUBLE:
+            advance(formatArg(out, room, spec, stars, c.stars, get<double>(rec, pos)));
+            break;
+        case ARG_POINTER:
+            advance(formatArg(out, room, spec, stars, c.stars, get<void *>(rec, pos)));
+            break;
+        case ARG_STRING:
+            advance(formatArg(out, room, spec, stars, c.stars, getString(rec, pos)));
+            break;
+        default:
+            break;
+        }
+    }
+    advance(snprintf(m.text + len, size - len, "%s", p));
+}
+
+bool DeferredLog::pop(Message &m)
+{
+    for (;;) {
+        uint32_t pos = released.load(std::memory_order_relaxed);
+        if (pos == reserved.load(std::memory_order_acquire))
+            return false;
+        uint32_t off = pos % LOG_DEFERRED_BUFFER_SIZE;
+        uint8_t state = __atomic_load_n(&buf[off + RECORD_STATE_OFFSET], __ATOMIC_ACQUIRE);
+        if (state == STATE_EMPTY)
+            return false;
+
+        uint16_t len;
+        memcpy(&len, buf + off, sizeof(len));
+        if (state == STATE_READY)
+            formatRecord(buf + off, m);
+        // Zero all of it, so leftovers can't look like the state of a record written here later
+        memset(buf + off, 0, len);
+        released.store(pos + len, std::memory_order_release);
+        if (state == STATE_READY)
+            return true;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes of log messages waiting to be printed, a power of two
+#ifndef LOG_DEFERRED_BUFFER_SIZE
+#define LOG_DEFERRED_BUFFER_SIZE 4096
+#endif
+// Longest %s argument kept, longer strings are cut short
+#define LOG_DEFERRED_MAX_STRING 64
+// Longest message, arguments included, that can be deferred
+#define LOG_DEFERRED_MAX_RECORD 256
+// Longest thread name kept with a message
+#define LOG_DEFERRED_THREAD_NAME 16
+
+/**
+ * Log messages captured now and formatted later.
+ *
+ * push() stores the log level and format pointers and the raw arguments, copying %s strings since they may be gone by
+ * the time the message is formatted. That is a scan of the format string and a few copies, instead of formatting and
+ * writing to a serial port from whatever thread logged. pop() formats the oldest message.
+ *
+ * Any number of threads may push at the same time and nobody waits: space is reserved with a compare-exchange, and a
+ * message that doesn't fit is counted as dropped. Only one thread may pop. The log level and format must be string
+ * literals, they're used after push() returns.
+ */
+class DeferredLog
+{
+  public:
+    enum PushResult { PUSHED, DROPPED, UNSUPPORTED };
+
+    struct Message {
+        const char *logLevel;
+        uint32_t msec; // When it was pushed
+        char threadName[LOG_DEFERRED_THREAD_NAME];
+        char text[LOG_DEFERRED_MAX_RECORD];
+    };
+
+    /**
+     * Capture a message.
+     * @return UNSUPPORTED if the format has a conversion that can't be captured (%n, long double), print it directly
+     */
+    PushResult push(const char *logLevel, const char *threadName, const char *format, va_list arg);
+
+    /// Format the oldest message. @return false if there is none, or the oldest one is still being pushed.
+    bool pop(Message &m);
+
+    /// @return the messages dropped since the last call
+    uint32_t takeDropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+
+  private:
+    alignas(4) uint8_t buf[LOG_DEFERRED_BUFFER_SIZE] = {};
+    // Bytes ever reserved by push() and released by pop(), the difference is what's in use
+    std::atomic<uint32_t> reserved{0};
+    std::atomic<uint32_t> released{0};
+    std::atomic<uint32_t> dropped{0};
+};
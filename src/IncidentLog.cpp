@@ -0,0 +1,183 @@
+#include "IncidentLog.h"
+
+#if defined(FLAMINGO) || defined(ARCH_PORTDUINO)
+
+#include "NodeDB.h"
+#include "RTC.h"
+#include "SerialConsole.h"
+#include "concurrency/LockGuard.h"
+#include <math.h>
+
+// Drain this many lines per run, so a burst of events can't hold up the main loop
+#define INCIDENTLOG_LINES_PER_RUN 4
+// How soon to try again when the console couldn't take a line
+#define INCIDENTLOG_RETRY_MSEC 20
+// Room left at the end of a message line for the fields after its text
+#define INCIDENTLOG_MSG_TAIL 8
+
+IncidentLog *incidentLog;
+
+/// Append printf output, clamped to the end of the line
+static size_t appendf(char *line, size_t len, const char *format, ...) __attribute__((format(printf, 3, 4)));
+static size_t appendf(char *line, size_t len, const char *format, ...)
+{
+    if (len >= INCIDENTLOG_MAX_LINE)
+        return len;
+    va_list arg;
+    va_start(arg, format);
+    int n = vsnprintf(line + len, INCIDENTLOG_MAX_LINE - len, format, arg);
+    va_end(arg);
+    if (n < 0)
+        return len;
+    return std::min<size_t>(len + n, INCIDENTLOG_MAX_LINE - 1);
+}
+
+/**
+ * Append s as a JSON string, stopping before the line gets longer than limit.
+ * @return false if s was cut short
+ */
+static bool appendString(char *line, size_t &len, size_t limit, const char *s, size_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+    if (len + 2 > limit)
+        return false;
+    line[len++] = '"';
+    bool complete = true;
+    for (size_t i = 0; i < n && s[i]; i++) {
+        uint8_t c = s[i];
+        char esc[6];
+        size_t escLen = 0;
+        if (c == '"' || c == '\\') {
+            esc[escLen++] = '\\';
+            esc[escLen++] = c;
+        } else if (c < 0x20) {
+            esc[escLen++] = '\\';
+            esc[escLen++] = 'u';
+            esc[escLen++] = '0';
+            esc[escLen++] = '0';
+            esc[escLen++] = hex[c >> 4];
+            esc[escLen++] = hex[c & 0xF];
+        } else {
+            esc[escLen++] = c; // UTF-8 goes through as is
+        }
+        if (len + escLen + 1 > limit) {
+            complete = false;
+            break;
+        }
+        memcpy(line + len, esc, escLen);
+        len += escLen;
+    }
+    line[len++] = '"';
+    return complete;
+}
+
+IncidentLog::IncidentLog() : concurrency::OSThread("IncidentLog") {}
+
+size_t IncidentLog::begin(const char *type)
+{
+    return appendf(eventLine, 0, "{\"t\":\"%s\",\"seq\":%u,\"ms\":%u,\"ts\":%u", type, nextSeq++, (unsigned)millis(),
+                   getValidTime(RTCQualityDevice));
+}
+
+void IncidentLog::enqueue(size_t len)
+{
+    len = appendf(eventLine, len, "}\n");
+    if (len < 2 || eventLine[len - 1] != '\n' || len > INCIDENTLOG_QUEUE_SIZE - used) {
+        // Too long, or no room: the gap in seq tells the reader
+        dropped++;
+        return;
+    }
+    size_t tail = (head + used) % INCIDENTLOG_QUEUE_SIZE;
+    size_t first = std::min(len, INCIDENTLOG_QUEUE_SIZE - tail);
+    memcpy(queue + tail, eventLine, first);
+    memcpy(queue, eventLine + first, len - first);
+    used += len;
+    setIntervalFromNow(0);
+}
+
+void IncidentLog::logMessage(const meshtastic_MeshPacket &mp, const char *dir)
+{
+    const meshtastic_NodeInfoLite *n = nodeDB ? nodeDB->getMeshNode(getFrom(&mp)) : nullptr;
+    const char *name = (n && n->has_user) ? n->user.long_name : "";
+
+    concurrency::LockGuard g(&lock);
+    size_t len = begin("msg");
+    len = appendf(eventLine, len,
+                  ",\"dir\":\"%s\",\"from\":\"!%08x\",\"to\":\"!%08x\",\"id\":%u,\"ch\":%u,\"name\":", dir, getFrom(&mp), mp.to,
+                  mp.id, mp.channel);
+    appendString(eventLine, len, INCIDENTLOG_MAX_LINE, name, sizeof(n->user.long_name));
+    len = appendf(eventLine, len, ",\"snr\":%.2f,\"rssi\":%d,\"hop_limit\":%u,\"hop_start\":%u,\"trunc\":", mp.rx_snr, mp.rx_rssi,
+                  mp.hop_limit, mp.hop_start);
+
+    // Fill in the truncation flag once we know
+    size_t truncPos = len;
+    len = appendf(eventLine, len, "0,\"text\":");
+    if (!appendString(eventLine, len, INCIDENTLOG_MAX_LINE - INCIDENTLOG_MSG_TAIL, (const char *)mp.decoded.payload.bytes,
+                      mp.decoded.payload.size))
+        eventLine[truncPos] = '1';
+    enqueue(len);
+}
+
+void IncidentLog::logRangeTest(const LinkQualityTable::Entry &e)
+{
+    concurrency::LockGuard g(&lock);
+    size_t len = begin("rt");
+    len = appendf(eventLine, len,
+                  ",\"from\":\"!%08x\",\"rx\":%u,\"span\":%u,\"burst\":%u,\"jitter_ms\":%u,\"samples\":%u,\"snr\":%.2f,\"snr_sd\":%.2f,"
+                  "\"rssi\":%.1f",
+                  e.node, LinkQualityTable::getHeard(e), e.seqSpan, LinkQualityTable::getLongestBurst(e), (unsigned)e.jitterMsec,
+                  e.samples, e.snrMean, sqrtf(e.snrVar), e.rssiMean);
+    enqueue(len);
+}
+
+void IncidentLog::logLink(const LinkStatus &s)
+{
+    concurrency::LockGuard g(&lock);
+    size_t len = begin("link");
+    len = appendf(eventLine, len,
+                  ",\"link\":\"%s\",\"cobs\":%d,\"arq\":%d,\"rx_frames\":%u,\"crc_errors\":%u,\"sent\":%u,\"dropped\":%u,"
+                  "\"srtt_ms\":%d,\"retx\":%u,\"expired\":%u",
+                  s.link, s.cobs, s.arq, s.framesReceived, s.crcErrors, s.sent, s.dropped, s.srttMsec, s.retransmissions,
+                  s.expired);
+    enqueue(len);
+}
+
+bool IncidentLog::drain(int maxLines)
+{
+    for (int i = 0; i < maxLines; i++) {
+        if (!drainLen) {
+            concurrency::LockGuard g(&lock);
+            while (drainLen < used) {
+                char c = queue[(head + drainLen) % INCIDENTLOG_QUEUE_SIZE];
+                drainLine[drainLen++] = c;
+                if (c == '\n')
+                    break;
+            }
+            head = (head + drainLen) % INCIDENTLOG_QUEUE_SIZE;
+            used -= drainLen;
+        }
+        if (!drainLen)
+            return false;
+        if (!writeLine(drainLine, drainLen))
+            return true;
+        drainLen = 0;
+    }
+    concurrency::LockGuard g(&lock);
+    return used > 0;
+}
+
+bool IncidentLog::writeLine(const char *line, size_t len)
+{
+#ifdef DEBUG_PORT
+    return console && console->writeLine(line, len);
+#else
+    return true;
+#endif
+}
+
+int32_t IncidentLog::runOnce()
+{
+    return drain(INCIDENTLOG_LINES_PER_RUN) ? INCIDENTLOG_RETRY_MSEC : INT32_MAX;
+}
+
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "configuration.h"
+
+#if defined(FLAMINGO) || defined(ARCH_PORTDUINO)
+
+#include "concurrency/Lock.h"
+#include "concurrency/OSThread.h"
+#include "mesh/LinkQualityTable.h"
+#include "mesh/generated/meshtastic/mesh.pb.h"
+
+// Bytes of events waiting to be written, an event that doesn't fit is dropped
+#define INCIDENTLOG_QUEUE_SIZE 2048
+// Longest event line, a message text that doesn't fit is cut short
+#define INCIDENTLOG_MAX_LINE 512
+
+/**
+ * Events for the Incident Command logging laptop, as JSON lines on the console.
+ *
+ * Each event is one line with a fixed set of keys for its type, formatted when it happens and written whole by a drain
+ * thread, never interleaved with a log message and never split the way the log's print buffer splits long lines. Every
+ * line starts with {"t": and has a sequence number, so a gap in "seq" shows events were dropped because the queue was full.
+ *
+ *  {"t":"msg","seq":7,"ms":81234,"ts":1760000000,"dir":"rx","from":"!a1b2c3d4","to":"!ffffffff","id":12345,"ch":0,
+ *   "name":"Base","snr":6.25,"rssi":-87,"hop_limit":3,"hop_start":3,"trunc":0,"text":"..."}
+ *  {"t":"rt","seq":8,"ms":...,"ts":...,"from":"!a1b2c3d4","rx":29,"span":32,"burst":2,"jitter_ms":140,"samples":40,
+ *   "snr":6.50,"snr_sd":1.20,"rssi":-88.0}
+ *  {"t":"link","seq":9,"ms":...,"ts":...,"link":"slink","cobs":1,"arq":1,"rx_frames":120,"crc_errors":0,"sent":118,
+ *   "dropped":0,"srtt_ms":35,"retx":2,"expired":0}
+ *
+ * "dir" is "rx" for a message received from the mesh and "phone" for one our phone sends. "ts" is 0 while we don't know
+ * the time, "ms" is the uptime.
+ */
+class IncidentLog : private concurrency::OSThread
+{
+  public:
+    /// Serial link state for a "link" event, srttMsec is -1 without ARQ
+    struct LinkStatus {
+        const char *link;
+        bool cobs, arq;
+        uint32_t framesReceived, crcErrors;
+        uint32_t sent, dropped;
+        int32_t srttMsec;
+        uint32_t retransmissions, expired;
+    };
+
+    IncidentLog();
+
+    void logMessage(const meshtastic_MeshPacket &mp, const char *dir);
+    void logRangeTest(const LinkQualityTable::Entry &e);
+    void logLink(const LinkStatus &s);
+
+    /// Events dropped because the queue was full
+    uint32_t getDropped() const { return dropped; }
+
+  protected:
+    virtual int32_t runOnce() override;
+
+    /// Write one line, newline included. @return false to try it again later.
+    virtual bool writeLine(const char *line, size_t len);
+
+    /// Write what's queued, up to maxLines lines. @return true if there is more.
+    bool drain(int maxLines);
+
+  private:
+    concurrency::Lock lock;
+    char queue[INCIDENTLOG_QUEUE_SIZE];
+    size_t head = 0, used = 0; // Lines waiting start at head, '\n' separated
+    uint32_t nextSeq = 0;
+    uint32_t dropped = 0;
+
+    // Events are formatted here with the lock held
+    char eventLine[INCIDENTLOG_MAX_LINE];
+
+    // Only touched by the drain thread
+    char drainLine[INCIDENTLOG_MAX_LINE];
+    size_t drainLen = 0; // A line taken from the queue that couldn't be written yet
+
+    /// Start eventLine with the type, sequence number and times. Lock held.
+    size_t begin(const char *type);
+    /// Queue eventLine, closing brace and newline included. Lock held.
+    void enqueue(size_t len);
+};
+
+extern IncidentLog *incidentLog;
+
+#endif
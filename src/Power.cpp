@@ -886,6 +886,7 @@ void Power::readPowerStatus()
         LOG_HEAP(threadlist);
         LOG_HEAP("Heap status: %d/%d bytes free (%d), running %d/%d threads", memGet.getFreeHeap(), memGet.getHeapSize(),
                  memGet.getFreeHeap() - lastheap, running, concurrency::mainController.size(false));
+        packetPool.logStats("Packet pool");
         lastheap = memGet.getFreeHeap();
     }
 #ifdef DEBUG_HEAP_MQTT
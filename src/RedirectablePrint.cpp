@@ -119,7 +119,8 @@ void RedirectablePrint::log_to_serial(const char *logLevel, const char *format,
             Print::write("\u001b[35m", 5);
     }
 
-    uint32_t rtc_sec = getValidTime(RTCQuality::RTCQualityDevice, true); // display local time on logfile
+    uint32_t rtc_sec = getMessageRtcSec(); // display local time on logfile
+    uint32_t msec = getMessageMsec();
     if (rtc_sec > 0) {
         long hms = rtc_sec % SEC_PER_DAY;
         // hms += tz.tz_dsttime * SEC_PER_HOUR;
@@ -136,13 +137,13 @@ void RedirectablePrint::log_to_serial(const char *logLevel, const char *format,
         if (color) {
             ::printf("\u001b[0m");
         }
-        ::printf("| %02d:%02d:%02d %u ", hour, min, sec, millis() / 1000);
+        ::printf("| %02d:%02d:%02d %u ", hour, min, sec, msec / 1000);
 #else
         printf("%s ", logLevel);
         if (color) {
             printf("\u001b[0m");
         }
-        printf("| %02d:%02d:%02d %u ", hour, min, sec, millis() / 1000);
+        printf("| %02d:%02d:%02d %u ", hour, min, sec, msec / 1000);
 #endif
     } else {
 #ifdef ARCH_PORTDUINO
@@ -150,21 +151,19 @@ void RedirectablePrint::log_to_serial(const char *logLevel, const char *format,
         if (color) {
             ::printf("\u001b[0m");
         }
-        ::printf("| ??:??:?? %u ", millis() / 1000);
+        ::printf("| ??:??:?? %u ", msec / 1000);
 #else
         printf("%s ", logLevel);
         if (color) {
             printf("\u001b[0m");
         }
-        printf("| ??:??:?? %u ", millis() / 1000);
+        printf("| ??:??:?? %u ", msec / 1000);
 #endif
     }
-    auto thread = concurrency::OSThread::currentThread;
-    if (thread) {
+    const char *threadName = getThreadName();
+    if (threadName) {
         print("[");
-        // printf("%p ", thread);
-        // assert(thread->ThreadName.length());
-        print(thread->ThreadName);
+        print(threadName);
         print("] ");
     }
 
@@ -205,11 +204,11 @@ void RedirectablePrint::log_to_syslog(const char *logLevel, const char *format,
         default:
             ll = 0;
         }
-        auto thread = concurrency::OSThread::currentThread;
-        if (thread) {
-            syslog.vlogf(ll, thread->ThreadName.c_str(), format, arg);
+        const char *threadName = getThreadName();
+        if (threadName) {
+            syslog.vlogf(ll, getMessageMsec(), threadName, format, arg);
         } else {
-            syslog.vlogf(ll, format, arg);
+            syslog.vlogf(ll, getMessageMsec(), format, arg);
         }
     }
 #endif
@@ -237,13 +236,13 @@ void RedirectablePrint::log_to_ble(const char *logLevel, const char *format, va_
                 message = new char[len + 1];
                 vsnprintf(message, len + 1, format, arg);
             }
-            auto thread = concurrency::OSThread::currentThread;
+            const char *threadName = getThreadName();
             meshtastic_LogRecord logRecord = meshtastic_LogRecord_init_zero;
             logRecord.level = getLogLevel(logLevel);
             strcpy(logRecord.message, message);
-            if (thread)
-                strcpy(logRecord.source, thread->ThreadName.c_str());
-            logRecord.time = getValidTime(RTCQuality::RTCQualityDevice, true);
+            if (threadName)
+                strcpy(logRecord.source, threadName);
+            logRecord.time = getMessageRtcSec();
 
             uint8_t *buffer = new uint8_t[meshtastic_LogRecord_size];
             size_t size = pb_encode_to_bytes(buffer, meshtastic_LogRecord_size, meshtastic_LogRecord_fields, &logRecord);
@@ -286,9 +285,63 @@ meshtastic_LogRecord_Level RedirectablePrint::getLogLevel(const char *logLevel)
     return ll;
 }
 
+bool RedirectablePrint::isFiltered(const char *logLevel)
+{
+#if ARCH_PORTDUINO
+    if (portduino_config.logoutputlevel < level_trace && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_TRACE) == 0)
+        return true;
+    if (portduino_config.logoutputlevel < level_debug && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_DEBUG) == 0)
+        return true;
+    else if (portduino_config.logoutputlevel < level_info && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_INFO) == 0)
+        return true;
+    else if (portduino_config.logoutputlevel < level_warn && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_WARN) == 0)
+        return true;
+#endif
+    return moduleConfig.serial.override_console_serial_port && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_DEBUG) == 0;
+}
+
+/// @return the name of the thread running now, nullptr if there is none
+static const char *getCurrentThreadName()
+{
+    auto thread = concurrency::OSThread::currentThread;
+    return thread ? thread->ThreadName.c_str() : nullptr;
+}
+
 void RedirectablePrint::log(const char *logLevel, const char *format, ...)
 {
+    va_list arg;
+    va_start(arg, format);
+    vlog(logLevel, format, arg);
+    va_end(arg);
+}
 
+void RedirectablePrint::vlog(const char *logLevel, const char *format, va_list arg)
+{
+#if ARCH_PORTDUINO
+    // level trace is special, two possible ways to handle it.
+    if (strcmp(logLevel, MESHTASTIC_LOG_LEVEL_TRACE) == 0 && portduino_config.traceFilename != "") {
+        va_list copy;
+        va_copy(copy, arg);
+        try {
+            traceFile << va_arg(copy, char *) << std::endl;
+        } catch (const std::ios_base::failure &e) {
+        }
+        va_end(copy);
+    }
+#endif
+    if (!isFiltered(logLevel))
+        emit(logLevel, getCurrentThreadName(), millis(), format, arg);
+}
+
+uint32_t RedirectablePrint::getMessageRtcSec() const
+{
+    uint32_t rtc_sec = getValidTime(RTCQuality::RTCQualityDevice, true);
+    uint32_t age = (millis() - messageMsec) / 1000; // A deferred message was logged a while ago
+    return rtc_sec > age ? rtc_sec - age : 0;
+}
+
+void RedirectablePrint::emit(const char *logLevel, const char *threadName, uint32_t msec, const char *format, va_list arg)
+{
     // append \n to format
     size_t len = strlen(format);
     char *newFormat = new char[len + 2];
@@ -296,39 +349,6 @@ void RedirectablePrint::log(const char *logLevel, const char *format, ...)
     newFormat[len] = '\n';
     newFormat[len + 1] = '\0';
 
-#if ARCH_PORTDUINO
-    // level trace is special, two possible ways to handle it.
-    if (strcmp(logLevel, MESHTASTIC_LOG_LEVEL_TRACE) == 0) {
-        if (portduino_config.traceFilename != "") {
-            va_list arg;
-            va_start(arg, format);
-            try {
-                traceFile << va_arg(arg, char *) << std::endl;
-            } catch (const std::ios_base::failure &e) {
-            }
-            va_end(arg);
-        }
-        if (portduino_config.logoutputlevel < level_trace && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_TRACE) == 0) {
-            delete[] newFormat;
-            return;
-        }
-    }
-    if (portduino_config.logoutputlevel < level_debug && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_DEBUG) == 0) {
-        delete[] newFormat;
-        return;
-    } else if (portduino_config.logoutputlevel < level_info && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_INFO) == 0) {
-        delete[] newFormat;
-        return;
-    } else if (portduino_config.logoutputlevel < level_warn && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_WARN) == 0) {
-        delete[] newFormat;
-        return;
-    }
-#endif
-    if (moduleConfig.serial.override_console_serial_port && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_DEBUG) == 0) {
-        delete[] newFormat;
-        return;
-    }
-
 #ifdef HAS_FREE_RTOS
     if (inDebugPrint != nullptr && xSemaphoreTake(inDebugPrint, portMAX_DELAY) == pdTRUE) {
 #else
@@ -336,14 +356,21 @@ void RedirectablePrint::log(const char *logLevel, const char *format, ...)
         inDebugPrint = true;
 #endif
 
-        va_list arg;
-        va_start(arg, format);
+        messageThreadName = threadName;
+        messageMsec = msec;
+        // Each sink gets its own copy, a va_list can only be walked once
+        va_list copy;
+        va_copy(copy, arg);
+        log_to_serial(logLevel, newFormat, copy);
+        va_end(copy);
+        va_copy(copy, arg);
+        log_to_syslog(logLevel, newFormat, copy);
+        va_end(copy);
+        va_copy(copy, arg);
+        log_to_ble(logLevel, newFormat, copy);
+        va_end(copy);
+        messageThreadName = nullptr;
 
-        log_to_serial(logLevel, newFormat, arg);
-        log_to_syslog(logLevel, newFormat, arg);
-        log_to_ble(logLevel, newFormat, arg);
-
-        va_end(arg);
 #ifdef HAS_FREE_RTOS
         xSemaphoreGive(inDebugPrint);
 #else
@@ -352,7 +379,63 @@ void RedirectablePrint::log(const char *logLevel, const char *format, ...)
     }
 
     delete[] newFormat;
-    return;
+}
+
+#if LOG_DEFERRED
+void RedirectablePrint::logDeferred(const char *logLevel, const char *format, ...)
+{
+    va_list arg;
+    va_start(arg, format);
+    if (!isFiltered(logLevel) && deferred.push(logLevel, getCurrentThreadName(), format, arg) == DeferredLog::UNSUPPORTED)
+        vlog(logLevel, format, arg);
+    va_end(arg);
+}
+
+void RedirectablePrint::emitf(const char *logLevel, const char *threadName, uint32_t msec, const char *format, ...)
+{
+    va_list arg;
+    va_start(arg, format);
+    emit(logLevel, threadName, msec, format, arg);
+    va_end(arg);
+}
+
+bool RedirectablePrint::drainDeferred(int maxMessages)
+{
+    uint32_t droppedMessages = deferred.takeDropped();
+    if (droppedMessages)
+        emitf(MESHTASTIC_LOG_LEVEL_WARN, getCurrentThreadName(), millis(),
+              "%u log messages dropped, the deferred log buffer was full", droppedMessages);
+
+    static DeferredLog::Message m;
+    for (int i = 0; i < maxMessages; i++) {
+        if (!deferred.pop(m))
+            return false;
+        // Shown as logged from the thread that pushed it, when it pushed it
+        emitf(m.logLevel, *m.threadName ? m.threadName : nullptr, m.msec, "%s", m.text);
+    }
+    return true;
+}
+#endif
+
+bool RedirectablePrint::writeLine(const char *line, size_t len)
+{
+#ifdef HAS_FREE_RTOS
+    if (inDebugPrint == nullptr || xSemaphoreTake(inDebugPrint, 0) != pdTRUE)
+        return false;
+#else
+    if (inDebugPrint)
+        return false;
+    inDebugPrint = true;
+#endif
+
+    line_to_serial(line, len);
+
+#ifdef HAS_FREE_RTOS
+    xSemaphoreGive(inDebugPrint);
+#else
+    inDebugPrint = false;
+#endif
+    return true;
 }
 
 void RedirectablePrint::hexDump(const char *logLevel, unsigned char *buf, uint16_t len)
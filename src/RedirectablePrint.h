@@ -6,6 +6,17 @@
 #include <stdarg.h>
 #include <string>
 
+/**
+ * With LOG_DEFERRED, LOG_* calls with a literal format only capture their arguments, and SerialConsole formats and prints
+ * them a little later on its own thread. A message logged while the buffer is full is dropped and counted.
+ */
+#ifndef LOG_DEFERRED
+#define LOG_DEFERRED 0
+#endif
+#if LOG_DEFERRED
+#include "DeferredLog.h"
+#endif
+
 /**
  * A Printable that can be switched to squirt its bytes to a different sink.
  * This class is mostly useful to allow debug printing to be redirected away from Serial
@@ -40,20 +51,58 @@ class RedirectablePrint : public Print
      * allows you to call logDebug a few times to build up a single log message line if you wish.
      */
     void log(const char *logLevel, const char *format, ...) __attribute__((format(printf, 3, 4)));
+    void vlog(const char *logLevel, const char *format, va_list arg);
+
+#if LOG_DEFERRED
+    /// Like log(), but only captures the message for drainDeferred(). The format must be a string literal.
+    void logDeferred(const char *logLevel, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+    /**
+     * Print up to maxMessages deferred messages.
+     * @return true if there are more
+     */
+    bool drainDeferred(int maxMessages);
+#endif
 
     /** like printf but va_list based */
     size_t vprintf(const char *logLevel, const char *format, va_list arg);
 
     void hexDump(const char *logLevel, unsigned char *buf, uint16_t len);
 
+    /**
+     * Write a line as is, between log messages rather than in the middle of one.
+     * @return false if the output is busy, try again later
+     */
+    virtual bool writeLine(const char *line, size_t len);
+
     std::string mt_sprintf(const std::string fmt_str, ...);
 
   protected:
     /// Subclasses can override if they need to change how we format over the serial port
     virtual void log_to_serial(const char *logLevel, const char *format, va_list arg);
+    /// Likewise for writeLine(), called with the output held
+    virtual void line_to_serial(const char *line, size_t len) { Print::write(line, len); }
     meshtastic_LogRecord_Level getLogLevel(const char *logLevel);
+    /// @return the name of the thread that logged the message going out, nullptr if none did
+    const char *getThreadName() const { return messageThreadName; }
+    /// @return when the message going out was logged, millis()
+    uint32_t getMessageMsec() const { return messageMsec; }
+    /// @return the RTC time the message going out was logged at, 0 if the RTC isn't set
+    uint32_t getMessageRtcSec() const;
 
   private:
+    const char *messageThreadName = nullptr; // Set by emit() while inDebugPrint is held
+    uint32_t messageMsec = 0;                // Likewise
+#if LOG_DEFERRED
+    DeferredLog deferred;
+    void emitf(const char *logLevel, const char *threadName, uint32_t msec, const char *format, ...)
+        __attribute__((format(printf, 5, 6)));
+#endif
+
+    /// @return true if messages of this level aren't wanted
+    bool isFiltered(const char *logLevel);
+    /// Send a message to every sink
+    void emit(const char *logLevel, const char *threadName, uint32_t msec, const char *format, va_list arg);
     void log_to_syslog(const char *logLevel, const char *format, va_list arg);
     void log_to_ble(const char *logLevel, const char *format, va_list arg);
 };
\ No newline at end of file
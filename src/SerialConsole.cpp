@@ -2,6 +2,7 @@
 #include "Default.h"
 #include "NodeDB.h"
 #include "PowerFSM.h"
+#include "RTC.h"
 #include "Throttle.h"
 #include "configuration.h"
 #include "time.h"
@@ -28,6 +29,22 @@
 
 SerialConsole *console;
 
+#if LOG_DEFERRED
+// Deferred messages printed per run, so a burst can't hold up the main loop
+#define LOG_DRAIN_PER_RUN 8
+#define LOG_DRAIN_INTERVAL_MSEC 50
+
+/// Prints the messages LOG_* calls deferred
+class LogDrainThread : public concurrency::OSThread
+{
+  public:
+    LogDrainThread() : concurrency::OSThread("LogDrain") {}
+
+  protected:
+    virtual int32_t runOnce() override { return console->drainDeferred(LOG_DRAIN_PER_RUN) ? 0 : LOG_DRAIN_INTERVAL_MSEC; }
+};
+#endif
+
 void consoleInit()
 {
     auto sc = new SerialConsole(); // Must be dynamically allocated because we are now inheriting from thread
@@ -37,6 +54,9 @@ void consoleInit()
     Port.onReceive([sc]() { sc->rxInt(); });
 #endif
     DEBUG_PORT.rpInit(); // Simply sets up semaphore
+#if LOG_DEFERRED
+    new LogDrainThread();
+#endif
 }
 
 void consolePrintf(const char *format, ...)
@@ -98,6 +118,10 @@ int32_t SerialConsole::runOnce()
 
 void SerialConsole::flush()
 {
+#if LOG_DEFERRED
+    while (drainDeferred(LOG_DRAIN_PER_RUN))
+        ;
+#endif
     Port.flush();
 }
 
@@ -141,8 +165,24 @@ void SerialConsole::log_to_serial(const char *logLevel, const char *format, va_l
 {
     if (usingProtobufs && config.security.debug_log_api_enabled) {
         meshtastic_LogRecord_Level ll = RedirectablePrint::getLogLevel(logLevel);
-        auto thread = concurrency::OSThread::currentThread;
-        emitLogRecord(ll, thread ? thread->ThreadName.c_str() : "", format, arg);
+        const char *threadName = getThreadName();
+        emitLogRecord(ll, threadName ? threadName : "", getMessageRtcSec(), format, arg);
     } else
         RedirectablePrint::log_to_serial(logLevel, format, arg);
+}
+
+void SerialConsole::line_to_serial(const char *line, size_t len)
+{
+    if (usingProtobufs && config.security.debug_log_api_enabled)
+        emitLogRecordf(meshtastic_LogRecord_Level_INFO, "", "%.*s", (int)len, line);
+    else
+        RedirectablePrint::line_to_serial(line, len);
+}
+
+void SerialConsole::emitLogRecordf(meshtastic_LogRecord_Level level, const char *src, const char *format, ...)
+{
+    va_list arg;
+    va_start(arg, format);
+    emitLogRecord(level, src, getValidTime(RTCQuality::RTCQualityDevice, true), format, arg);
+    va_end(arg);
 }
\ No newline at end of file
@@ -42,6 +42,12 @@ class SerialConsole : public StreamAPI, public RedirectablePrint, private concur
 
     /// Possibly switch to protobufs if we see a valid protobuf message
     virtual void log_to_serial(const char *logLevel, const char *format, va_list arg);
+    /// Lines go out the same way as log messages
+    virtual void line_to_serial(const char *line, size_t len) override;
+
+  private:
+    void emitLogRecordf(meshtastic_LogRecord_Level level, const char *src, const char *format, ...)
+        __attribute__((format(printf, 4, 5)));
 };
 
 // A simple wrapper to allow non class aware code write to the console
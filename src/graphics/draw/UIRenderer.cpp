@@ -18,6 +18,9 @@
 #include <OLEDDisplay.h>
 #include <RTC.h>
 #include <cstring>
+#ifdef FLAMINGO
+#include "modules/RangeTestModule.h"
+#endif
 
 // External variables
 extern graphics::Screen *screen;
@@ -362,6 +365,18 @@ void UIRenderer::drawNodeInfo(OLEDDisplay *display, const OLEDDisplayUiState *st
     if (signalHopsStr[0] && line < 5) {
         display->drawString(x, getTextPositions(display)[line++], signalHopsStr);
     }
+#ifdef FLAMINGO
+    // === 2b. Range test link quality, if this node sends range tests we hear ===
+    const LinkQualityTable::Entry *link = rangeTestLinks.get(node->num);
+    if (link && LinkQualityTable::hasSnr(*link) && line < 5) {
+        char linkStr[32];
+        int loss = LinkQualityTable::getLossPercent(*link);
+        int len = snprintf(linkStr, sizeof(linkStr), " RT: %.1fdB sd %.1f", link->snrMean, sqrtf(link->snrVar));
+        if (loss >= 0)
+            snprintf(linkStr + len, sizeof(linkStr) - len, " %d%% lost", loss);
+        display->drawString(x, getTextPositions(display)[line++], linkStr);
+    }
+#endif
 
     // === 3. Heard (last seen, skip if node never seen) ===
     char seenStr[20] = "";
@@ -18,6 +18,9 @@
 #include "Throttle.h"
 #include "concurrency/OSThread.h"
 #include "concurrency/Periodic.h"
+#ifdef FLAMINGO
+#include "IncidentLog.h"
+#endif
 #include "detect/ScanI2C.h"
 #include "error.h"
 #include "power.h"
@@ -418,6 +421,9 @@ void setup()
 
 #ifdef DEBUG_PORT
     consoleInit(); // Set serial baud rate and init our mesh console
+#ifdef FLAMINGO
+    incidentLog = new IncidentLog();
+#endif
 #endif
 
 #ifdef UNPHONE
@@ -273,6 +273,7 @@ void Channels::initDefaults()
     channelFile.channels_count = MAX_NUM_CHANNELS;
     for (int i = 0; i < channelFile.channels_count; i++)
         fixupChannel(i);
+    buildHashTable();
     initDefaultLoraConfig();
 
 #ifdef USERPREFS_CHANNELS_TO_WRITE
@@ -293,6 +294,7 @@ void Channels::onConfigChanged()
         if (ch.role == meshtastic_Channel_Role_PRIMARY)
             primaryIndex = i;
     }
+    buildHashTable();
 #if !MESHTASTIC_EXCLUDE_MQTT
     if (channels.anyMqttEnabled() && mqtt && !mqtt->isEnabled()) {
         LOG_DEBUG("MQTT is enabled on at least one channel, so set MQTT thread to run immediately");
@@ -404,6 +406,15 @@ bool Channels::hasDefaultChannel()
     return false;
 }
 
+void Channels::buildHashTable()
+{
+    memset(channelsByHash, 0, sizeof(channelsByHash));
+    for (ChannelIndex i = 0; i < getNumChannels() && i < MAX_NUM_CHANNELS; i++) {
+        if (hashes[i] >= 0)
+            channelsByHash[hashes[i]] |= (1 << i);
+    }
+}
+
 /** Given a channel hash setup crypto for decoding that channel (or the primary channel if that channel is unsecured)
  *
  * This method is called before decoding inbound packets
@@ -28,6 +28,10 @@ class Channels
     /// the precomputed hashes for each of our channels, or -1 for invalid
     int16_t hashes[MAX_NUM_CHANNELS] = {};
 
+    /// for each possible channel hash, a bitmask of the channel indexes that have this hash (built by buildHashTable)
+    uint8_t channelsByHash[256] = {};
+    static_assert(MAX_NUM_CHANNELS <= 8, "channelsByHash bitmask needs to be widened");
+
   public:
     Channels() {}
 
@@ -96,6 +100,9 @@ class Channels
 
     bool setDefaultPresetCryptoForHash(ChannelHash channelHash);
 
+    /** Return a bitmask of the channel indexes whose hash matches, so inbound packets only try those for decryption */
+    uint8_t getChannelsForHash(ChannelHash channelHash) const { return channelsByHash[channelHash]; }
+
   private:
     /** Given a channel index, change to use the crypto key specified by that index
      *
@@ -115,6 +122,9 @@ class Channels
 
     int16_t getHash(ChannelIndex i) { return hashes[i]; }
 
+    /** Rebuild channelsByHash from the current channel hashes */
+    void buildHashTable();
+
     /**
      * Validate a channel, fixing any errors as needed
      */
@@ -33,6 +33,7 @@ void CryptoEngine::generateKeyPair(uint8_t *pubKey, uint8_t *privKey)
 
     LOG_DEBUG("Generate Curve25519 keypair");
     Curve25519::dh1(public_key, private_key);
+    clearSharedKeyCache();
     memcpy(pubKey, public_key, sizeof(public_key));
     memcpy(privKey, private_key, sizeof(private_key));
 }
@@ -54,6 +55,7 @@ bool CryptoEngine::regeneratePublicKey(uint8_t *pubKey, uint8_t *privKey)
         }
         memcpy(private_key, privKey, sizeof(private_key));
         memcpy(public_key, pubKey, sizeof(public_key));
+        clearSharedKeyCache();
     } else {
         LOG_WARN("X25519 key generation failed due to blank private key");
         return false;
@@ -65,6 +67,54 @@ void CryptoEngine::clearKeys()
 {
     memset(public_key, 0, sizeof(public_key));
     memset(private_key, 0, sizeof(private_key));
+    clearSharedKeyCache();
+}
+
+void CryptoEngine::clearSharedKeyCache()
+{
+    memset(sharedKeyCache, 0, sizeof(sharedKeyCache));
+    sharedKeyCacheClock = 0;
+}
+
+void CryptoEngine::invalidateSharedKey(const uint8_t *remotePublic)
+{
+    for (auto &entry : sharedKeyCache) {
+        if (entry.lastUsed && memcmp(entry.remotePublic, remotePublic, 32) == 0)
+            memset(&entry, 0, sizeof(entry));
+    }
+}
+
+/**
+ * Set shared_key for a remote public key. The X25519 step plus SHA256 takes tens of ms on the slower MCUs, so the result is
+ * kept in a small LRU cache keyed by the remote public key.
+ */
+bool CryptoEngine::setSharedKey(const uint8_t *remotePublic)
+{
+    SharedKeyCacheEntry *victim = &sharedKeyCache[0];
+    for (auto &entry : sharedKeyCache) {
+        if (entry.lastUsed && memcmp(entry.remotePublic, remotePublic, 32) == 0) {
+            entry.lastUsed = ++sharedKeyCacheClock;
+            memcpy(shared_key, entry.sharedKey, 32);
+            sharedKeyCacheHits++;
+            return true;
+        }
+        if (entry.lastUsed < victim->lastUsed)
+            victim = &entry; // Empty slots (0) win, otherwise the least recently used one
+    }
+
+    sharedKeyCacheMisses++;
+    uint8_t pubKey[32];
+    memcpy(pubKey, remotePublic, 32);
+    if (!setDHPublicKey(pubKey)) {
+        return false;
+    }
+    hash(shared_key, 32);
+
+    memcpy(victim->remotePublic, remotePublic, 32);
+    memcpy(victim->sharedKey, shared_key, 32);
+    victim->lastUsed = ++sharedKeyCacheClock;
+    LOG_DEBUG("Shared key cache miss, %u hits / %u misses so far", sharedKeyCacheHits, sharedKeyCacheMisses);
+    return true;
 }
 
 /**
@@ -92,15 +142,16 @@ bool CryptoEngine::encryptCurve25519(uint32_t toNode, uint32_t fromNode, meshtas
         LOG_DEBUG("Node %d or their public_key not found", toNode);
         return false;
     }
-    if (!setDHPublicKey(remotePublic.bytes)) {
+    if (!setSharedKey(remotePublic.bytes)) {
         return false;
     }
-    hash(shared_key, 32);
     initNonce(fromNode, packetNum, extraNonceTmp);
 
     // Calculate the shared secret with the destination node and encrypt
-    printBytes("Attempt encrypt with nonce: ", nonce, 13);
-    printBytes("Attempt encrypt with shared_key starting with: ", shared_key, 8);
+    if (LOG_ENABLED(DEBUG, LOG_SUBSYS_CRYPTO)) {
+        printBytes("Attempt encrypt with nonce: ", nonce, 13);
+        printBytes("Attempt encrypt with shared_key starting with: ", shared_key, 8);
+    }
     aes_ccm_ae(shared_key, 32, nonce, 8, bytes, numBytes, nullptr, 0, bytesOut,
                auth); // this can write up to 15 bytes longer than numbytes past bytesOut
     memcpy((uint8_t *)(auth + 8), &extraNonceTmp,
@@ -134,20 +185,22 @@ bool CryptoEngine::decryptCurve25519(uint32_t fromNode, meshtastic_UserLite_publ
     }
 
     // Calculate the shared secret with the sending node and decrypt
-    if (!setDHPublicKey(remotePublic.bytes)) {
+    if (!setSharedKey(remotePublic.bytes)) {
         return false;
     }
-    hash(shared_key, 32);
 
     initNonce(fromNode, packetNum, extraNonce);
-    printBytes("Attempt decrypt with nonce: ", nonce, 13);
-    printBytes("Attempt decrypt with shared_key starting with: ", shared_key, 8);
+    if (LOG_ENABLED(DEBUG, LOG_SUBSYS_CRYPTO)) {
+        printBytes("Attempt decrypt with nonce: ", nonce, 13);
+        printBytes("Attempt decrypt with shared_key starting with: ", shared_key, 8);
+    }
     return aes_ccm_ad(shared_key, 32, nonce, 8, bytes, numBytes - 12, nullptr, 0, auth, bytesOut);
 }
 
 void CryptoEngine::setDHPrivateKey(uint8_t *_private_key)
 {
     memcpy(private_key, _private_key, 32);
+    clearSharedKeyCache();
 }
 
 /**
@@ -23,6 +23,11 @@ struct CryptoKey {
 #define MAX_BLOCKSIZE 256
 #define TEST_CURVE25519_FIELD_OPS // Exposes Curve25519::isWeakPoint() for testing keys
 
+// Number of remote public keys we keep the derived (DH + SHA256) shared key for
+#ifndef PKI_SHARED_KEY_CACHE_SIZE
+#define PKI_SHARED_KEY_CACHE_SIZE 8
+#endif
+
 class CryptoEngine
 {
   public:
@@ -46,6 +51,13 @@ class CryptoEngine
     virtual bool setDHPublicKey(uint8_t *publicKey);
     virtual void hash(uint8_t *bytes, size_t numBytes);
 
+    /// Forget the cached shared key for a remote public key, e.g. because a node's key changed
+    void invalidateSharedKey(const uint8_t *remotePublic);
+    /// Forget all cached shared keys, they are no good once our own private key changes
+    void clearSharedKeyCache();
+    /// Lookups in the shared key cache that avoided a DH computation, and those that needed one
+    uint32_t sharedKeyCacheHits = 0, sharedKeyCacheMisses = 0;
+
     virtual void aesSetKey(const uint8_t *key, size_t key_len);
 
     virtual void aesEncrypt(uint8_t *in, uint8_t *out);
@@ -82,6 +94,20 @@ class CryptoEngine
 #if !(MESHTASTIC_EXCLUDE_PKI)
     uint8_t shared_key[32] = {0};
     uint8_t private_key[32] = {0};
+
+    struct SharedKeyCacheEntry {
+        uint8_t remotePublic[32];
+        uint8_t sharedKey[32];
+        uint32_t lastUsed; // sharedKeyCacheClock value of the last hit, 0 means empty
+    };
+    SharedKeyCacheEntry sharedKeyCache[PKI_SHARED_KEY_CACHE_SIZE] = {};
+    uint32_t sharedKeyCacheClock = 0;
+
+    /**
+     * Set shared_key to the hashed DH shared secret for a remote public key, computing it only if it isn't cached
+     * @return false if the key agreement failed
+     */
+    bool setSharedKey(const uint8_t *remotePublic);
 #endif
     /**
      * Init our 128 bit nonce for a new packet
@@ -0,0 +1,145 @@
+#include "LinkQualityTable.h"
+#include "configuration.h"
+#include <algorithm>
+#include <math.h>
+
+// Weight of a new sample in the rolling means and variances
+#define LINKQUALITY_ALPHA 0.25f
+// Weight of a new sample in the jitter, as in RFC 3550
+#define LINKQUALITY_JITTER_GAIN (1.0f / 16)
+// Gaps longer than this many sequence numbers say more about the sender pausing than about the link
+#define LINKQUALITY_MAX_JITTER_STEPS 4
+
+static void updateMeanVar(float &mean, float &var, float x, bool first)
+{
+    if (first) {
+        mean = x;
+        var = 0;
+        return;
+    }
+    // Exponentially weighted mean and variance, see Finch, "Incremental calculation of weighted mean and variance"
+    float diff = x - mean;
+    float incr = LINKQUALITY_ALPHA * diff;
+    mean += incr;
+    var = (1 - LINKQUALITY_ALPHA) * (var + diff * incr);
+}
+
+void LinkQualityTable::update(NodeNum from, float snr, int32_t rssi, bool direct, uint32_t now, uint32_t seq)
+{
+    Entry &e = findOrAdd(from, now);
+    e.lastHeardMsec = now;
+    if (direct) {
+        updateMeanVar(e.snrMean, e.snrVar, snr, e.samples == 0);
+        updateMeanVar(e.rssiMean, e.rssiVar, rssi, e.samples == 0);
+        if (e.samples < UINT16_MAX)
+            e.samples++;
+    }
+    if (seq)
+        updateSeq(e, seq, now);
+}
+
+void LinkQualityTable::updateSeq(Entry &e, uint32_t seq, uint32_t now)
+{
+    if (e.seqSpan > 0 && seq > e.lastSeq) {
+        uint32_t ahead = seq - e.lastSeq;
+        e.seqBitmap = (ahead >= LINKQUALITY_SEQ_WINDOW ? 0 : e.seqBitmap << ahead) | 1;
+        e.seqSpan = std::min<uint32_t>(e.seqSpan + ahead, LINKQUALITY_SEQ_WINDOW);
+        e.lastSeq = seq;
+        updateJitter(e, ahead, now);
+    } else if (e.seqSpan > 0 && e.lastSeq - seq <= LINKQUALITY_MAX_REORDER) {
+        // A late copy, or another copy of one we heard already
+        if (e.lastSeq - seq < e.seqSpan)
+            e.seqBitmap |= 1u << (e.lastSeq - seq);
+    } else {
+        // First one, or the sender restarted its count
+        e.lastSeq = seq;
+        e.seqBitmap = 1;
+        e.seqSpan = 1;
+        e.lastSeqMsec = now;
+        e.intervalMsec = 0;
+        e.jitterMsec = 0;
+    }
+}
+
+void LinkQualityTable::updateJitter(Entry &e, uint32_t steps, uint32_t now)
+{
+    float elapsed = now - e.lastSeqMsec;
+    e.lastSeqMsec = now;
+    if (steps > LINKQUALITY_MAX_JITTER_STEPS)
+        return;
+
+    float interval = elapsed / steps;
+    if (e.intervalMsec == 0) {
+        e.intervalMsec = interval;
+        return;
+    }
+    // How far off this one was from when the mean interval said it was due
+    float deviation = fabsf(elapsed - e.intervalMsec * steps);
+    e.jitterMsec += LINKQUALITY_JITTER_GAIN * (deviation - e.jitterMsec);
+    e.intervalMsec += LINKQUALITY_ALPHA * (interval - e.intervalMsec);
+}
+
+static uint32_t spanMask(const LinkQualityTable::Entry &e)
+{
+    return e.seqSpan >= 32 ? UINT32_MAX : (1u << e.seqSpan) - 1;
+}
+
+uint8_t LinkQualityTable::getHeard(const Entry &e)
+{
+    return __builtin_popcount(e.seqBitmap & spanMask(e));
+}
+
+int LinkQualityTable::getLossPercent(const Entry &e)
+{
+    if (e.seqSpan == 0)
+        return -1;
+    return (e.seqSpan - getHeard(e)) * 100 / e.seqSpan;
+}
+
+uint8_t LinkQualityTable::getLongestBurst(const Entry &e)
+{
+    // Shift the lost bits onto themselves until none are left: the number of shifts is the longest run
+    uint32_t lost = ~e.seqBitmap & spanMask(e);
+    uint8_t longest = 0;
+    while (lost) {
+        lost &= lost >> 1;
+        longest++;
+    }
+    return longest;
+}
+
+const LinkQualityTable::Entry *LinkQualityTable::get(NodeNum node) const
+{
+    for (const Entry &e : entries) {
+        if (e.node == node && node)
+            return &e;
+    }
+    return nullptr;
+}
+
+LinkQualityTable::Entry &LinkQualityTable::findOrAdd(NodeNum node, uint32_t now)
+{
+    Entry *oldest = &entries[0];
+    for (Entry &e : entries) {
+        if (e.node == node)
+            return e;
+        if (!e.node) {
+            // Entries are only ever freed all at once, so node isn't in any of the ones after this
+            oldest = &e;
+            break;
+        }
+        if (now - e.lastHeardMsec > now - oldest->lastHeardMsec)
+            oldest = &e;
+    }
+    if (oldest->node)
+        LOG_DEBUG("Link quality table full, forgetting 0x%x", oldest->node);
+    *oldest = {};
+    oldest->node = node;
+    return *oldest;
+}
+
+void LinkQualityTable::clear()
+{
+    for (Entry &e : entries)
+        e = {};
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+// Senders we keep track of, the one heard least recently makes room for a new one
+#define LINKQUALITY_MAX_SENDERS 16
+// Sequence numbers the loss rate is computed over
+#define LINKQUALITY_SEQ_WINDOW 32
+// A copy this many sequence numbers behind the last one is late, further back the sender restarted its count
+#define LINKQUALITY_MAX_REORDER 2
+// Samples needed before the SNR mean means something
+#define LINKQUALITY_MIN_SAMPLES 3
+
+/**
+ * Link quality per sender, from the packets we hear from it: rolling SNR and RSSI means and variances, the loss rate and
+ * longest loss burst over its last LINKQUALITY_SEQ_WINDOW sequence numbers, the jitter of their arrival times and when we
+ * last heard it.
+ *
+ * The means and variances are exponentially weighted, so each packet is an O(1) update and recent packets count most. Only
+ * packets heard directly from the sender count towards them, a relayed copy tells more about the relay than the sender.
+ * Every copy counts for the loss rate.
+ *
+ * The sender's interval isn't known here, so jitter is measured against the mean arrival interval per sequence number: the
+ * smoothed deviation of each arrival from when that interval said it was due, like the RTP interarrival jitter (RFC 3550).
+ */
+class LinkQualityTable
+{
+  public:
+    struct Entry {
+        NodeNum node;           // 0 for an unused entry
+        uint32_t lastHeardMsec;
+        uint16_t samples;       // SNR/RSSI samples, saturating
+        float snrMean, snrVar;
+        float rssiMean, rssiVar;
+        uint32_t lastSeq;       // Highest sequence number heard
+        uint32_t seqBitmap;     // Bit i: lastSeq - i was heard
+        uint8_t seqSpan;        // Sequence numbers the bitmap covers, up to LINKQUALITY_SEQ_WINDOW
+        uint32_t lastSeqMsec;   // When lastSeq first arrived
+        float intervalMsec;     // Mean time between sequence numbers, 0 until two arrived
+        float jitterMsec;
+    };
+
+    /**
+     * Record a packet from 'from'.
+     * @param direct true if it was heard from the sender itself, not through a relay
+     * @param nowMsec when it arrived, millis()
+     * @param seq its sequence number, 0 if it has none
+     */
+    void update(NodeNum from, float snr, int32_t rssi, bool direct, uint32_t nowMsec, uint32_t seq = 0);
+
+    /// @return the entry of a sender, or nullptr if we haven't heard from it (lately)
+    const Entry *get(NodeNum node) const;
+
+    /// @return true if there are enough samples for the SNR mean to mean something
+    static bool hasSnr(const Entry &e) { return e.samples >= LINKQUALITY_MIN_SAMPLES; }
+
+    /// @return the percentage of sequence numbers lost in the window, or -1 with none heard
+    static int getLossPercent(const Entry &e);
+
+    /// @return the sequence numbers heard in the window
+    static uint8_t getHeard(const Entry &e);
+
+    /// @return the longest run of sequence numbers lost in a row in the window
+    static uint8_t getLongestBurst(const Entry &e);
+
+    /// Iterate over the senders, stops when f returns false
+    template <typename F> void forEach(F f) const
+    {
+        for (const Entry &e : entries) {
+            if (e.node && !f(e))
+                return;
+        }
+    }
+
+    void clear();
+
+  private:
+    Entry entries[LINKQUALITY_MAX_SENDERS] = {};
+
+    Entry &findOrAdd(NodeNum node, uint32_t now);
+    static void updateSeq(Entry &e, uint32_t seq, uint32_t now);
+    static void updateJitter(Entry &e, uint32_t steps, uint32_t now);
+};
@@ -2,12 +2,21 @@
 
 #include <Arduino.h>
 #include <assert.h>
+#include <atomic>
 #include <functional>
 #include <memory>
 
 #include "PointerQueue.h"
 #include "configuration.h" // For LOG_WARN, LOG_DEBUG, LOG_HEAP
 
+/// Usage counters of an Allocator, see Allocator::getStats()
+struct AllocatorStats {
+    uint32_t inUse;        // Buffers currently handed out
+    uint32_t highWater;    // Most buffers ever handed out at the same time
+    uint32_t failedAllocs; // Allocations that returned nullptr
+    uint32_t capacity;     // Number of buffers in the pool, 0 if only limited by the heap
+};
+
 template <class T> class Allocator
 {
 
@@ -69,10 +78,33 @@ template <class T> class Allocator
     /// Return a buffer for use by others
     virtual void release(T *p) = 0;
 
+    /// Return the usage counters of this allocator.
+    /// Note: this method is safe to call from regular OR ISR code
+    virtual AllocatorStats getStats() const = 0;
+
+    /// Print the usage counters at heap log level, so pool exhaustion during bursts shows up next to the heap status
+    void logStats(const char *name) const
+    {
+        AllocatorStats stats = getStats();
+        LOG_HEAP("%s: %u/%u in use, high water %u, %u failed allocs", name, stats.inUse, stats.capacity, stats.highWater,
+                 stats.failedAllocs);
+    }
+
   protected:
     // Alloc some storage
     virtual T *alloc(TickType_t maxWait) = 0;
 
+    std::atomic<uint32_t> inUse{0}, highWater{0}, failedAllocs{0};
+
+    /// Account for a buffer handed out by alloc()
+    void countAlloc()
+    {
+        uint32_t n = ++inUse;
+        uint32_t hw = highWater.load(std::memory_order_relaxed);
+        while (n > hw && !highWater.compare_exchange_weak(hw, n, std::memory_order_relaxed))
+            ;
+    }
+
   private:
     // std::unique_ptr Deleter function; calls release().
     const std::function<void(T *)> deleter;
@@ -93,6 +125,12 @@ template <class T> class MemoryDynamic : public Allocator<T>
         LOG_HEAP("Freeing 0x%x", p);
 
         free(p);
+        this->inUse--;
+    }
+
+    virtual AllocatorStats getStats() const override
+    {
+        return {this->inUse.load(), this->highWater.load(), this->failedAllocs.load(), 0};
     }
 
   protected:
@@ -101,25 +139,42 @@ template <class T> class MemoryDynamic : public Allocator<T>
     {
         T *p = (T *)malloc(sizeof(T));
         assert(p);
+        if (p)
+            this->countAlloc();
+        else
+            this->failedAllocs++;
         return p;
     }
 };
 
 /**
  * A static memory pool that uses a fixed buffer instead of heap allocation
+ *
+ * Free buffers are kept on an intrusive lock-free stack, so alloc and release are O(1) and safe to call from both
+ * ISR and thread context.
  */
 template <class T, int MaxSize> class MemoryPool : public Allocator<T>
 {
+    static_assert(MaxSize > 0 && MaxSize < 0xFFFF, "MemoryPool free list uses 16 bit indexes");
+
   private:
+    static constexpr uint16_t NO_ITEM = 0xFFFF;
+
     T pool[MaxSize];
     bool used[MaxSize];
+    uint16_t nextFree[MaxSize]; // Free list link, only meaningful while the item is free
+
+    /// Index of the first free item in the low 16 bits, and a counter bumped on every change in the high 16 bits so a
+    /// compare-exchange racing with a pop and push of the same item fails instead of corrupting the list (ABA).
+    std::atomic<uint32_t> freeHead;
 
   public:
     MemoryPool() : pool{}, used{}
     {
-        // Arrays are now zero-initialized by member initializer list
-        // pool array: all elements are default-constructed (zero for POD types)
-        // used array: all elements are false (zero-initialized)
+        // Arrays are zero-initialized by member initializer list, chain every item onto the free list
+        for (int i = 0; i < MaxSize; i++)
+            nextFree[i] = (i + 1 < MaxSize) ? i + 1 : NO_ITEM;
+        freeHead.store(0);
     }
 
     /// Return a buffer for use by others
@@ -135,27 +190,47 @@ template <class T, int MaxSize> class MemoryPool : public Allocator<T>
         if (index >= 0 && index < MaxSize) {
             assert(used[index]); // Should be marked as used
             used[index] = false;
+
+            uint32_t head = freeHead.load(std::memory_order_relaxed);
+            uint32_t newHead;
+            do {
+                nextFree[index] = head & 0xFFFF;
+                newHead = ((head + 0x10000) & 0xFFFF0000) | index;
+            } while (!freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+            this->inUse--;
             LOG_HEAP("Released static pool item %d at 0x%x", index, p);
         } else {
             LOG_WARN("Pointer 0x%x not from our pool!", p);
         }
     }
 
+    virtual AllocatorStats getStats() const override
+    {
+        return {this->inUse.load(), this->highWater.load(), this->failedAllocs.load(), MaxSize};
+    }
+
   protected:
     // Alloc some storage from our static pool
     virtual T *alloc(TickType_t maxWait) override
     {
-        // Find first free slot
-        for (int i = 0; i < MaxSize; i++) {
-            if (!used[i]) {
-                used[i] = true;
-                LOG_HEAP("Allocated static pool item %d at 0x%x", i, &pool[i]);
-                return &pool[i];
+        // Pop the first free item
+        uint32_t head = freeHead.load(std::memory_order_acquire);
+        uint16_t index;
+        do {
+            index = head & 0xFFFF;
+            if (index == NO_ITEM) {
+                // No free slots available - return nullptr instead of asserting
+                this->failedAllocs++;
+                LOG_WARN("No free slots available in static memory pool!");
+                return nullptr;
             }
-        }
-
-        // No free slots available - return nullptr instead of asserting
-        LOG_WARN("No free slots available in static memory pool!");
-        return nullptr;
+        } while (!freeHead.compare_exchange_weak(head, ((head + 0x10000) & 0xFFFF0000) | nextFree[index],
+                                                 std::memory_order_acquire, std::memory_order_acquire));
+
+        assert(!used[index]);
+        used[index] = true;
+        this->countAlloc();
+        LOG_HEAP("Allocated static pool item %d at 0x%x", index, &pool[index]);
+        return &pool[index];
     }
 };
@@ -28,11 +28,93 @@ bool CompareMeshPacketFunc(const meshtastic_MeshPacket *p1, const meshtastic_Mes
     return (p1p != p2p) ? (p1p > p2p) : (!isFromUs(p1) && isFromUs(p2));
 }
 
-MeshPacketQueue::MeshPacketQueue(size_t _maxLen) : maxLen(_maxLen) {}
+MeshPacketQueue::MeshPacketQueue(size_t _maxLen) : maxLen(_maxLen), ring(_maxLen ? _maxLen : 1, nullptr)
+{
+    index.reserve(maxLen);
+}
 
 bool MeshPacketQueue::empty()
 {
-    return queue.empty();
+    return count == 0;
+}
+
+size_t MeshPacketQueue::upperBound(const meshtastic_MeshPacket *p)
+{
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (CompareMeshPacketFunc(p, at(mid)))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+size_t MeshPacketQueue::positionOf(const meshtastic_MeshPacket *p)
+{
+    // Binary search for the first packet not ordered before p, then look through the ones ordered equal to it
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (CompareMeshPacketFunc(at(mid), p))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (size_t pos = lo; pos < count && !CompareMeshPacketFunc(p, at(pos)); pos++) {
+        if (at(pos) == p)
+            return pos;
+    }
+
+    // Someone changed the ordering fields of a queued packet, fall back to a plain search
+    for (size_t pos = 0; pos < count; pos++) {
+        if (at(pos) == p)
+            return pos;
+    }
+    return count;
+}
+
+void MeshPacketQueue::insertAt(size_t pos, meshtastic_MeshPacket *p)
+{
+    assert(count < ring.size());
+    if (pos < count / 2) {
+        // Closer to the front: grow the ring backwards and shift the packets before pos down
+        head = (head + ring.size() - 1) % ring.size();
+        for (size_t i = 0; i < pos; i++)
+            at(i) = at(i + 1);
+    } else {
+        for (size_t i = count; i > pos; i--)
+            at(i) = at(i - 1);
+    }
+    at(pos) = p;
+    count++;
+    index.emplace(GlobalPacketId(p), p);
+}
+
+meshtastic_MeshPacket *MeshPacketQueue::eraseAt(size_t pos)
+{
+    meshtastic_MeshPacket *p = at(pos);
+    if (pos < count / 2) {
+        for (size_t i = pos; i > 0; i--)
+            at(i) = at(i - 1);
+        at(0) = nullptr;
+        head = (head + 1) % ring.size();
+    } else {
+        for (size_t i = pos; i + 1 < count; i++)
+            at(i) = at(i + 1);
+        at(count - 1) = nullptr;
+    }
+    count--;
+
+    auto range = index.equal_range(GlobalPacketId(p));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == p) {
+            index.erase(it);
+            break;
+        }
+    }
+    return p;
 }
 
 /**
@@ -68,7 +150,7 @@ void fixPriority(meshtastic_MeshPacket *p)
 bool MeshPacketQueue::enqueue(meshtastic_MeshPacket *p, bool *dropped)
 {
     // no space - try to replace a lower priority packet in the queue
-    if (queue.size() >= maxLen) {
+    if (count >= maxLen) {
         bool replaced = replaceLowerPriorityPacket(p);
         if (!replaced) {
             LOG_WARN("TX queue is full, and there is no lower-priority packet available to evict in favour of 0x%08x", p->id);
@@ -84,8 +166,7 @@ bool MeshPacketQueue::enqueue(meshtastic_MeshPacket *p, bool *dropped)
     }
 
     // Find the correct position using upper_bound to maintain a stable order
-    auto it = std::upper_bound(queue.begin(), queue.end(), p, CompareMeshPacketFunc);
-    queue.insert(it, p); // Insert packet at the found position
+    insertAt(upperBound(p), p); // Insert packet at the found position
     return true;
 }
 
@@ -95,9 +176,7 @@ meshtastic_MeshPacket *MeshPacketQueue::dequeue()
         return NULL;
     }
 
-    auto *p = queue.front();
-    queue.erase(queue.begin()); // Remove the highest-priority packet
-    return p;
+    return eraseAt(0); // Remove the highest-priority packet
 }
 
 meshtastic_MeshPacket *MeshPacketQueue::getFront()
@@ -106,42 +185,49 @@ meshtastic_MeshPacket *MeshPacketQueue::getFront()
         return NULL;
     }
 
-    auto *p = queue.front();
+    auto *p = at(0);
     return p;
 }
 
 /** Get a packet from this queue. Returns a pointer to the packet, or NULL if not found. */
 meshtastic_MeshPacket *MeshPacketQueue::getPacketFromQueue(NodeNum from, PacketId id)
 {
-    for (auto it = queue.begin(); it != queue.end(); it++) {
-        auto p = (*it);
-        if (getFrom(p) == from && p->id == id) {
-            return p;
+    auto range = index.equal_range(GlobalPacketId(from, id));
+    meshtastic_MeshPacket *first = NULL;
+    size_t firstPos = count;
+    for (auto it = range.first; it != range.second; ++it) {
+        // Normally there is only one, otherwise return the one that goes out first
+        size_t pos = positionOf(it->second);
+        if (pos < firstPos) {
+            first = it->second;
+            firstPos = pos;
         }
     }
 
-    return NULL;
+    return first;
 }
 
 /** Attempt to find and remove a packet from this queue.  Returns a pointer to the removed packet, or NULL if not found */
 meshtastic_MeshPacket *MeshPacketQueue::remove(NodeNum from, PacketId id, bool tx_normal, bool tx_late, uint8_t hop_limit_lt)
 {
-    for (auto it = queue.begin(); it != queue.end(); it++) {
-        auto p = (*it);
-        if (getFrom(p) == from && p->id == id && ((tx_normal && !p->tx_after) || (tx_late && p->tx_after)) &&
-            (!hop_limit_lt || p->hop_limit < hop_limit_lt)) {
-            queue.erase(it);
-            return p;
+    auto range = index.equal_range(GlobalPacketId(from, id));
+    size_t bestPos = count;
+    for (auto it = range.first; it != range.second; ++it) {
+        auto p = it->second;
+        if (((tx_normal && !p->tx_after) || (tx_late && p->tx_after)) && (!hop_limit_lt || p->hop_limit < hop_limit_lt)) {
+            size_t pos = positionOf(p);
+            if (pos < bestPos)
+                bestPos = pos;
         }
     }
 
-    return NULL;
+    return (bestPos < count) ? eraseAt(bestPos) : NULL;
 }
 
 /* Attempt to find a packet from this queue. Return true if it was found. */
 bool MeshPacketQueue::find(const NodeNum from, const PacketId id)
 {
-    return getPacketFromQueue(from, id) != NULL;
+    return index.count(GlobalPacketId(from, id)) > 0;
 }
 
 /**
@@ -151,16 +237,16 @@ bool MeshPacketQueue::find(const NodeNum from, const PacketId id)
 bool MeshPacketQueue::replaceLowerPriorityPacket(meshtastic_MeshPacket *p)
 {
 
-    if (queue.empty()) {
+    if (empty()) {
         return false; // No packets to replace
     }
 
     // Check if the packet at the back has a lower priority than the new packet
-    auto *backPacket = queue.back();
+    auto *backPacket = at(count - 1);
     if (!backPacket->tx_after && backPacket->priority < p->priority) {
         LOG_WARN("Dropping packet 0x%08x to make room in the TX queue for higher-priority packet 0x%08x", backPacket->id, p->id);
         // Remove the back packet
-        queue.pop_back();
+        eraseAt(count - 1);
         packetPool.release(backPacket);
         // Insert the new packet in the correct order
         enqueue(p);
@@ -169,14 +255,14 @@ bool MeshPacketQueue::replaceLowerPriorityPacket(meshtastic_MeshPacket *p)
 
     if (backPacket->tx_after) {
         // Check if there's a non-late packet with lower priority
-        auto it = queue.end();
-        auto refPacket = *--it;
-        for (; refPacket->tx_after && it != queue.begin(); refPacket = *--it)
-            ;
+        size_t pos = count - 1;
+        while (at(pos)->tx_after && pos > 0)
+            pos--;
+        auto refPacket = at(pos);
         if (!refPacket->tx_after && refPacket->priority < p->priority) {
             LOG_WARN("Dropping non-late packet 0x%08x to make room in the TX queue for higher-priority packet 0x%08x",
                      refPacket->id, p->id);
-            queue.erase(it);
+            eraseAt(pos);
             packetPool.release(refPacket);
             // Insert the new packet in the correct order
             enqueue(p);
@@ -186,4 +272,4 @@ bool MeshPacketQueue::replaceLowerPriorityPacket(meshtastic_MeshPacket *p)
 
     // If the back packet's priority is not lower, no replacement occurs
     return false;
-}
\ No newline at end of file
+}
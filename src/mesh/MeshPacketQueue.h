@@ -3,14 +3,36 @@
 #include "MeshTypes.h"
 
 #include <queue>
+#include <unordered_map>
 
 /**
  * A priority queue of packets
+ *
+ * Packets are kept sorted (by CompareMeshPacketFunc, stable for equal priorities) in a ring buffer, so taking the front is
+ * O(1) and inserting is a binary search plus shifting the shorter side of the ring. A side index on (from, id) makes the
+ * lookups and removals the radio does for every duplicate it hears independent of the queue length.
  */
 class MeshPacketQueue
 {
     size_t maxLen;
-    std::vector<meshtastic_MeshPacket *> queue;
+
+    /// Ring buffer of maxLen slots, position i of the sorted queue lives at ring[(head + i) % maxLen]
+    std::vector<meshtastic_MeshPacket *> ring;
+    size_t head = 0, count = 0;
+
+    /// Queued packets by (getFrom(p), p->id)
+    std::unordered_multimap<GlobalPacketId, meshtastic_MeshPacket *, GlobalPacketIdHashFunction> index;
+
+    meshtastic_MeshPacket *&at(size_t pos) { return ring[(head + pos) % ring.size()]; }
+
+    /** @return the position after the last queued packet that is not ordered after p */
+    size_t upperBound(const meshtastic_MeshPacket *p);
+
+    /** @return the position of a queued packet, or count if it isn't in the queue */
+    size_t positionOf(const meshtastic_MeshPacket *p);
+
+    void insertAt(size_t pos, meshtastic_MeshPacket *p);
+    meshtastic_MeshPacket *eraseAt(size_t pos);
 
     /** Replace a lower priority package in the queue with 'mp' (provided there are lower pri packages). Return true if replaced.
      */
@@ -28,7 +50,7 @@ class MeshPacketQueue
     bool empty();
 
     /** return amount of free packets in Queue */
-    size_t getFree() { return maxLen - queue.size(); }
+    size_t getFree() { return maxLen - count; }
 
     /** return total size of the Queue */
     size_t getMaxLen() { return maxLen; }
@@ -46,4 +68,4 @@ class MeshPacketQueue
 
     /* Attempt to find a packet from this queue. Return true if it was found. */
     bool find(const NodeNum from, const PacketId id);
-};
\ No newline at end of file
+};
@@ -133,6 +133,9 @@ class MeshService
     /// Return the next MqttClientProxyMessage packet destined to the phone.
     meshtastic_MqttClientProxyMessage *getMqttClientProxyMessageForPhone() { return toPhoneMqttProxyQueue.dequeuePtr(0); }
 
+    /// How many more MqttClientProxyMessages the phone queue takes before it starts discarding the oldest
+    int numFreeMqttClientProxyMessages() { return toPhoneMqttProxyQueue.numFree(); }
+
     /// Return the next ClientNotification packet destined to the phone.
     meshtastic_ClientNotification *getClientNotificationForPhone() { return toPhoneClientNotificationQueue.dequeuePtr(0); }
 
@@ -5,6 +5,7 @@
 #include "MemoryPool.h"
 #include "mesh/mesh-pb-constants.h"
 #include <Arduino.h>
+#include <functional>
 
 typedef uint32_t NodeNum;
 typedef uint32_t PacketId; // A packet sequence number
@@ -70,4 +71,33 @@ bool isToUs(const meshtastic_MeshPacket *p);
 /* Some clients might not properly set priority, therefore we fix it here. */
 void fixPriority(meshtastic_MeshPacket *p);
 
-bool isBroadcast(uint32_t dest);
\ No newline at end of file
+bool isBroadcast(uint32_t dest);
+
+/**
+ * An identifier for a globally unique message - a pair of the sending nodenum and the packet id assigned
+ * to that message
+ */
+struct GlobalPacketId {
+    NodeNum node;
+    PacketId id;
+
+    bool operator==(const GlobalPacketId &p) const { return node == p.node && id == p.id; }
+
+    explicit GlobalPacketId(const meshtastic_MeshPacket *p)
+    {
+        node = getFrom(p);
+        id = p->id;
+    }
+
+    GlobalPacketId(NodeNum _from, PacketId _id)
+    {
+        node = _from;
+        id = _id;
+    }
+};
+
+class GlobalPacketIdHashFunction
+{
+  public:
+    size_t operator()(const GlobalPacketId &p) const { return (std::hash<NodeNum>()(p.node)) ^ (std::hash<PacketId>()(p.id)); }
+};
@@ -24,6 +24,7 @@
 #include "modules/NeighborInfoModule.h"
 #include <ErriezCRC32.h>
 #include <algorithm>
+#include <assert.h>
 #include <pb_decode.h>
 #include <pb_encode.h>
 #include <vector>
@@ -523,6 +524,7 @@ void NodeDB::installDefaultNodeDatabase()
     nodeDatabase.nodes = std::vector<meshtastic_NodeInfoLite>(MAX_NUM_NODES);
     numMeshNodes = 0;
     meshNodes = &nodeDatabase.nodes;
+    rebuildNodeIndex();
 }
 
 void NodeDB::installDefaultConfig(bool preserveKey = false)
@@ -991,21 +993,24 @@ void NodeDB::resetNodes(bool keepFavorites)
 {
     if (!config.position.fixed_position)
         clearLocalPosition();
-    numMeshNodes = 1;
     if (keepFavorites) {
         LOG_INFO("Clearing node database - preserving favorites");
-        for (size_t i = 0; i < meshNodes->size(); i++) {
-            meshtastic_NodeInfoLite &node = meshNodes->at(i);
-            if (i > 0 && !node.is_favorite) {
-                node = meshtastic_NodeInfoLite();
-            } else {
-                numMeshNodes += 1;
-            }
-        };
     } else {
         LOG_INFO("Clearing node database - removing favorites");
-        std::fill(nodeDatabase.nodes.begin() + 1, nodeDatabase.nodes.end(), meshtastic_NodeInfoLite());
     }
+    // Keep ourselves (and the favorites if asked to), compacted to the front
+    pb_size_t kept = 0;
+    for (pb_size_t i = 0; i < numMeshNodes; i++) {
+        meshtastic_NodeInfoLite &node = meshNodes->at(i);
+        if (node.num == getNodeNum() || (keepFavorites && node.is_favorite)) {
+            if (kept != i)
+                meshNodes->at(kept) = node;
+            kept++;
+        }
+    }
+    numMeshNodes = kept;
+    std::fill(nodeDatabase.nodes.begin() + numMeshNodes, nodeDatabase.nodes.end(), meshtastic_NodeInfoLite());
+    rebuildNodeIndex();
     devicestate.has_rx_text_message = false;
     devicestate.has_rx_waypoint = false;
     saveNodeDatabaseToDisk();
@@ -1016,16 +1021,12 @@ void NodeDB::resetNodes(bool keepFavorites)
 
 void NodeDB::removeNodeByNum(NodeNum nodeNum)
 {
-    int newPos = 0, removed = 0;
-    for (int i = 0; i < numMeshNodes; i++) {
-        if (meshNodes->at(i).num != nodeNum)
-            meshNodes->at(newPos++) = meshNodes->at(i);
-        else
-            removed++;
+    int removed = 0;
+    auto it = nodeIndex.find(nodeNum);
+    if (it != nodeIndex.end()) {
+        removeMeshNodeAt(it->second);
+        removed++;
     }
-    numMeshNodes -= removed;
-    std::fill(nodeDatabase.nodes.begin() + numMeshNodes, nodeDatabase.nodes.begin() + numMeshNodes + 1,
-              meshtastic_NodeInfoLite());
     LOG_DEBUG("NodeDB::removeNodeByNum purged %d entries. Save changes", removed);
     saveNodeDatabaseToDisk();
 }
@@ -1061,9 +1062,43 @@ void NodeDB::cleanupMeshDB()
     numMeshNodes -= removed;
     std::fill(nodeDatabase.nodes.begin() + numMeshNodes, nodeDatabase.nodes.begin() + numMeshNodes + removed,
               meshtastic_NodeInfoLite());
+    rebuildNodeIndex();
     LOG_DEBUG("cleanupMeshDB purged %d entries", removed);
 }
 
+void NodeDB::rebuildNodeIndex()
+{
+    nodeIndex.clear();
+    nodeIndex.reserve(MAX_NUM_NODES);
+    nodeOrder.clear();
+    nodeOrder.reserve(MAX_NUM_NODES);
+    for (pb_size_t i = 0; i < numMeshNodes; i++) {
+        nodeIndex.emplace(meshNodes->at(i).num, i); // On duplicates the first one wins, same as a linear search would
+        nodeOrder.push_back(i);
+    }
+    std::stable_sort(nodeOrder.begin(), nodeOrder.end(),
+                     [this](pb_size_t a, pb_size_t b) { return sortsBefore(meshNodes->at(a), meshNodes->at(b)); });
+}
+
+void NodeDB::removeMeshNodeAt(pb_size_t index)
+{
+    if (index >= numMeshNodes)
+        return;
+    auto it = nodeIndex.find(meshNodes->at(index).num);
+    if (it != nodeIndex.end() && it->second == index)
+        nodeIndex.erase(it);
+    nodeOrder.erase(std::find(nodeOrder.begin(), nodeOrder.end(), index));
+
+    pb_size_t last = numMeshNodes - 1;
+    if (index != last) {
+        meshNodes->at(index) = meshNodes->at(last);
+        nodeIndex[meshNodes->at(index).num] = index;
+        *std::find(nodeOrder.begin(), nodeOrder.end(), last) = index;
+    }
+    meshNodes->at(last) = meshtastic_NodeInfoLite();
+    numMeshNodes--;
+}
+
 void NodeDB::installDefaultDeviceState()
 {
     LOG_INFO("Install default DeviceState");
@@ -1224,6 +1259,7 @@ void NodeDB::loadFromDisk()
         numMeshNodes = MAX_NUM_NODES;
     }
     meshNodes->resize(MAX_NUM_NODES);
+    rebuildNodeIndex();
 
     // static DeviceState scratch; We no longer read into a tempbuf because this structure is 15KB of valuable RAM
     state = loadProto(deviceStateFileName, meshtastic_DeviceState_size, sizeof(meshtastic_DeviceState),
@@ -1514,7 +1550,7 @@ bool NodeDB::saveToDisk(int saveWhat)
 const meshtastic_NodeInfoLite *NodeDB::readNextMeshNode(uint32_t &readIndex)
 {
     if (readIndex < numMeshNodes)
-        return &meshNodes->at(readIndex++);
+        return &meshNodes->at(nodeOrder.at(readIndex++));
     else
         return NULL;
 }
@@ -1741,6 +1777,13 @@ bool NodeDB::updateUser(uint32_t nodeId, meshtastic_User &p, uint8_t channelInde
     auto lite = TypeConversions::ConvertToUserLite(p);
     bool changed = memcmp(&info->user, &lite, sizeof(info->user)) || (info->channel != channelIndex);
 
+#if !(MESHTASTIC_EXCLUDE_PKI)
+    // A shared key derived from a key this node no longer uses must not linger in the crypto cache
+    if (info->user.public_key.size == 32 &&
+        (lite.public_key.size != 32 || memcmp(info->user.public_key.bytes, lite.public_key.bytes, 32) != 0))
+        crypto->invalidateSharedKey(info->user.public_key.bytes);
+#endif
+
     info->user = lite;
     if (info->user.public_key.size == 32) {
         printBytes("Saved Pubkey: ", info->user.public_key.bytes, 32);
@@ -1876,33 +1919,32 @@ void NodeDB::pause_sort(bool paused)
     sortingIsPaused = paused;
 }
 
+bool NodeDB::sortsBefore(const meshtastic_NodeInfoLite &a, const meshtastic_NodeInfoLite &b)
+{
+    if (a.num == getNodeNum() || b.num == getNodeNum())
+        return a.num == getNodeNum() && b.num != getNodeNum();
+    if (a.is_favorite != b.is_favorite)
+        return a.is_favorite;
+    return a.last_heard > b.last_heard;
+}
+
 void NodeDB::sortMeshDB()
 {
     if (!sortingIsPaused && (lastSort == 0 || !Throttle::isWithinTimespanMs(lastSort, 1000 * 5))) {
         lastSort = millis();
-        bool changed = true;
-        while (changed) { // dumb reverse bubble sort, but probably not bad for what we're doing
-            changed = false;
-            for (int i = numMeshNodes - 1; i > 0; i--) { // lowest case this should examine is i == 1
-                if (meshNodes->at(i - 1).num == getNodeNum()) {
-                    // noop
-                } else if (meshNodes->at(i).num ==
-                           getNodeNum()) { // in the oddball case our own node num is not at location 0, put it there
-                    // TODO: Look for at(i-1) also matching own node num, and throw the DB in the trash
-                    std::swap(meshNodes->at(i), meshNodes->at(i - 1));
-                    changed = true;
-                } else if (meshNodes->at(i).is_favorite && !meshNodes->at(i - 1).is_favorite) {
-                    std::swap(meshNodes->at(i), meshNodes->at(i - 1));
-                    changed = true;
-                } else if (!meshNodes->at(i).is_favorite && meshNodes->at(i - 1).is_favorite) {
-                    // noop
-                } else if (meshNodes->at(i).last_heard > meshNodes->at(i - 1).last_heard) {
-                    std::swap(meshNodes->at(i), meshNodes->at(i - 1));
-                    changed = true;
-                }
-            }
+        // Binary insertion sort over nodeOrder. Between two sorts usually only a few nodes got heard, so the list is nearly
+        // sorted already: this is one compare per node, plus shifting indices for the nodes that actually move up.
+        auto byOrder = [this](pb_size_t a, pb_size_t b) { return sortsBefore(meshNodes->at(a), meshNodes->at(b)); };
+        uint32_t moved = 0;
+        for (size_t i = 1; i < nodeOrder.size(); i++) {
+            if (!byOrder(nodeOrder[i], nodeOrder[i - 1]))
+                continue;
+            auto pos = std::upper_bound(nodeOrder.begin(), nodeOrder.begin() + i, nodeOrder[i], byOrder);
+            std::rotate(pos, nodeOrder.begin() + i, nodeOrder.begin() + i + 1);
+            moved++;
         }
-        LOG_INFO("Sort took %u milliseconds", millis() - lastSort);
+        if (moved)
+            LOG_DEBUG("Sort moved %u nodes in %u milliseconds", moved, millis() - lastSort);
     }
 }
 
@@ -1926,11 +1968,17 @@ std::string NodeDB::getNodeId() const
 /// NOTE: This function might be called from an ISR
 meshtastic_NodeInfoLite *NodeDB::getMeshNode(NodeNum n)
 {
-    for (int i = 0; i < numMeshNodes; i++)
-        if (meshNodes->at(i).num == n)
-            return &meshNodes->at(i);
-
-    return NULL;
+    // Every change to meshNodes keeps nodeIndex in step, a mismatch is a bug to be found in testing
+    auto it = nodeIndex.find(n);
+    if (it == nodeIndex.end()) {
+#ifdef PIO_UNIT_TESTING
+        for (pb_size_t i = 0; i < numMeshNodes; i++)
+            assert(meshNodes->at(i).num != n);
+#endif
+        return NULL;
+    }
+    assert(it->second < numMeshNodes && meshNodes->at(it->second).num == n);
+    return &meshNodes->at(it->second);
 }
 
 // returns true if the maximum number of nodes is reached or we are running low on memory
@@ -1953,7 +2001,9 @@ meshtastic_NodeInfoLite *NodeDB::getOrCreateMeshNode(NodeNum n)
             uint32_t oldestBoring = UINT32_MAX;
             int oldestIndex = -1;
             int oldestBoringIndex = -1;
-            for (int i = 1; i < numMeshNodes; i++) {
+            for (int i = 0; i < numMeshNodes; i++) {
+                if (meshNodes->at(i).num == getNodeNum())
+                    continue; // Never evict ourselves
                 // Simply the oldest non-favorite, non-ignored, non-verified node
                 if (!meshNodes->at(i).is_favorite && !meshNodes->at(i).is_ignored &&
                     !(meshNodes->at(i).bitfield & NODEINFO_BITFIELD_IS_KEY_MANUALLY_VERIFIED_MASK) &&
@@ -1974,14 +2024,12 @@ meshtastic_NodeInfoLite *NodeDB::getOrCreateMeshNode(NodeNum n)
             }
 
             if (oldestIndex != -1) {
-                // Shove the remaining nodes down the chain
-                for (int i = oldestIndex; i < numMeshNodes - 1; i++) {
-                    meshNodes->at(i) = meshNodes->at(i + 1);
-                }
-                (numMeshNodes)--;
+                removeMeshNodeAt(oldestIndex);
             }
         }
         // add the node at the end
+        nodeIndex[n] = numMeshNodes;
+        nodeOrder.push_back(numMeshNodes); // Never heard yet, so it belongs at the end anyway
         lite = &meshNodes->at((numMeshNodes)++);
 
         // everything is missing except the nodenum
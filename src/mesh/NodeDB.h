@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <pb_encode.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "MeshTypes.h"
@@ -243,10 +244,11 @@ class NodeDB
 
     const meshtastic_NodeInfoLite *readNextMeshNode(uint32_t &readIndex);
 
+    /// @return the node at position x in sorted order (us, then favorites, then most recently heard)
     meshtastic_NodeInfoLite *getMeshNodeByIndex(size_t x)
     {
         assert(x < numMeshNodes);
-        return &meshNodes->at(x);
+        return &meshNodes->at(nodeOrder.at(x));
     }
 
     virtual meshtastic_NodeInfoLite *getMeshNode(NodeNum n);
@@ -304,6 +306,23 @@ class NodeDB
     uint32_t lastNodeDbSave = 0;    // when we last saved our db to flash
     uint32_t lastBackupAttempt = 0; // when we last tried a backup automatically or manually
     uint32_t lastSort = 0;          // When last sorted the nodeDB
+
+    /// NodeNum -> position in meshNodes, must be kept in sync whenever nodes are added, removed or moved
+    std::unordered_map<NodeNum, pb_size_t> nodeIndex;
+
+    /// Positions in meshNodes in sorted order. meshNodes itself is kept unsorted, so sorting only moves these small indices
+    /// around instead of whole NodeInfoLite structs
+    std::vector<pb_size_t> nodeOrder;
+
+    /// Recreate nodeIndex and nodeOrder from scratch, after bulk changes to meshNodes
+    void rebuildNodeIndex();
+
+    /// Remove the node at a position in meshNodes by moving the last node into its place, the sorted order of the others is kept
+    void removeMeshNodeAt(pb_size_t index);
+
+    /// @return true if a should be listed before b: us first, then favorites, then by last_heard descending
+    bool sortsBefore(const meshtastic_NodeInfoLite &a, const meshtastic_NodeInfoLite &b);
+
     /// Find a node in our DB, create an empty NodeInfoLite if missing
     meshtastic_NodeInfoLite *getOrCreateMeshNode(NodeNum n);
 
@@ -9,12 +9,12 @@
 
 #define PACKETHISTORY_MAX                                                                                                        \
     max((u_int32_t)(MAX_NUM_NODES * 2.0),                                                                                        \
-        (u_int32_t)100) // x2..3  Should suffice. Empirical setup. 16B per record malloc'ed, but no less than 100
+        (u_int32_t)100) // x2..3  Should suffice. Empirical setup. 20B record + 8B index per slot malloc'ed, but no less than 100
 
 #define RECENT_WARN_AGE (10 * 60 * 1000L) // Warn if the packet that gets removed was more recent than 10 min
 
 #define VERBOSE_PACKET_HISTORY 0     // Set to 1 for verbose logging, 2 for heavy debugging
-#define PACKET_HISTORY_TRACE_AGING 1 // Set to 1 to enable logging of the age of re/used history slots
+#define PACKET_HISTORY_TRACE_AGING 0 // Set to 1 to enable logging of the age of re/used history slots
 
 PacketHistory::PacketHistory(uint32_t size) : recentPacketsCapacity(0), recentPackets(NULL) // Initialize members
 {
@@ -22,26 +22,49 @@ PacketHistory::PacketHistory(uint32_t size) : recentPacketsCapacity(0), recentPa
         LOG_WARN("Packet History - Invalid size %d, using default %d", size, PACKETHISTORY_MAX);
         size = PACKETHISTORY_MAX; // Use default size if invalid
     }
+    if (size > PACKETHISTORY_MAX_SLOTS) {
+        LOG_WARN("Packet History - Size %d exceeds slot index range, using %d", size, PACKETHISTORY_MAX_SLOTS);
+        size = PACKETHISTORY_MAX_SLOTS;
+    }
+
+    // Index has at least twice as many buckets as records, rounded up to a power of two for cheap masking
+    uint32_t hashBuckets = 8;
+    while (hashBuckets < size * 2)
+        hashBuckets <<= 1;
 
-    // Allocate memory for the recent packets array
+    // Allocate memory for the recent packets array and its index
     recentPacketsCapacity = size;
     recentPackets = new PacketRecord[recentPacketsCapacity];
-    if (!recentPackets) { // No logging here, console/log probably uninitialized yet.
+    hashIndex = new HistorySlot[hashBuckets];
+    agePrev = new HistorySlot[recentPacketsCapacity];
+    ageNext = new HistorySlot[recentPacketsCapacity];
+    if (!recentPackets || !hashIndex || !agePrev || !ageNext) { // No logging here, console/log probably uninitialized yet.
         LOG_ERROR("Packet History - Memory allocation failed for size=%d entries / %d Bytes", size,
                   sizeof(PacketRecord) * recentPacketsCapacity);
         recentPacketsCapacity = 0; // mark allocation fail
         return;                    // return early
     }
+    hashMask = hashBuckets - 1;
 
-    // Initialize the recent packets array to zero
+    // Initialize the recent packets array to zero, and the index/age list to empty
     memset(recentPackets, 0, sizeof(PacketRecord) * recentPacketsCapacity);
+    memset(hashIndex, 0xFF, sizeof(HistorySlot) * hashBuckets);
+    memset(agePrev, 0xFF, sizeof(HistorySlot) * recentPacketsCapacity);
+    memset(ageNext, 0xFF, sizeof(HistorySlot) * recentPacketsCapacity);
+    recentPacketsUsed = 0;
+    ageHead = ageTail = PACKETHISTORY_NO_SLOT;
 }
 
 PacketHistory::~PacketHistory()
 {
     recentPacketsCapacity = 0;
+    recentPacketsUsed = 0;
     delete[] recentPackets;
+    delete[] hashIndex;
+    delete[] agePrev;
+    delete[] ageNext;
     recentPackets = NULL;
+    hashIndex = agePrev = ageNext = NULL;
 }
 
 /** Update recentPackets and return true if we have already seen this packet */
@@ -194,6 +217,82 @@ bool PacketHistory::wasSeenRecently(const meshtastic_MeshPacket *p, bool withUpd
     return seenRecently;
 }
 
+/** Bucket where a (sender, id) key would ideally live in hashIndex */
+inline uint32_t PacketHistory::hashHome(NodeNum sender, PacketId id) const
+{
+    // Packet ids are mostly sequential per sender, so mix both before masking
+    uint32_t h = (sender * 0x9E3779B1u) ^ (id * 0x85EBCA77u);
+    h ^= h >> 16;
+    return h & hashMask;
+}
+
+/** Slot of the record matching (sender, id), PACKETHISTORY_NO_SLOT if there is none */
+PacketHistory::HistorySlot PacketHistory::findSlot(NodeNum sender, PacketId id) const
+{
+    for (uint32_t b = hashHome(sender, id);; b = (b + 1) & hashMask) {
+        HistorySlot slot = hashIndex[b];
+        if (slot == PACKETHISTORY_NO_SLOT)
+            return PACKETHISTORY_NO_SLOT;
+        if (recentPackets[slot].id == id && recentPackets[slot].sender == sender)
+            return slot;
+    }
+}
+
+/** Add a slot to hashIndex, keyed by the record currently stored in it */
+void PacketHistory::hashInsert(HistorySlot slot)
+{
+    uint32_t b = hashHome(recentPackets[slot].sender, recentPackets[slot].id);
+    while (hashIndex[b] != PACKETHISTORY_NO_SLOT)
+        b = (b + 1) & hashMask;
+    hashIndex[b] = slot;
+}
+
+/** Remove a slot from hashIndex. Uses backward shift deletion, so no tombstones pile up and probes stay short */
+void PacketHistory::hashRemove(HistorySlot slot)
+{
+    uint32_t hole = hashHome(recentPackets[slot].sender, recentPackets[slot].id);
+    while (hashIndex[hole] != slot) {
+        if (hashIndex[hole] == PACKETHISTORY_NO_SLOT)
+            return; // Not indexed
+        hole = (hole + 1) & hashMask;
+    }
+
+    for (uint32_t b = (hole + 1) & hashMask; hashIndex[b] != PACKETHISTORY_NO_SLOT; b = (b + 1) & hashMask) {
+        uint32_t home = hashHome(recentPackets[hashIndex[b]].sender, recentPackets[hashIndex[b]].id);
+        // Entries whose home lies cyclically in (hole, b] are still reachable, leave them
+        bool reachable = (hole <= b) ? (hole < home && home <= b) : (hole < home || home <= b);
+        if (!reachable) {
+            hashIndex[hole] = hashIndex[b];
+            hole = b;
+        }
+    }
+    hashIndex[hole] = PACKETHISTORY_NO_SLOT;
+}
+
+void PacketHistory::ageUnlink(HistorySlot slot)
+{
+    if (agePrev[slot] != PACKETHISTORY_NO_SLOT)
+        ageNext[agePrev[slot]] = ageNext[slot];
+    else
+        ageHead = ageNext[slot];
+    if (ageNext[slot] != PACKETHISTORY_NO_SLOT)
+        agePrev[ageNext[slot]] = agePrev[slot];
+    else
+        ageTail = agePrev[slot];
+    agePrev[slot] = ageNext[slot] = PACKETHISTORY_NO_SLOT;
+}
+
+void PacketHistory::ageAppend(HistorySlot slot)
+{
+    agePrev[slot] = ageTail;
+    ageNext[slot] = PACKETHISTORY_NO_SLOT;
+    if (ageTail != PACKETHISTORY_NO_SLOT)
+        ageNext[ageTail] = slot;
+    else
+        ageHead = slot;
+    ageTail = slot;
+}
+
 /** Find a packet record in history.
  * @return pointer to PacketRecord if found, NULL if not found */
 PacketHistory::PacketRecord *PacketHistory::find(NodeNum sender, PacketId id)
@@ -205,17 +304,15 @@ PacketHistory::PacketRecord *PacketHistory::find(NodeNum sender, PacketId id)
         return NULL;
     }
 
-    PacketRecord *it = NULL;
-    for (it = recentPackets; it < (recentPackets + recentPacketsCapacity); ++it) {
-        if (it->id == id && it->sender == sender) {
+    HistorySlot slot = findSlot(sender, id);
+    if (slot != PACKETHISTORY_NO_SLOT) {
+        PacketRecord *it = &recentPackets[slot];
 #if VERBOSE_PACKET_HISTORY
-            LOG_DEBUG("Packet History - find: s=%08x id=%08x FOUND nh=%02x rby=%02x %02x %02x age=%d slot=%d/%d", it->sender,
-                      it->id, it->next_hop, it->relayed_by[0], it->relayed_by[1], it->relayed_by[2], millis() - (it->rxTimeMsec),
-                      it - recentPackets, recentPacketsCapacity);
+        LOG_DEBUG("Packet History - find: s=%08x id=%08x FOUND nh=%02x rby=%02x %02x %02x age=%d slot=%d/%d", it->sender, it->id,
+                  it->next_hop, it->relayed_by[0], it->relayed_by[1], it->relayed_by[2], millis() - (it->rxTimeMsec), slot,
+                  recentPacketsCapacity);
 #endif
-            // only the first match is returned, so be careful not to create duplicate entries
-            return it; // Return pointer to the found record
-        }
+        return it; // Return pointer to the found record
     }
 
 #if VERBOSE_PACKET_HISTORY
@@ -227,69 +324,57 @@ PacketHistory::PacketRecord *PacketHistory::find(NodeNum sender, PacketId id)
 /** Insert/Replace oldest PacketRecord in recentPackets. */
 void PacketHistory::insert(const PacketRecord &r)
 {
+    if (r.rxTimeMsec == 0) {
+#if VERBOSE_PACKET_HISTORY
+        LOG_WARN("Packet History - insert: I will not store packet with rxTimeMsec = 0.");
+#endif
+        return; // Return early if we can't update the history
+    }
+
     uint32_t now_millis = millis(); // Should not jump with time changes
     uint32_t OldtrxTimeMsec = 0;
     PacketRecord *tu = NULL; // Will insert here.
-    PacketRecord *it = NULL;
 
-    // Find a free, matching or oldest used slot in the recentPackets array
-    for (it = recentPackets; it < (recentPackets + recentPacketsCapacity); ++it) {
-        if (it->id == 0 && it->sender == 0 /*&& rxTimeMsec == 0*/) { // Record is empty
-            tu = it;                                                 // Remember the free slot
+    // Matching slot first, then a never used one, then the oldest one (head of the age list)
+    HistorySlot slot = findSlot(r.sender, r.id);
+    bool matched = (slot != PACKETHISTORY_NO_SLOT);
+    if (matched) {
+        OldtrxTimeMsec = now_millis - recentPackets[slot].rxTimeMsec; // ..and save current entry's age
 #if VERBOSE_PACKET_HISTORY >= 2
-            LOG_DEBUG("Packet History - insert: Free slot@ %d/%d", tu - recentPackets, recentPacketsCapacity);
+        LOG_DEBUG("Packet History - insert: Matched slot@ %d/%d age=%d", slot, recentPacketsCapacity, OldtrxTimeMsec);
 #endif
-            // We have that, Exit the loop
-            it = (recentPackets + recentPacketsCapacity);
-        } else if (it->id == r.id && it->sender == r.sender) { // Record matches the packet we want to insert
-            tu = it;                                           // Remember the matching slot
-            OldtrxTimeMsec = now_millis - it->rxTimeMsec;      // ..and save current entry's age
+    } else if (recentPacketsUsed < recentPacketsCapacity) {
+        slot = recentPacketsUsed++;
 #if VERBOSE_PACKET_HISTORY >= 2
-            LOG_DEBUG("Packet History - insert: Matched slot@ %d/%d age=%d", tu - recentPackets, recentPacketsCapacity,
-                      OldtrxTimeMsec);
+        LOG_DEBUG("Packet History - insert: Free slot@ %d/%d", slot, recentPacketsCapacity);
 #endif
-            // We have that, Exit the loop
-            it = (recentPackets + recentPacketsCapacity);
-        } else {
-            if (it->rxTimeMsec == 0) {
-                LOG_WARN(
-                    "Packet History - insert: Found packet s=%08x id=%08x with rxTimeMsec = 0, slot %d/%d. Should never happen!",
-                    it->sender, it->id, it - recentPackets, recentPacketsCapacity);
-            }
-            if ((now_millis - it->rxTimeMsec) > OldtrxTimeMsec) { // 49.7 days rollover friendly
-                OldtrxTimeMsec = now_millis - it->rxTimeMsec;
-                tu = it; // remember the oldest packet
+    } else {
+        slot = ageHead;
+        if (slot == PACKETHISTORY_NO_SLOT) {
+            LOG_ERROR("Packet History - insert: No free slot, no matched packet, no oldest to reuse. Something leaked."); // mx
+            return; // Return early if we can't update the history
+        }
+        OldtrxTimeMsec = now_millis - recentPackets[slot].rxTimeMsec; // 49.7 days rollover friendly
 #if VERBOSE_PACKET_HISTORY >= 2
-                LOG_DEBUG("Packet History - insert: Older slot@ %d/%d age=%d", tu - recentPackets, recentPacketsCapacity,
-                          OldtrxTimeMsec);
+        LOG_DEBUG("Packet History - insert: Older slot@ %d/%d age=%d", slot, recentPacketsCapacity, OldtrxTimeMsec);
 #endif
-            }
-            // keep looking for oldest till entire array is checked
-        }
-    }
-
-    if (tu == NULL) {
-        LOG_ERROR("Packet History - insert: No free slot, no matched packet, no oldest to reuse. Something leaked."); // mx
-        // assert(false); // This should never happen, we should always have at least one packet to clear
-        return; // Return early if we can't update the history
     }
+    tu = &recentPackets[slot];
 
 #if VERBOSE_PACKET_HISTORY
     if (tu->id == 0 && tu->sender == 0) {
-        LOG_DEBUG("Packet History - insert: slot@ %d/%d is NEW", tu - recentPackets, recentPacketsCapacity);
-    } else if (tu->id == r.id && tu->sender == r.sender) {
-        LOG_DEBUG("Packet History - insert: slot@ %d/%d MATCHED, age=%d", tu - recentPackets, recentPacketsCapacity,
-                  OldtrxTimeMsec);
+        LOG_DEBUG("Packet History - insert: slot@ %d/%d is NEW", slot, recentPacketsCapacity);
+    } else if (matched) {
+        LOG_DEBUG("Packet History - insert: slot@ %d/%d MATCHED, age=%d", slot, recentPacketsCapacity, OldtrxTimeMsec);
     } else {
-        LOG_DEBUG("Packet History - insert: slot@ %d/%d REUSE OLDEST, age=%d", tu - recentPackets, recentPacketsCapacity,
-                  OldtrxTimeMsec);
+        LOG_DEBUG("Packet History - insert: slot@ %d/%d REUSE OLDEST, age=%d", slot, recentPacketsCapacity, OldtrxTimeMsec);
     }
 #endif
 
     // If we are reusing a slot, we should warn if the packet is too recent
 #if RECENT_WARN_AGE > 0
     if (tu->rxTimeMsec && (OldtrxTimeMsec < RECENT_WARN_AGE)) {
-        if (!(tu->id == r.id && tu->sender == r.sender)) {
+        if (!matched) {
 #if VERBOSE_PACKET_HISTORY
             LOG_WARN("Packet History - insert: Reusing slot aged %ds < %ds RECENT_WARN_AGE", OldtrxTimeMsec / 1000,
                      RECENT_WARN_AGE / 1000);
@@ -304,35 +389,40 @@ void PacketHistory::insert(const PacketRecord &r)
     }
 
 #if PACKET_HISTORY_TRACE_AGING
-    if (tu->rxTimeMsec != 0) {
-        LOG_INFO("Packet History - insert: Reusing slot aged %.3fs TRACE %s", OldtrxTimeMsec / 1000.,
-                 (tu->id == r.id && tu->sender == r.sender) ? "MATCHED PACKET" : "OLDEST SLOT");
-    } else {
-        LOG_INFO("Packet History - insert: Using new slot @uptime %.3fs TRACE NEW", millis() / 1000.);
+    if (LOG_ENABLED(INFO, LOG_SUBSYS_PACKET_HISTORY)) {
+        if (tu->rxTimeMsec != 0) {
+            LOG_INFO("Packet History - insert: Reusing slot aged %.3fs TRACE %s", OldtrxTimeMsec / 1000.,
+                     matched ? "MATCHED PACKET" : "OLDEST SLOT");
+        } else {
+            LOG_INFO("Packet History - insert: Using new slot @uptime %.3fs TRACE NEW", millis() / 1000.);
+        }
     }
 #endif
 
 #endif
 
 #if VERBOSE_PACKET_HISTORY
-    LOG_DEBUG("Packet History - insert: Store slot@ %d/%d s=%08x id=%08x nh=%02x rby=%02x %02x %02x rxT=%d BEFORE",
-              tu - recentPackets, recentPacketsCapacity, tu->sender, tu->id, tu->next_hop, tu->relayed_by[0], tu->relayed_by[1],
-              tu->relayed_by[2], tu->rxTimeMsec);
+    LOG_DEBUG("Packet History - insert: Store slot@ %d/%d s=%08x id=%08x nh=%02x rby=%02x %02x %02x rxT=%d BEFORE", slot,
+              recentPacketsCapacity, tu->sender, tu->id, tu->next_hop, tu->relayed_by[0], tu->relayed_by[1], tu->relayed_by[2],
+              tu->rxTimeMsec);
 #endif
 
-    if (r.rxTimeMsec == 0) {
-#if VERBOSE_PACKET_HISTORY
-        LOG_WARN("Packet History - insert: I will not store packet with rxTimeMsec = 0.");
-#endif
-        return; // Return early if we can't update the history
-    }
+    // The key of a matched slot doesn't change, anything else has to be re-indexed
+    if (tu->rxTimeMsec != 0 && !matched)
+        hashRemove(slot);
+    if (tu->rxTimeMsec != 0)
+        ageUnlink(slot);
 
     *tu = r; // store the packet
 
+    if (!matched)
+        hashInsert(slot);
+    ageAppend(slot); // Most recently stored
+
 #if VERBOSE_PACKET_HISTORY
-    LOG_DEBUG("Packet History - insert: Store slot@ %d/%d s=%08x id=%08x nh=%02x rby=%02x %02x %02x rxT=%d AFTER",
-              tu - recentPackets, recentPacketsCapacity, tu->sender, tu->id, tu->next_hop, tu->relayed_by[0], tu->relayed_by[1],
-              tu->relayed_by[2], tu->rxTimeMsec);
+    LOG_DEBUG("Packet History - insert: Store slot@ %d/%d s=%08x id=%08x nh=%02x rby=%02x %02x %02x rxT=%d AFTER", slot,
+              recentPacketsCapacity, tu->sender, tu->id, tu->next_hop, tu->relayed_by[0], tu->relayed_by[1], tu->relayed_by[2],
+              tu->rxTimeMsec);
 #endif
 }
 
@@ -8,6 +8,10 @@
 #define HOP_LIMIT_OUR_TX_MASK 0x38  // Bits 3-5
 #define HOP_LIMIT_OUR_TX_SHIFT 3    // Bits 3-5
 
+// Slot numbers are kept as 16 bit to keep the index small on MCUs, so the history can't grow beyond this
+#define PACKETHISTORY_NO_SLOT 0xFFFF
+#define PACKETHISTORY_MAX_SLOTS 0xFFFE
+
 /**
  * This is a mixin that adds a record of past packets we have seen
  */
@@ -23,10 +27,33 @@ class PacketHistory
                                           // bit 3-5: our hop limit when we first transmitted it
         uint8_t relayed_by[NUM_RELAYERS]; // Array of nodes that relayed this packet
     };                                    // 4B + 4B + 4B + 1B + 1B + 6B = 20B
+    static_assert(sizeof(PacketRecord) == 20, "PacketRecord should stay 20 bytes");
+
+    typedef uint16_t HistorySlot; // Index into recentPackets
 
     uint32_t recentPacketsCapacity =
         0; // Can be set in constructor, no need to recompile. Used to allocate memory for mx_recentPackets.
     PacketRecord *recentPackets = NULL; // Simple and fixed in size. Debloat.
+    uint32_t recentPacketsUsed = 0;     // Slots [0, recentPacketsUsed) hold records, the rest were never used
+
+    // Open-addressed (linear probing) index keyed by (sender, id), holds slot numbers or PACKETHISTORY_NO_SLOT.
+    // Sized to a power of two of at least twice the capacity, so the load factor stays <= 0.5
+    HistorySlot *hashIndex = NULL;
+    uint32_t hashMask = 0;
+
+    // Age list over the used slots, oldest at ageHead, most recently inserted/updated at ageTail.
+    // Kept beside recentPackets so PacketRecord stays 20 bytes.
+    HistorySlot *agePrev = NULL;
+    HistorySlot *ageNext = NULL;
+    HistorySlot ageHead = PACKETHISTORY_NO_SLOT;
+    HistorySlot ageTail = PACKETHISTORY_NO_SLOT;
+
+    inline uint32_t hashHome(NodeNum sender, PacketId id) const;
+    HistorySlot findSlot(NodeNum sender, PacketId id) const;
+    void hashInsert(HistorySlot slot);
+    void hashRemove(HistorySlot slot);
+    void ageUnlink(HistorySlot slot);
+    void ageAppend(HistorySlot slot);
 
     /** Find a packet record in history.
      * @param sender NodeNum
@@ -34,7 +61,7 @@ class PacketHistory
      * @return pointer to PacketRecord if found, NULL if not found */
     PacketRecord *find(NodeNum sender, PacketId id);
 
-    /** Insert/Replace oldest PacketRecord in mx_recentPackets.
+    /** Insert/Replace oldest PacketRecord in mx_recentPackets. O(1): matched record via hashIndex, oldest via ageHead.
      * @param r PacketRecord to insert or replace */
     void insert(const PacketRecord &r); // Insert or replace a packet record in the history
 
@@ -75,4 +102,7 @@ class PacketHistory
 
     // To check if the PacketHistory was initialized correctly by constructor
     bool initOk(void) { return recentPackets != NULL && recentPacketsCapacity != 0; }
+
+    // Number of history slots currently holding a record
+    uint32_t getNumRecentPackets(void) const { return recentPacketsUsed; }
 };
@@ -31,6 +31,9 @@
 #endif
 #include "Throttle.h"
 #include <RTC.h>
+#if defined(FLAMINGO) && defined(DEBUG_PORT)
+#include "IncidentLog.h"
+#endif
 
 // Flag to indicate a heartbeat was received and we should send queue status
 bool heartbeatReceived = false;
@@ -767,10 +770,6 @@ bool PhoneAPI::wasSeenRecently(uint32_t id)
     return false;
 }
 
-#if defined(FLAMINGO) && defined(DEBUG_PORT)
-char phonemsg[201];
-#endif
-
 /**
  * Handle a packet that the phone wants us to send.  It is our responsibility to free the packet to the pool
  */
@@ -779,33 +778,10 @@ bool PhoneAPI::handleToRadioPacket(meshtastic_MeshPacket &p)
     printPacket("PACKET FROM PHONE", &p);
 
 #if defined(FLAMINGO) && defined(DEBUG_PORT)
-    auto &pp = p.decoded;
-    meshtastic_NodeInfoLite *n = nodeDB->getMeshNode(getFrom(&p));
-    /*
-    LOG_INFO("PhoneApi msg: from=0x%0x, id=0x%x, ln=%s, rxSNR=%g, hop_limit=%d, hop_start=%d, msg=%.*s",
-        p.from, p.id, n->user.long_name, p.rx_snr, p.hop_limit, p.hop_start, pp.payload.size, pp.payload.bytes);
-    */
-    LOG_INFO("PhoneApi msg: from=0x%0x, id=0x%x, ln=%s, rxSNR=%g, hop_limit=%d, hop_start=%d",
-        p.from, p.id, n->user.long_name, p.rx_snr, p.hop_limit, p.hop_start);
-    uint16_t offset;
-    uint16_t bytes_left = pp.payload.size;
-    bool do_loop = 1;
-    offset = 0;
-    /* apparently, the maximum size log message is about 150 characters. Deal this with this*/
-    while (do_loop) {
-        if (bytes_left <= 150) {
-            memset(phonemsg, 0, sizeof(phonemsg));
-            strncpy(phonemsg, (char *)(pp.payload.bytes+offset), bytes_left);
-            do_loop = 0;
-        } else {
-            memset(phonemsg, 0, sizeof(phonemsg));
-            strncpy(phonemsg, (char *)(pp.payload.bytes+offset), 150);
-            offset = offset + 150;
-            bytes_left = bytes_left-150;
-        }
-        LOG_INFO("z=%s",phonemsg);
-    }
-
+    // Incident Command reads the message from the event log
+    if (incidentLog && p.which_payload_variant == meshtastic_MeshPacket_decoded_tag &&
+        p.decoded.portnum == meshtastic_PortNum_TEXT_MESSAGE_APP)
+        incidentLog->logMessage(p, "phone");
 #endif
 
 #if defined(ARCH_PORTDUINO)
@@ -9,6 +9,9 @@
 #include "main.h"
 #include "sleep.h"
 #include <assert.h>
+#ifdef ARCH_PORTDUINO
+#include "platform/portduino/PortduinoGlue.h"
+#endif
 #include <pb_decode.h>
 #include <pb_encode.h>
 
@@ -328,6 +331,13 @@ uint32_t RadioInterface::getTxDelayMsecWeighted(meshtastic_MeshPacket *p)
 void printPacket(const char *prefix, const meshtastic_MeshPacket *p)
 {
 #if defined(DEBUG_PORT) && !defined(DEBUG_MUTE)
+    // Check before building the string, it's called for every packet
+    if (!LOG_ENABLED(DEBUG, LOG_SUBSYS_PACKETS))
+        return;
+#ifdef ARCH_PORTDUINO
+    if (portduino_config.logoutputlevel < level_debug)
+        return;
+#endif
     std::string out =
         DEBUG_PORT.mt_sprintf("%s (id=0x%08x fr=0x%08x to=0x%08x, transport = %u, WantAck=%d, HopLim=%d Ch=0x%x", prefix, p->id,
                               p->from, p->to, p->transport_mechanism, p->want_ack, p->hop_limit, p->channel);
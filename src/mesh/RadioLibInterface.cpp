@@ -448,7 +448,7 @@ void RadioLibInterface::handleReceiveInterrupt()
 
     int state = iface->readData((uint8_t *)&radioBuffer, length);
 #if ARCH_PORTDUINO
-    if (portduino_config.logoutputlevel == level_trace) {
+    if (portduino_config.logoutputlevel == level_trace && LOG_ENABLED(TRACE, LOG_SUBSYS_RADIO)) {
         printBytes("Raw incoming packet: ", (uint8_t *)&radioBuffer, length);
     }
 #endif
@@ -358,24 +358,31 @@ ErrorCode Router::send(meshtastic_MeshPacket *p)
     if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
         ChannelIndex chIndex = p->channel; // keep as a local because we are about to change it
 
-        DEBUG_HEAP_BEFORE;
-        meshtastic_MeshPacket *p_decoded = packetPool.allocCopy(*p);
-        DEBUG_HEAP_AFTER("Router::send", p_decoded);
+        // Keep the decoded form only if MQTT is going to publish it, copying a packet is not free
+        meshtastic_MeshPacket *p_decoded = NULL;
+#if !MESHTASTIC_EXCLUDE_MQTT
+        // Only publish to MQTT if we're the original transmitter of the packet
+        if (moduleConfig.mqtt.enabled && isFromUs(p) && mqtt) {
+            DEBUG_HEAP_BEFORE;
+            p_decoded = packetPool.allocCopy(*p);
+            DEBUG_HEAP_AFTER("Router::send", p_decoded);
+        }
+#endif
 
         auto encodeResult = perhapsEncode(p);
         if (encodeResult != meshtastic_Routing_Error_NONE) {
-            packetPool.release(p_decoded);
+            if (p_decoded)
+                packetPool.release(p_decoded);
             p->channel = 0; // Reset the channel to 0, so we don't use the failing hash again
             abortSendAndNak(encodeResult, p);
             return encodeResult; // FIXME - this isn't a valid ErrorCode
         }
+        if (p_decoded) {
 #if !MESHTASTIC_EXCLUDE_MQTT
-        // Only publish to MQTT if we're the original transmitter of the packet
-        if (moduleConfig.mqtt.enabled && isFromUs(p) && mqtt) {
             mqtt->onSend(*p, *p_decoded, chIndex);
-        }
 #endif
-        packetPool.release(p_decoded);
+            packetPool.release(p_decoded);
+        }
     }
 #ifdef FLAMINGO_SLINK
     if (moduleConfig.serial.enabled){
@@ -418,6 +425,15 @@ void Router::sniffReceived(const meshtastic_MeshPacket *p, const meshtastic_Rout
     // FIXME, update nodedb here for any packet that passes through us
 }
 
+ChannelDecryptStats channelDecryptStats;
+
+// Channel that last decrypted a packet from a sender, direct mapped on the sender's NodeNum. A collision only costs a miss.
+#define LAST_DECRYPT_CHANNEL_SLOTS 32
+static struct {
+    NodeNum from;
+    ChannelIndex chIndex;
+} lastDecryptChannel[LAST_DECRYPT_CHANNEL_SLOTS];
+
 DecodeState perhapsDecode(meshtastic_MeshPacket *p)
 {
     concurrency::LockGuard g(cryptLock);
@@ -473,8 +489,23 @@ DecodeState perhapsDecode(meshtastic_MeshPacket *p)
 
     // assert(p->which_payloadVariant == MeshPacket_encrypted_tag);
     if (!decrypted) {
-        // Try to find a channel that works with this hash
-        for (chIndex = 0; chIndex < channels.getNumChannels(); chIndex++) {
+        // Only channels with a matching hash are worth a try. The one this sender used last time goes first.
+        uint8_t candidates = channels.getChannelsForHash(p->channel);
+        auto &last = lastDecryptChannel[p->from % LAST_DECRYPT_CHANNEL_SLOTS];
+        int preferred = (last.from == p->from && (candidates & (1 << last.chIndex))) ? last.chIndex : -1;
+        ChannelIndex tryOrder[MAX_NUM_CHANNELS];
+        uint8_t numTries = 0;
+        if (preferred >= 0)
+            tryOrder[numTries++] = preferred;
+        for (ChannelIndex i = 0; i < channels.getNumChannels() && i < MAX_NUM_CHANNELS; i++) {
+            if ((candidates & (1 << i)) && i != preferred)
+                tryOrder[numTries++] = i;
+        }
+        if (numTries == 0)
+            channelDecryptStats.noCandidate++;
+
+        for (uint8_t t = 0; t < numTries; t++) {
+            chIndex = tryOrder[t];
             // Try to use this hash/channel pair
             if (channels.decryptForHash(chIndex, p->channel)) {
                 // we have to copy into a scratch buffer, because these bytes are a union with the decoded protobuf. Create a
@@ -482,6 +513,7 @@ DecodeState perhapsDecode(meshtastic_MeshPacket *p)
                 memcpy(bytes, p->encrypted.bytes, rawSize);
                 // Try to decrypt the packet if we can
                 crypto->decrypt(p->from, p->id, rawSize, bytes);
+                channelDecryptStats.attempts++;
 
                 // printBytes("plaintext", bytes, p->encrypted.size);
 
@@ -490,8 +522,10 @@ DecodeState perhapsDecode(meshtastic_MeshPacket *p)
                 memset(&decodedtmp, 0, sizeof(decodedtmp));
                 if (!pb_decode_from_bytes(bytes, rawSize, &meshtastic_Data_msg, &decodedtmp)) {
                     LOG_ERROR("Invalid protobufs in received mesh packet id=0x%08x (bad psk?)!", p->id);
+                    channelDecryptStats.wasted++;
                 } else if (decodedtmp.portnum == meshtastic_PortNum_UNKNOWN_APP) {
                     LOG_ERROR("Invalid portnum (bad psk?)!");
+                    channelDecryptStats.wasted++;
 #if !(MESHTASTIC_EXCLUDE_PKI)
                 } else if (!owner.is_licensed && isToUs(p) && decodedtmp.portnum == meshtastic_PortNum_TEXT_MESSAGE_APP) {
                     LOG_WARN("Rejecting legacy DM");
@@ -501,6 +535,10 @@ DecodeState perhapsDecode(meshtastic_MeshPacket *p)
                     p->decoded = decodedtmp;
                     p->which_payload_variant = meshtastic_MeshPacket_decoded_tag; // change type to decoded
                     decrypted = true;
+                    if (chIndex == preferred)
+                        channelDecryptStats.preferredHits++;
+                    last.from = p->from;
+                    last.chIndex = chIndex;
                     break;
                 }
             }
@@ -536,35 +574,39 @@ DecodeState perhapsDecode(meshtastic_MeshPacket *p)
         // Message is decrypted. Change range test payload
         if (isBroadcast(p->to)) {
             if ((p->decoded.payload.size > 4) && strncmp("seq ", (char *)p->decoded.payload.bytes, 4) == 0) {
-                // this is a range test packet. 
+                // this is a range test packet. Add how we hear it, and how we've been hearing its sender lately
                 auto bp = (char *)p->decoded.payload.bytes + p->decoded.payload.size;
-                if (RangeTestIsValidSnrAverage()) {
-                    auto extra = sprintf(bp, " RSSI=%i SNR=%.2f SNR_AVG:%.2f", p->rx_rssi, p->rx_snr, RangeTestGetSnrAverage());
-                    if (extra > 0){
-                        p->decoded.payload.size = p->decoded.payload.size + extra;
-                    }
+                size_t room = sizeof(p->decoded.payload.bytes) - p->decoded.payload.size;
+                const LinkQualityTable::Entry *link = rangeTestLinks.get(getFrom(p));
+                int extra;
+                if (link && LinkQualityTable::hasSnr(*link)) {
+                    extra = snprintf(bp, room, " RSSI=%i SNR=%.2f SNR_AVG:%.2f SNR_SD:%.2f LOSS:%d%%", p->rx_rssi, p->rx_snr,
+                                     link->snrMean, sqrtf(link->snrVar), LinkQualityTable::getLossPercent(*link));
                 } else {
-                    auto extra = sprintf(bp, " RSSI=%i SNR=%.2f SNR_AVG:n/a", p->rx_rssi, p->rx_snr);
-                    if (extra > 0){
-                        p->decoded.payload.size = p->decoded.payload.size + extra;
-                    }
+                    extra = snprintf(bp, room, " RSSI=%i SNR=%.2f SNR_AVG:n/a", p->rx_rssi, p->rx_snr);
+                }
+                if (extra > 0 && (size_t)extra < room) {
+                    p->decoded.payload.size = p->decoded.payload.size + extra;
                 }
-
             }
         }
 #endif
 
         printPacket("decoded message", p);
 #if ENABLE_JSON_LOGGING
-        LOG_TRACE("%s", MeshPacketSerializer::JsonSerialize(p, false).c_str());
+        if (LOG_ENABLED(TRACE, LOG_SUBSYS_JSON))
+            LOG_TRACE("%s", MeshPacketSerializer::JsonSerialize(p, false).c_str());
 #elif ARCH_PORTDUINO
-        if (portduino_config.traceFilename != "" || portduino_config.logoutputlevel == level_trace) {
+        if ((portduino_config.traceFilename != "" || portduino_config.logoutputlevel == level_trace) &&
+            LOG_ENABLED(TRACE, LOG_SUBSYS_JSON)) {
             LOG_TRACE("%s", MeshPacketSerializer::JsonSerialize(p, false).c_str());
         }
 #endif
         return DecodeState::DECODE_SUCCESS;
     } else {
-        LOG_WARN("No suitable channel found for decoding, hash was 0x%x!", p->channel);
+        LOG_WARN("No suitable channel found for decoding, hash was 0x%x! (decrypts=%u wasted=%u preferred=%u nohash=%u)",
+                 p->channel, channelDecryptStats.attempts, channelDecryptStats.wasted, channelDecryptStats.preferredHits,
+                 channelDecryptStats.noCandidate);
         return DecodeState::DECODE_FAILURE;
     }
 }
@@ -723,10 +765,15 @@ void Router::handleReceived(meshtastic_MeshPacket *p, RxSource src)
     // Also, we should set the time from the ISR and it should have msec level resolution
     p->rx_time = getValidTime(RTCQualityFromNet); // store the arrival timestamp for the phone
 
-    // Store a copy of encrypted packet for MQTT
-    DEBUG_HEAP_BEFORE;
-    meshtastic_MeshPacket *p_encrypted = packetPool.allocCopy(*p);
-    DEBUG_HEAP_AFTER("Router::handleReceived", p_encrypted);
+    // Store a copy of encrypted packet for MQTT, but only if we might publish it
+    meshtastic_MeshPacket *p_encrypted = NULL;
+#if !MESHTASTIC_EXCLUDE_MQTT
+    if (moduleConfig.mqtt.enabled && !isFromUs(p) && mqtt) {
+        DEBUG_HEAP_BEFORE;
+        p_encrypted = packetPool.allocCopy(*p);
+        DEBUG_HEAP_AFTER("Router::handleReceived", p_encrypted);
+    }
+#endif
 
     // Take those raw bytes and convert them back into a well structured protobuf we can understand
     auto decodedState = perhapsDecode(p);
@@ -780,17 +827,17 @@ void Router::handleReceived(meshtastic_MeshPacket *p, RxSource src)
 #if !MESHTASTIC_EXCLUDE_MQTT
         // Mark as pki_encrypted if it is not yet decoded and MQTT encryption is also enabled, hash matches and it's a DM not to
         // us (because we would be able to decrypt it)
-        if (decodedState == DecodeState::DECODE_FAILURE && moduleConfig.mqtt.encryption_enabled && p->channel == 0x00 &&
-            !isBroadcast(p->to) && !isToUs(p))
+        if (p_encrypted && decodedState == DecodeState::DECODE_FAILURE && moduleConfig.mqtt.encryption_enabled &&
+            p->channel == 0x00 && !isBroadcast(p->to) && !isToUs(p))
             p_encrypted->pki_encrypted = true;
         // After potentially altering it, publish received message to MQTT if we're not the original transmitter of the packet
-        if ((decodedState == DecodeState::DECODE_SUCCESS || p_encrypted->pki_encrypted) && moduleConfig.mqtt.enabled &&
-            !isFromUs(p) && mqtt)
+        if (p_encrypted && (decodedState == DecodeState::DECODE_SUCCESS || p_encrypted->pki_encrypted))
             mqtt->onSend(*p_encrypted, *p, p->channel);
 #endif
     }
 
-    packetPool.release(p_encrypted); // Release the encrypted packet
+    if (p_encrypted)
+        packetPool.release(p_encrypted); // Release the encrypted packet
 }
 
 void Router::perhapsHandleReceived(meshtastic_MeshPacket *p)
@@ -798,10 +845,12 @@ void Router::perhapsHandleReceived(meshtastic_MeshPacket *p)
 #if ENABLE_JSON_LOGGING
     // Even ignored packets get logged in the trace
     p->rx_time = getValidTime(RTCQualityFromNet); // store the arrival timestamp for the phone
-    LOG_TRACE("%s", MeshPacketSerializer::JsonSerializeEncrypted(p).c_str());
+    if (LOG_ENABLED(TRACE, LOG_SUBSYS_JSON))
+        LOG_TRACE("%s", MeshPacketSerializer::JsonSerializeEncrypted(p).c_str());
 #elif ARCH_PORTDUINO
     // Even ignored packets get logged in the trace
-    if (portduino_config.traceFilename != "" || portduino_config.logoutputlevel == level_trace) {
+    if ((portduino_config.traceFilename != "" || portduino_config.logoutputlevel == level_trace) &&
+        LOG_ENABLED(TRACE, LOG_SUBSYS_JSON)) {
         p->rx_time = getValidTime(RTCQualityFromNet); // store the arrival timestamp for the phone
         LOG_TRACE("%s", MeshPacketSerializer::JsonSerializeEncrypted(p).c_str());
     }
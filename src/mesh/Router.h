@@ -155,6 +155,14 @@ class Router : protected concurrency::OSThread, protected PacketHistory
 
 enum DecodeState { DECODE_SUCCESS, DECODE_FAILURE, DECODE_FATAL };
 
+/* Statistics for channel decryption in perhapsDecode: how often we ran AES + protobuf decode, how many of those runs were
+   wasted on a channel whose hash matched but whose key didn't, how often the sender's last channel was right on the first try
+   and how many packets had a hash that none of our channels use */
+struct ChannelDecryptStats {
+    uint32_t attempts = 0, wasted = 0, preferredHits = 0, noCandidate = 0;
+};
+extern ChannelDecryptStats channelDecryptStats;
+
 /** FIXME - move this into a mesh packet class
  * Remove any encryption and decode the protobufs inside this packet (if necessary).
  *
@@ -0,0 +1,428 @@
+#include "SerialLink.h"
+
+#if defined(FLAMINGO_SLINK) || defined(ARCH_PORTDUINO)
+
+#include "serialization/cobs.h"
+#include <algorithm>
+
+// Retransmit timeout bounds, and where it starts before there is an RTT sample
+#define SLINK_ARQ_MIN_RTO 20
+#define SLINK_ARQ_MAX_RTO 2000
+#define SLINK_ARQ_INITIAL_RTO 500
+
+// Slice-by-4 tables for the standard reflected CRC-32, filled on first use
+static uint32_t crc32Table[4][256];
+static bool crc32TableReady = false;
+
+static void initCrc32Table()
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int j = 0; j < 8; j++)
+            c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+        crc32Table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 4; t++)
+            crc32Table[t][i] = (crc32Table[t - 1][i] >> 8) ^ crc32Table[0][crc32Table[t - 1][i] & 0xFF];
+    }
+    crc32TableReady = true;
+}
+
+// 4 bytes per table step
+uint32_t computeCrc32(const uint8_t *buf, uint16_t len)
+{
+    if (!crc32TableReady)
+        initCrc32Table();
+
+    uint32_t crc = 0xFFFFFFFF;
+    for (; len >= 4; buf += 4, len -= 4) {
+        crc ^= (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+        crc = crc32Table[3][crc & 0xFF] ^ crc32Table[2][(crc >> 8) & 0xFF] ^ crc32Table[1][(crc >> 16) & 0xFF] ^
+              crc32Table[0][crc >> 24];
+    }
+    while (len--)
+        crc = (crc >> 8) ^ crc32Table[0][(crc ^ *buf++) & 0xFF];
+    return ~crc;
+}
+
+static uint8_t txBody[SLINK_COBS_MAX_BODY];
+static uint8_t txFrame[COBS_ENCODE_DST_BUF_LEN_MAX(SLINK_COBS_MAX_BODY) + 2];
+
+bool slinkWriteFrame(Stream *stream, const uint8_t *head, size_t head_len, const uint8_t *payload, size_t payload_len)
+{
+    size_t len = head_len + payload_len;
+    if (len + sizeof(uint32_t) > sizeof(txBody))
+        return false;
+
+    memcpy(txBody, head, head_len);
+    if (payload_len)
+        memcpy(txBody + head_len, payload, payload_len);
+    uint32_t crc = computeCrc32(txBody, len);
+    for (int i = 0; i < 4; i++)
+        txBody[len++] = crc >> (8 * i);
+
+    cobs_encode_result res = cobs_encode(txFrame + 1, sizeof(txFrame) - 2, txBody, len);
+    if (res.status != COBS_ENCODE_OK) {
+        LOG_ERROR("Serial link COBS encode failed, status %d", res.status);
+        return false;
+    }
+    txFrame[0] = 0;
+    txFrame[res.out_len + 1] = 0;
+    stream->write(txFrame, res.out_len + 2);
+    return true;
+}
+
+int slinkDecodeFrame(const uint8_t *frame, size_t frame_len, uint8_t *body, size_t body_size)
+{
+    cobs_decode_result res = cobs_decode(body, body_size, frame, frame_len);
+    if (res.status != COBS_DECODE_OK || res.out_len <= sizeof(uint32_t))
+        return SLINK_FRAME_BAD_COBS;
+
+    size_t len = res.out_len - sizeof(uint32_t);
+    uint32_t receivedCrc = 0;
+    for (int i = 0; i < 4; i++)
+        receivedCrc |= (uint32_t)body[len + i] << (8 * i);
+    if (receivedCrc != computeCrc32(body, len))
+        return SLINK_FRAME_BAD_CRC;
+    return len;
+}
+
+void SerialLinkContext::touch(uint8_t i)
+{
+    Entry e = entries[i];
+    memmove(entries + 1, entries, i * sizeof(Entry));
+    entries[0] = e;
+}
+
+void SerialLinkContext::insert(NodeNum node)
+{
+    if (count < SLINK_CONTEXT_SIZE)
+        count++;
+    memmove(entries + 1, entries, (count - 1) * sizeof(Entry));
+    entries[0] = {node, 0, false};
+}
+
+void SerialLinkContext::putNode(uint8_t *buf, size_t &len, NodeNum node)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (entries[i].node == node) {
+            buf[len++] = i;
+            touch(i);
+            return;
+        }
+    }
+    buf[len++] = SLINK_CONTEXT_LITERAL;
+    for (int i = 0; i < 4; i++)
+        buf[len++] = node >> (8 * i);
+    insert(node);
+}
+
+bool SerialLinkContext::getNode(const uint8_t *buf, size_t len, size_t &pos, NodeNum &node)
+{
+    if (pos >= len)
+        return false;
+    uint8_t i = buf[pos++];
+    if (i != SLINK_CONTEXT_LITERAL) {
+        if (i >= count)
+            return false;
+        node = entries[i].node;
+        touch(i);
+        return true;
+    }
+    if (len - pos < 4)
+        return false;
+    node = 0;
+    for (int b = 0; b < 4; b++)
+        node |= (NodeNum)buf[pos++] << (8 * b);
+    insert(node);
+    return true;
+}
+
+bool SerialLinkContext::putId(uint8_t *buf, size_t &len, PacketId id)
+{
+    Entry &e = entries[0];
+    uint32_t step = (id - e.lastId) & ID_COUNTER_MASK;
+    bool isStep = e.hasId && step >= 1 && step <= 4;
+    // The random part is the top 22 bits, the 2 bits below it carry the step
+    uint32_t v = isStep ? ((id & ~ID_COUNTER_MASK) >> 8) | (step - 1) : id;
+    for (int i = 0; i < (isStep ? 3 : 4); i++)
+        buf[len++] = v >> (8 * i);
+    e.lastId = id;
+    e.hasId = true;
+    return isStep;
+}
+
+bool SerialLinkContext::getId(const uint8_t *buf, size_t len, size_t &pos, bool isStep, PacketId &id)
+{
+    Entry &e = entries[0];
+    int n = isStep ? 3 : 4;
+    if (count == 0 || (isStep && !e.hasId) || len - pos < (size_t)n)
+        return false;
+    uint32_t v = 0;
+    for (int i = 0; i < n; i++)
+        v |= (uint32_t)buf[pos++] << (8 * i);
+    if (isStep)
+        id = ((v & ~3u) << 8) | ((e.lastId + (v & 3) + 1) & ID_COUNTER_MASK);
+    else
+        id = v;
+    e.lastId = id;
+    e.hasId = true;
+    return true;
+}
+
+SerialLinkArq::SerialLinkArq(Stream *_stream, Receiver _receiver, uint8_t _epoch, TxLost _txLost)
+    : stream(_stream), receiver(_receiver), txLost(_txLost), epoch(_epoch ? _epoch : 1), rto(SLINK_ARQ_INITIAL_RTO)
+{
+}
+
+bool SerialLinkArq::send(const uint8_t *payload, size_t len)
+{
+    if (!canSend() || len > SLINK_ARQ_MAX_PAYLOAD)
+        return false;
+
+    for (auto &slot : window) {
+        if (slot.used)
+            continue;
+        slot.used = true;
+        slot.seq = nextSeq++;
+        slot.tries = 0;
+        slot.len = len;
+        memcpy(slot.payload, payload, len);
+        stats.framesSent++;
+        transmit(slot);
+        return true;
+    }
+    return false;
+}
+
+void SerialLinkArq::transmit(Slot &slot)
+{
+    if (slot.tries > 0)
+        stats.retransmissions++;
+    slot.tries++;
+    slot.fastRetransmitted = false;
+    slot.sentMsec = millis();
+    writeFrame(SLINK_ARQ_FLAG_DATA, slot.seq, slot.payload, slot.len);
+}
+
+void SerialLinkArq::sendAck()
+{
+    stats.acksSent++;
+    writeFrame(0, 0, NULL, 0);
+}
+
+void SerialLinkArq::probe()
+{
+    writeFrame(0, 0, NULL, 0);
+}
+
+void SerialLinkArq::writeFrame(uint8_t flags, uint8_t seq, const uint8_t *payload, size_t len)
+{
+    if (rxSynced)
+        flags |= SLINK_ARQ_FLAG_ACK;
+    const uint8_t head[SLINK_ARQ_HEADER_LEN] = {SLINK_ARQ_MAGIC, flags, epoch, seq, getSendBase(), peerEpoch, rxNext, rxBitmap};
+    slinkWriteFrame(stream, head, sizeof(head), payload, len);
+    ackOwed = false; // Every frame carries the latest ACK
+}
+
+void SerialLinkArq::handleFrame(const uint8_t *body, size_t len)
+{
+    if (len < SLINK_ARQ_HEADER_LEN || body[0] != SLINK_ARQ_MAGIC || body[2] == 0)
+        return;
+    uint8_t flags = body[1], frameEpoch = body[2], seq = body[3], base = body[4], ackedEpoch = body[5], ack = body[6],
+            sack = body[7];
+
+    if (frameEpoch != peerEpoch) {
+        if (peerEpoch)
+            LOG_INFO("Serial link peer restarted");
+        peerEpoch = frameEpoch;
+        clearRx();
+        // Whatever was in flight either way around is gone
+        receiver(NULL, 0);
+        if (txLost)
+            txLost();
+    }
+    if (!rxSynced) {
+        // Pick up wherever the peer is, what it still has in flight starts at base
+        rxNext = base;
+        rxSynced = true;
+    }
+    if ((flags & SLINK_ARQ_FLAG_ACK) && ackedEpoch == epoch)
+        onAck(ack, sack);
+
+    // The peer gave up on everything before base that is still missing
+    uint8_t skip = base - rxNext;
+    if (skip > 0 && skip < 128)
+        skipRx(base);
+
+    if (!(flags & SLINK_ARQ_FLAG_DATA)) {
+        // The peer doesn't know us yet, or missed that we restarted: answer
+        if (ackedEpoch != epoch)
+            ackOwed = true;
+        return;
+    }
+    ackOwed = true;
+
+    const uint8_t *payload = body + SLINK_ARQ_HEADER_LEN;
+    size_t payloadLen = len - SLINK_ARQ_HEADER_LEN;
+    uint8_t ahead = seq - rxNext;
+    if (ahead == 0) {
+        receiver(payload, payloadLen);
+        nextRx();
+    } else if (ahead < SLINK_ARQ_WINDOW && !(rxBitmap & (1 << (ahead - 1)))) {
+        for (auto &h : held) {
+            if (h.used)
+                continue;
+            h.used = true;
+            h.seq = seq;
+            h.len = payloadLen;
+            memcpy(h.payload, payload, payloadLen);
+            rxBitmap |= 1 << (ahead - 1);
+            break;
+        }
+    } else {
+        // Delivered before and our ACK got lost, or from beyond any window the peer could have. Either way it'll be acked.
+        stats.duplicates++;
+    }
+}
+
+void SerialLinkArq::skipRx(uint8_t seq)
+{
+    while (rxNext != seq) {
+        receiver(NULL, 0);
+        nextRx();
+    }
+}
+
+void SerialLinkArq::nextRx()
+{
+    for (;;) {
+        bool isHeld = rxBitmap & 1;
+        rxBitmap >>= 1;
+        rxNext++;
+        if (!isHeld)
+            return;
+        for (auto &h : held) {
+            if (h.used && h.seq == rxNext) {
+                h.used = false;
+                receiver(h.payload, h.len);
+                break;
+            }
+        }
+    }
+}
+
+void SerialLinkArq::clearRx()
+{
+    for (auto &h : held)
+        h.used = false;
+    rxBitmap = 0;
+    rxSynced = false;
+}
+
+uint8_t SerialLinkArq::getSendBase() const
+{
+    uint8_t base = nextSeq;
+    for (auto &slot : window) {
+        if (slot.used && (uint8_t)(nextSeq - slot.seq) > (uint8_t)(nextSeq - base))
+            base = slot.seq;
+    }
+    return base;
+}
+
+void SerialLinkArq::onAck(uint8_t ack, uint8_t sack)
+{
+    uint32_t now = millis();
+
+    // How far past the cumulative ACK the peer has received something
+    uint8_t highestSacked = 0;
+    for (uint8_t i = SLINK_ARQ_SACK_BITS; i > 0; i--) {
+        if (sack & (1 << (i - 1))) {
+            highestSacked = i;
+            break;
+        }
+    }
+
+    for (auto &slot : window) {
+        if (!slot.used)
+            continue;
+        uint8_t ahead = slot.seq - ack;
+        bool acked = ahead >= 128 || (ahead >= 1 && ahead <= SLINK_ARQ_SACK_BITS && (sack & (1 << (ahead - 1))));
+        if (acked) {
+            // Karn's algorithm: only frames sent once give an unambiguous RTT sample
+            if (slot.tries == 1)
+                updateRtt(now - slot.sentMsec);
+            release(slot);
+        } else if (ahead < highestSacked && !slot.fastRetransmitted && now - slot.sentMsec >= srtt) {
+            // A later frame made it, this one was lost
+            transmit(slot);
+            slot.fastRetransmitted = true;
+        }
+    }
+}
+
+int32_t SerialLinkArq::poll()
+{
+    uint32_t now = millis();
+    int32_t next = INT32_MAX;
+
+    for (auto &slot : window) {
+        if (!slot.used)
+            continue;
+        uint32_t timeout = std::min<uint32_t>(rto << (slot.tries - 1), SLINK_ARQ_MAX_RTO);
+        uint32_t age = now - slot.sentMsec;
+        if (age >= timeout) {
+            if (slot.tries >= SLINK_ARQ_MAX_TRIES) {
+                LOG_WARN("Serial link gave up on frame %u after %u tries", slot.seq, slot.tries);
+                stats.expired++;
+                release(slot);
+                if (txLost)
+                    txLost();
+                continue;
+            }
+            transmit(slot);
+            timeout = std::min<uint32_t>(rto << (slot.tries - 1), SLINK_ARQ_MAX_RTO);
+            age = 0;
+        }
+        next = std::min<int32_t>(next, timeout - age);
+    }
+
+    if (ackOwed)
+        sendAck();
+    return next;
+}
+
+void SerialLinkArq::reset()
+{
+    for (auto &slot : window)
+        slot.used = false;
+    peerEpoch = 0;
+    clearRx();
+    ackOwed = false;
+    haveRtt = false;
+    srtt = rttvar = 0;
+    rto = SLINK_ARQ_INITIAL_RTO;
+}
+
+void SerialLinkArq::release(Slot &slot)
+{
+    slot.used = false;
+}
+
+// RFC 6298
+void SerialLinkArq::updateRtt(uint32_t sample)
+{
+    if (!haveRtt) {
+        srtt = sample;
+        rttvar = sample / 2;
+        haveRtt = true;
+    } else {
+        uint32_t err = srtt > sample ? srtt - sample : sample - srtt;
+        rttvar = (3 * rttvar + err) / 4;
+        srtt = (7 * srtt + sample) / 8;
+    }
+    rto = std::min<uint32_t>(std::max<uint32_t>(srtt + 4 * rttvar, SLINK_ARQ_MIN_RTO), SLINK_ARQ_MAX_RTO);
+}
+
+#endif
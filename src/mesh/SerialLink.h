@@ -0,0 +1,215 @@
+#pragma once
+
+#include "configuration.h"
+
+#if defined(FLAMINGO_SLINK) || defined(ARCH_PORTDUINO)
+
+#include "MeshTypes.h"
+#include <Arduino.h>
+#include <functional>
+
+/**
+ * Framing shared by everything that talks COBS on the Flamingo serial link (SLINK): a frame is 0x00, COBS(body), 0x00, and
+ * the body ends with the CRC-32 of the bytes before it, little endian. The first byte of the body says what kind of frame
+ * it is.
+ */
+#define SLINK_COBS_MAX_BODY 600
+
+/// CRC-32 (IEEE 802.3)
+uint32_t computeCrc32(const uint8_t *buf, uint16_t len);
+
+/// Write head followed by payload as one frame. Returns false if it doesn't fit in SLINK_COBS_MAX_BODY.
+bool slinkWriteFrame(Stream *stream, const uint8_t *head, size_t head_len, const uint8_t *payload, size_t payload_len);
+
+#define SLINK_FRAME_BAD_COBS -1
+#define SLINK_FRAME_BAD_CRC -2
+
+/**
+ * Decode a frame received without its delimiters and check its CRC.
+ * @return the length of the body without the CRC, or SLINK_FRAME_BAD_COBS / SLINK_FRAME_BAD_CRC
+ */
+int slinkDecodeFrame(const uint8_t *frame, size_t frame_len, uint8_t *body, size_t body_size);
+
+/**
+ * Link layer reliability for the serial link: selective repeat ARQ.
+ *
+ * Data frames carry a sequence number, and every frame carries a cumulative ACK (the next sequence number expected) plus a
+ * bitmap of the SLINK_ARQ_SACK_BITS frames after it that already arrived. Up to SLINK_ARQ_WINDOW frames are in flight. A
+ * frame is sent again when its retransmit timeout expires, or straight away when a later frame gets acknowledged first.
+ * Sequence numbers in flight never span more than the window, and every frame also carries the oldest one the sender
+ * still retransmits, so a receiver moves past frames the sender gave up on.
+ * The timeout follows a smoothed RTT estimate (Jacobson/Karels). Payloads are delivered once and in order: frames that
+ * arrive ahead of a missing one are held until it does, or until the sender gives up on it.
+ *
+ * Each side picks a random nonzero epoch when it starts, so a peer that restarted is noticed and not mistaken for a stream
+ * of duplicates.
+ *
+ * Frame body: SLINK_ARQ_MAGIC, flags (SLINK_ARQ_FLAG_*), epoch, seq, base, acked epoch, ack, sack bitmap, payload. The acked
+ * epoch is the last one heard from the peer, 0 before that. A frame without data that doesn't carry our epoch there gets
+ * answered, which is how two sides find out they both speak ARQ.
+ */
+#define SLINK_ARQ_MAGIC 0xC6
+#define SLINK_ARQ_HEADER_LEN 8
+#define SLINK_ARQ_FLAG_DATA 0x01 // seq and payload are valid
+#define SLINK_ARQ_FLAG_ACK 0x02  // ack and sack are valid
+
+#define SLINK_ARQ_WINDOW 4
+#define SLINK_ARQ_SACK_BITS 8
+#define SLINK_ARQ_MAX_TRIES 6
+/// Largest payload of a data frame
+#define SLINK_ARQ_MAX_PAYLOAD (SLINK_COBS_MAX_BODY - SLINK_ARQ_HEADER_LEN - sizeof(uint32_t))
+
+/**
+ * Header compression state for one direction of the serial link.
+ *
+ * Holds the SLINK_CONTEXT_SIZE NodeNums used most recently, most recent first, with the last packet id seen from each. A
+ * NodeNum in there is sent as its 1 byte index, any other one as SLINK_CONTEXT_LITERAL and 4 bytes, and either way it then
+ * moves to the front. Packet ids are a random part and a per sender counter (see generatePacketId()), so when the counter
+ * moved on by 1 to 4 since the last id from the same sender, the id is sent as the random part and that step in 3 bytes
+ * instead of 4.
+ *
+ * The sender and the receiver make the same updates in the same order, so this only works over a link that delivers
+ * everything in order, and both need to start over from reset() whenever something went missing.
+ */
+#define SLINK_CONTEXT_SIZE 32
+#define SLINK_CONTEXT_LITERAL 0xFF
+
+class SerialLinkContext
+{
+  public:
+    void reset() { count = 0; }
+
+    /// Append node and make it the most recent entry
+    void putNode(uint8_t *buf, size_t &len, NodeNum node);
+    /// @return false if the buffer ends early or refers to an entry we don't have
+    bool getNode(const uint8_t *buf, size_t len, size_t &pos, NodeNum &node);
+
+    /**
+     * Append the id of a packet from the most recent entry, right after putNode() for its sender.
+     * @return true if it went out as a step of the sender's counter, the receiver needs to know which
+     */
+    bool putId(uint8_t *buf, size_t &len, PacketId id);
+    bool getId(const uint8_t *buf, size_t len, size_t &pos, bool isStep, PacketId &id);
+
+  private:
+    struct Entry {
+        NodeNum node;
+        PacketId lastId;
+        bool hasId;
+    };
+    Entry entries[SLINK_CONTEXT_SIZE];
+    uint8_t count = 0;
+
+    /// Move entry i to the front
+    void touch(uint8_t i);
+    /// Put a new entry in front, dropping the least recent one when full
+    void insert(NodeNum node);
+};
+
+class SerialLinkArq
+{
+  public:
+    struct Stats {
+        uint32_t framesSent;      // Data frames sent for the first time
+        uint32_t retransmissions; // Data frames sent again
+        uint32_t expired;         // Data frames given up on after SLINK_ARQ_MAX_TRIES sends
+        uint32_t duplicates;      // Data frames received again after they were delivered
+        uint32_t acksSent;        // Frames sent only to acknowledge
+    };
+
+    /**
+     * Called with the payload of each data frame, in order. Called with NULL where a frame the peer gave up on was skipped,
+     * and when the peer restarted, because the payloads around that point are lost.
+     */
+    typedef std::function<void(const uint8_t *payload, size_t len)> Receiver;
+    /// Called when the peer may have missed payloads we sent: we gave up on one, or it restarted
+    typedef std::function<void()> TxLost;
+
+    SerialLinkArq(Stream *stream, Receiver receiver, uint8_t epoch, TxLost txLost = nullptr);
+
+    /// @return true if a frame can be sent without waiting for an ACK first
+    bool canSend() const { return (uint8_t)(nextSeq - getSendBase()) < SLINK_ARQ_WINDOW; }
+
+    /// Send a payload reliably. Returns false if the window is full or the payload is too long.
+    bool send(const uint8_t *payload, size_t len);
+
+    /// Handle a received frame body that starts with SLINK_ARQ_MAGIC, CRC already checked
+    void handleFrame(const uint8_t *body, size_t len);
+
+    /**
+     * Retransmit what timed out and send any ACK still owed.
+     * @return msecs until something will need doing, or INT32_MAX if nothing will
+     */
+    int32_t poll();
+
+    /// Send an empty frame, so the peer learns we speak ARQ and answers with one of its own
+    void probe();
+
+    /// @return true once the peer sent us an ARQ frame
+    bool peerSpeaksArq() const { return peerEpoch != 0; }
+
+    /// Forget the peer and everything in flight, for when it stops speaking ARQ
+    void reset();
+
+    uint32_t getSrttMsec() const { return srtt; }
+    uint32_t getRtoMsec() const { return rto; }
+    const Stats &getStats() const { return stats; }
+
+  private:
+    struct Slot {
+        bool used;
+        uint8_t seq;
+        uint8_t tries;
+        bool fastRetransmitted; // At most once per send, so a stale SACK can't trigger a storm
+        uint32_t sentMsec;
+        uint16_t len;
+        uint8_t payload[SLINK_ARQ_MAX_PAYLOAD];
+    };
+
+    /// A frame that arrived ahead of rxNext, waiting to be delivered
+    struct Held {
+        bool used;
+        uint8_t seq;
+        uint16_t len;
+        uint8_t payload[SLINK_ARQ_MAX_PAYLOAD];
+    };
+
+    Stream *stream;
+    Receiver receiver;
+    TxLost txLost;
+    uint8_t epoch;
+
+    // Sending
+    Slot window[SLINK_ARQ_WINDOW] = {};
+    uint8_t nextSeq = 0;
+
+    // Receiving
+    uint8_t peerEpoch = 0;
+    bool rxSynced = false;   // rxNext is known for peerEpoch
+    uint8_t rxNext = 0;      // Every seq before this one was delivered or skipped
+    uint8_t rxBitmap = 0;    // Bit i: rxNext + 1 + i is held
+    Held held[SLINK_ARQ_WINDOW - 1] = {};
+    bool ackOwed = false;
+
+    // Retransmit timeout, in msecs
+    bool haveRtt = false;
+    uint32_t srtt = 0, rttvar = 0, rto;
+
+    Stats stats = {};
+
+    /// The oldest seq still in flight, or nextSeq if there is none
+    uint8_t getSendBase() const;
+    /// Skip the missing frames before seq
+    void skipRx(uint8_t seq);
+    /// rxNext was delivered or skipped: move past it and deliver the held frames that follow
+    void nextRx();
+    void clearRx();
+    void transmit(Slot &slot);
+    void sendAck();
+    void writeFrame(uint8_t flags, uint8_t seq, const uint8_t *payload, size_t len);
+    void onAck(uint8_t ack, uint8_t sack);
+    void release(Slot &slot);
+    void updateRtt(uint32_t sample);
+};
+
+#endif
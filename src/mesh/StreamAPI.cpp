@@ -193,15 +193,15 @@ void StreamAPI::emitRebooted()
     emitTxBuffer(pb_encode_to_bytes(txBuf + HEADER_LEN, meshtastic_FromRadio_size, &meshtastic_FromRadio_msg, &fromRadioScratch));
 }
 
-void StreamAPI::emitLogRecord(meshtastic_LogRecord_Level level, const char *src, const char *format, va_list arg)
+void StreamAPI::emitLogRecord(meshtastic_LogRecord_Level level, const char *src, uint32_t rtcSec, const char *format,
+                              va_list arg)
 {
     // In case we send a FromRadio packet
     memset(&fromRadioScratch, 0, sizeof(fromRadioScratch));
     fromRadioScratch.which_payload_variant = meshtastic_FromRadio_log_record_tag;
     fromRadioScratch.log_record.level = level;
 
-    uint32_t rtc_sec = getValidTime(RTCQuality::RTCQualityDevice, true);
-    fromRadioScratch.log_record.time = rtc_sec;
+    fromRadioScratch.log_record.time = rtcSec;
     strncpy(fromRadioScratch.log_record.source, src, sizeof(fromRadioScratch.log_record.source) - 1);
 
     auto num_printed =
@@ -87,6 +87,6 @@ class StreamAPI : public PhoneAPI
     /// Subclasses can use this scratch buffer if they wish
     uint8_t txBuf[MAX_STREAM_BUF_SIZE] = {0};
 
-    /// Low level function to emit a protobuf encapsulated log record
-    void emitLogRecord(meshtastic_LogRecord_Level level, const char *src, const char *format, va_list arg);
+    /// Low level function to emit a protobuf encapsulated log record, logged at RTC time rtcSec
+    void emitLogRecord(meshtastic_LogRecord_Level level, const char *src, uint32_t rtcSec, const char *format, va_list arg);
 };
\ No newline at end of file
@@ -27,6 +27,9 @@
 #if defined(FLAMINGO) && defined(FLAMINGO_BUZZER)
 #include "BuzzerModule.h"
 #endif
+#ifdef FLAMINGO
+#include "IncidentLog.h"
+#endif
 
 RangeTestModule *rangeTestModule;
 RangeTestModuleRadio *rangeTestModuleRadio;
@@ -37,23 +40,21 @@ uint32_t packetSequence = 0;
 
 #ifdef FLAMINGO
 
-#define SNR_BUFFER_SIZE 3    // 3 packets seem to be enough for a decent average
 #define SNR_MININMUM 1.0     // send three beeps if below this threadhold
+#define SUMMARY_INTERVAL_MS (60 * 1000) // how often the phone gets link statistics while range test packets come in
 
-float snr_buffer[SNR_BUFFER_SIZE];  // SNR values of last SNR_BUFFER_SIZE packets
-float snr_last_average = 0.0;      // SNR average of last SNR_BUFFER_SIZE packets
-uint8_t snr_buffer_ptr = 0;        // circular buffer pointer into snr_buffer
-uint8_t snr_buffer_count = 0;      // Used to track that received min number of packets to compute SNR average
-
-float RangeTestGetSnrAverage() {
-    return snr_last_average;
-}
+LinkQualityTable rangeTestLinks;
 
-bool RangeTestIsValidSnrAverage() {
-    return snr_buffer_count == SNR_BUFFER_SIZE;
+// @return the sequence number of a range test payload, 0 if it isn't one
+static uint32_t getRangeTestSeq(const meshtastic_Data &d)
+{
+    if (d.payload.size <= 4 || strncmp("seq ", (const char *)d.payload.bytes, 4) != 0)
+        return 0;
+    char digits[11] = {0};
+    memcpy(digits, d.payload.bytes + 4, std::min<size_t>(d.payload.size - 4, sizeof(digits) - 1));
+    return strtoul(digits, NULL, 10);
 }
 
-
 #endif
 
 
@@ -99,9 +100,6 @@ int32_t RangeTestModule::runOnce()
                     return (senderHeartbeat);
             }
 
-            snr_buffer_ptr = 0;
-            snr_buffer_count = 0;
-            for (uint8_t i = 0; i < SNR_BUFFER_SIZE; i++) snr_buffer[i] = 0;
             return (5000);      // Sending first message 5 seconds after initialization.
 #else
             firstTime = 0;
@@ -224,23 +222,22 @@ ProcessMessage RangeTestModuleRadio::handleReceived(const meshtastic_MeshPacket
             }
             
 #ifdef FLAMINGO
-            // Compute SNR average of last SNR_BUFFER_SIZE packets
-            snr_buffer[snr_buffer_ptr] = mp.rx_snr;  // save SNR value
-            if (snr_buffer_count < SNR_BUFFER_SIZE)
-            {
-                snr_buffer_count++;  // track that we have received enough packets to compute an average
+            // Link quality of this sender. Only the radio says anything about the link, and a relayed copy is about the relay.
+            NodeNum from = getFrom(&mp);
+            bool direct = !mp.via_mqtt && !mp.via_slink && (mp.hop_start == 0 || mp.hop_start == mp.hop_limit);
+            rangeTestLinks.update(from, mp.rx_snr, mp.rx_rssi, direct, millis(), getRangeTestSeq(mp.decoded));
+            const LinkQualityTable::Entry *link = rangeTestLinks.get(from);
+            if (LinkQualityTable::hasSnr(*link)) {
+                LOG_DEBUG("Range test link 0x%x: SNR %.2f sd %.2f, RSSI %.1f sd %.1f, %d%% lost of last %u", from, link->snrMean,
+                          sqrtf(link->snrVar), link->rssiMean, sqrtf(link->rssiVar), LinkQualityTable::getLossPercent(*link),
+                          link->seqSpan);
             }
-            if (snr_buffer_count == SNR_BUFFER_SIZE) {
-                /* We have enough packets to compute the average*/
-                snr_last_average = 0.0;
-                for (uint8_t i = 0; i < SNR_BUFFER_SIZE; i++) snr_last_average += snr_buffer[i];
-                snr_last_average = snr_last_average/SNR_BUFFER_SIZE;
+            if (!Throttle::isWithinTimespanMs(lastSummaryMsec, SUMMARY_INTERVAL_MS)) {
+                lastSummaryMsec = millis();
+                sendSummary();
             }
-            /* increment buffer pointer after average */
-            snr_buffer_ptr++;
-            if (snr_buffer_ptr >= SNR_BUFFER_SIZE) snr_buffer_ptr = 0; // wrap pointer
             uint8_t num_tones = 1;
-            if ((snr_buffer_count == SNR_BUFFER_SIZE) && snr_last_average < SNR_MININMUM) {
+            if (LinkQualityTable::hasSnr(*link) && link->snrMean < SNR_MININMUM) {
                  num_tones = 3; // set max tones regardless of RSSI value
             }
             else if (mp.rx_rssi < -110) {
@@ -287,6 +284,33 @@ ProcessMessage RangeTestModuleRadio::handleReceived(const meshtastic_MeshPacket
     return ProcessMessage::CONTINUE; // Let others look at this message also if they want
 }
 
+#ifdef FLAMINGO
+void RangeTestModuleRadio::sendSummary()
+{
+    rangeTestLinks.forEach([this](const LinkQualityTable::Entry &e) {
+        if (!e.seqSpan)
+            return true;
+
+        // e.g. "stats !a1b2c3d4 rx 29/32 burst 2 jitter 140ms snr 6.5"
+        char line[64];
+        int len = snprintf(line, sizeof(line), "stats !%08x rx %u/%u burst %u jitter %ums", e.node, LinkQualityTable::getHeard(e),
+                           e.seqSpan, LinkQualityTable::getLongestBurst(e), (unsigned)e.jitterMsec);
+        if (LinkQualityTable::hasSnr(e))
+            snprintf(line + len, sizeof(line) - len, " snr %.1f", e.snrMean);
+        LOG_DEBUG("Range test %s", line);
+        if (incidentLog)
+            incidentLog->logRangeTest(e);
+
+        meshtastic_MeshPacket *p = allocDataPacket();
+        p->to = nodeDB->getNodeNum();
+        p->decoded.payload.size = strlen(line);
+        memcpy(p->decoded.payload.bytes, line, p->decoded.payload.size);
+        service->sendToPhone(p);
+        return true;
+    });
+}
+#endif
+
 bool RangeTestModuleRadio::appendFile(const meshtastic_MeshPacket &mp)
 {
 #ifdef ARCH_ESP32
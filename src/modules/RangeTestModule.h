@@ -7,9 +7,11 @@
 #include <functional>
 
 #ifdef FLAMINGO
-extern float RangeTestGetSnrAverage();
-extern bool RangeTestIsValidSnrAverage();
-#endif 
+#include "LinkQualityTable.h"
+
+/// Link quality of every range test sender we hear
+extern LinkQualityTable rangeTestLinks;
+#endif
 
 class RangeTestModule : private concurrency::OSThread
 {
@@ -32,6 +34,9 @@ extern RangeTestModule *rangeTestModule;
 class RangeTestModuleRadio : public SinglePortModule
 {
     uint32_t lastRxID = 0;
+#ifdef FLAMINGO
+    uint32_t lastSummaryMsec = 0;
+#endif
 
   public:
     RangeTestModuleRadio() : SinglePortModule("RangeTestModuleRadio", meshtastic_PortNum_RANGE_TEST_APP)
@@ -54,6 +59,13 @@ class RangeTestModuleRadio : public SinglePortModule
      */
     bool removeFile();
 
+#ifdef FLAMINGO
+    /**
+     * Send the phone a line of link statistics for every range test sender we hear, and an incident log event
+     */
+    void sendSummary();
+#endif
+
   protected:
     /** Called to handle a particular incoming message
 
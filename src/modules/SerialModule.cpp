@@ -2,14 +2,17 @@
 
 #include "SerialModule.h"
 #include "GeoCoord.h"
+#include "IncidentLog.h"
 #include "MeshService.h"
 #include "NMEAWPL.h"
 #include "NodeDB.h"
 #include "RTC.h"
 #include "Router.h"
 #include "configuration.h"
+#include "serialization/cobs.h"
 #include <Arduino.h>
 #include <Throttle.h>
+#include <algorithm>
 
 /*
 
@@ -28,6 +31,15 @@
 
 #define TIMEOUT 250
 #define BAUD 38400
+// A frame that stops arriving for this long is given up on
+#define SLINK_FRAME_TIMEOUT 100
+#define SLINK_STATS_INTERVAL (15 * 60 * 1000UL)
+// Packets waiting for the serial thread, and packets remembered so they aren't sent twice
+#define SLINK_TX_QUEUE_SIZE 16
+#define SLINK_TX_HISTORY_SIZE 64
+#define SLINK_ARQ_PROBE_INTERVAL (10 * 1000)
+// Compressed batches between header compression contexts starting over
+#define SLINK_CONTEXT_REFRESH 64
 #define ACK 1
 
 // API: Defaulting to the formerly removed phone_timeout_secs value of 15 minutes
@@ -50,10 +62,8 @@ static Print *serialPrint = &Serial1;
 #define headerByte1 0xaa
 #define headerByte2 0x55
 
-
-size_t serialPayloadSize;
-
-uint32_t computeCrc32(const uint8_t* buf, uint16_t len) {
+// Framing version 1 CRC: the reflected polynomial with a left shift, one bit at a time
+uint32_t computeCrc32Legacy(const uint8_t* buf, uint16_t len) {
   uint32_t crc = 0xFFFFFFFF; // Initial value
   const uint32_t poly = 0xEDB88320; // CRC-32 polynomial
 
@@ -70,6 +80,29 @@ uint32_t computeCrc32(const uint8_t* buf, uint16_t len) {
   return ~crc; // Return the final CRC value
 }
 
+// Whether the peer understands framing version 2, see SLINK_FLAGS_CRC32_CAPABLE
+static bool peerSpeaksCrc32 = false;
+
+static void setPeerSpeaksCrc32(bool crc32) {
+    if (crc32 != peerSpeaksCrc32)
+        LOG_INFO("Serial Module peer %s framing version 2, switching", crc32 ? "understands" : "doesn't understand");
+    peerSpeaksCrc32 = crc32;
+}
+
+// The CRC of a frame, with the algorithm of the framing version in its flags. Returns false for unknown versions.
+static bool computeFrameCrc(const meshtastic_serialPacket *sp, uint32_t *crc) {
+    switch (sp->header.flags & SLINK_FLAGS_VERSION_MASK) {
+    case SLINK_FLAGS_VERSION_1:
+        *crc = computeCrc32Legacy((const uint8_t *)sp, sp->header.size);
+        return true;
+    case SLINK_FLAGS_VERSION_2:
+        *crc = computeCrc32((const uint8_t *)sp, sp->header.size); // Standard CRC-32, from SerialLink
+        return true;
+    default:
+        return false;
+    }
+}
+
 
 
 void meshPacketToSerialPacket (const meshtastic_MeshPacket &mp, meshtastic_serialPacket *sp) {
@@ -91,10 +124,22 @@ void meshPacketToSerialPacket (const meshtastic_MeshPacket &mp, meshtastic_seria
     
     sp->header.hop_limit = mp.hop_limit & PACKET_FLAGS_HOP_LIMIT_MASK;
     sp->header.hop_start = mp.hop_start & PACKET_FLAGS_HOP_START_MASK;
-    sp->header.flags =
-        0x20 | (mp.want_ack ? PACKET_FLAGS_WANT_ACK_MASK : 0) | ((mp.which_payload_variant == meshtastic_MeshPacket_encrypted_tag) ? PACKET_FLAGS_ENCRYPTED_MASK : 0);
+    sp->header.flags = (peerSpeaksCrc32 ? SLINK_FLAGS_VERSION_2 : SLINK_FLAGS_VERSION_1) | SLINK_FLAGS_CRC32_CAPABLE;
+    sp->header.flags |=
+        (mp.want_ack ? PACKET_FLAGS_WANT_ACK_MASK : 0) | ((mp.which_payload_variant == meshtastic_MeshPacket_encrypted_tag) ? PACKET_FLAGS_ENCRYPTED_MASK : 0);
+#if SLINK_COBS
+    sp->header.flags |= SLINK_FLAGS_COBS_CAPABLE;
+#endif
+
+    uint32_t crc = 0;
+    computeFrameCrc(sp, &crc);
+    sp->header.crc = crc;
+}
 
-    sp->header.crc = computeCrc32((const uint8_t *)sp, sp->header.size);
+// Whether a payload of this length fits the mesh packet it will be copied into
+static bool isPayloadLenValid(bool encrypted, size_t payloadLen) {
+    size_t maxLen = encrypted ? member_size(meshtastic_MeshPacket, encrypted.bytes) : meshtastic_Constants_DATA_PAYLOAD_LEN;
+    return payloadLen <= maxLen;
 }
 
 void insertSerialPacketToMesh(meshtastic_serialPacket *sp) {
@@ -126,8 +171,9 @@ void insertSerialPacketToMesh(meshtastic_serialPacket *sp) {
               p->from, p->to, p->id);
 
     if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
-        memcpy(tmpbuf, p->decoded.payload.bytes, p->decoded.payload.size);
-        tmpbuf[p->decoded.payload.size+1]=0;
+        size_t size = std::min<size_t>(p->decoded.payload.size, sizeof(tmpbuf) - 1);
+        memcpy(tmpbuf, p->decoded.payload.bytes, size);
+        tmpbuf[size]=0;
         LOG_DEBUG("Serial Module RX packet of %d bytes, msg: %s", sp->header.size, tmpbuf);
     }
                     
@@ -151,17 +197,264 @@ bool checkIfValidPacket(meshtastic_serialPacket *sp) {
     }
     
     uint32_t received_crc = sp->header.crc;
+    uint32_t crc = 0;
     sp->header.crc = 0; // need to set to zero for computing CRC
-    if (computeCrc32((const uint8_t *)sp, sp->header.size) != received_crc) {
+    bool knownVersion = computeFrameCrc(sp, &crc);
+    sp->header.crc = received_crc; // restore
+    if (!knownVersion) {
+        LOG_DEBUG("SerialModule:: valid packet check fail, unknown framing version flags 0x%02x", sp->header.flags);
+        return false;
+    }
+    if (crc != received_crc) {
         LOG_DEBUG("SerialModule:: valid packet check fail, invalid crc");
-        sp->header.crc = received_crc; // restore
         return false;
     }
-    sp->header.crc = received_crc; // restore
     return true;
 }
 
-SerialModuleRadio::SerialModuleRadio() : MeshModule("SerialModuleRadio")
+// COBS framing. Both directions run on the main loop: receiving in SerialModule::readLink, batching in
+// SerialModuleRadio::onSend and sending in SerialModule::runOnce.
+#define SLINK_RECORD_HOP_START_SHIFT 5
+// flags, from, to, id, channel, hops, payload length. A compressed record and the batch flags take no more.
+#define SLINK_RECORD_MAX_HEADER (1 + 5 + 5 + 5 + 1 + 2 + 2)
+
+static bool peerSpeaksCobs = false;
+// Packet records batched up for the next frame, compressed ones go through the ARQ
+static uint8_t cobsTxBody[SLINK_ARQ_MAX_PAYLOAD];
+static size_t cobsTxBodyLen = 0;
+static bool cobsTxCompressed = false;
+static uint8_t cobsRxFrame[COBS_ENCODE_DST_BUF_LEN_MAX(SLINK_COBS_MAX_BODY)];
+static uint8_t cobsRxBody[SLINK_COBS_MAX_BODY];
+#if SLINK_ARQ
+static SerialLinkArq *linkArq;
+// Header compression state of both directions. The receiving one is only usable after a batch that starts it over.
+static SerialLinkContext txContext, rxContext;
+static bool txContextReset = true;
+static uint8_t txBatchesSinceReset = 0;
+static bool rxContextValid = false;
+#endif
+
+static void setPeerSpeaksCobs(bool cobs) {
+    if (cobs != peerSpeaksCobs)
+        LOG_INFO("Serial Module peer %s COBS framing, switching", cobs ? "understands" : "doesn't understand");
+    peerSpeaksCobs = cobs;
+#if SLINK_ARQ
+    if (!cobs && linkArq) {
+        linkArq->reset();
+        txContextReset = true;
+        rxContextValid = false;
+    }
+#endif
+}
+
+static void putVarint(uint8_t *buf, size_t &len, uint32_t v) {
+    while (v >= 0x80) {
+        buf[len++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    buf[len++] = v;
+}
+
+static bool getVarint(const uint8_t *buf, size_t len, size_t &pos, uint32_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos >= len)
+            return false;
+        uint8_t b = buf[pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Send the packets batched up since the last call as one COBS frame, compressed ones through the ARQ.
+// Returns false if the ARQ window is full, the batch is then kept for later.
+static bool flushCobsBatch() {
+    if (cobsTxBodyLen == 0)
+        return true;
+#if SLINK_ARQ
+    if (cobsTxCompressed) {
+        if (linkArq->peerSpeaksArq() && !linkArq->send(cobsTxBody, cobsTxBodyLen))
+            return false;
+        // A peer that stopped speaking ARQ can't decompress it anyway
+        cobsTxBodyLen = 0;
+        return true;
+    }
+#endif
+    const uint8_t magic = SLINK_COBS_MAGIC;
+    LOG_DEBUG("Serial Module TX COBS frame of %d bytes of packets", cobsTxBodyLen);
+    slinkWriteFrame(&Serial1, &magic, sizeof(magic), cobsTxBody, cobsTxBodyLen);
+    cobsTxBodyLen = 0;
+    return true;
+}
+
+// Add a packet to the COBS frame being batched up, sending that frame first if the packet doesn't fit anymore.
+// Records going through the ARQ have their header compressed.
+// Returns the size of the record, or 0 if it has to wait because the ARQ window is full.
+static size_t batchCobsRecord(const meshtastic_MeshPacket &mp) {
+    uint8_t flags = mp.want_ack ? SLINK_RECORD_WANT_ACK : 0;
+    const uint8_t *payload;
+    size_t payloadLen;
+    if (mp.which_payload_variant == meshtastic_MeshPacket_encrypted_tag) {
+        flags |= SLINK_RECORD_ENCRYPTED;
+        payload = mp.encrypted.bytes;
+        payloadLen = mp.encrypted.size;
+    } else {
+        payload = mp.decoded.payload.bytes;
+        payloadLen = mp.decoded.payload.size;
+    }
+    if (mp.to == NODENUM_BROADCAST)
+        flags |= SLINK_RECORD_BROADCAST;
+
+    bool compress = false;
+#if SLINK_ARQ
+    compress = linkArq->peerSpeaksArq();
+#endif
+    if ((cobsTxBodyLen + SLINK_RECORD_MAX_HEADER + payloadLen > sizeof(cobsTxBody) || compress != cobsTxCompressed) &&
+        !flushCobsBatch())
+        return 0;
+
+    size_t start = cobsTxBodyLen;
+#if SLINK_ARQ
+    if (compress) {
+        if (cobsTxBodyLen == 0) {
+            // Start over every so often too, so a receiver that lost track doesn't stay lost
+            bool reset = txContextReset || ++txBatchesSinceReset >= SLINK_CONTEXT_REFRESH;
+            if (reset) {
+                txContext.reset();
+                txContextReset = false;
+                txBatchesSinceReset = 0;
+            }
+            cobsTxBody[cobsTxBodyLen++] = reset ? SLINK_BATCH_CONTEXT_RESET : 0;
+        }
+        size_t flagsPos = cobsTxBodyLen++;
+        txContext.putNode(cobsTxBody, cobsTxBodyLen, mp.from);
+        if (txContext.putId(cobsTxBody, cobsTxBodyLen, mp.id))
+            flags |= SLINK_RECORD_ID_STEP;
+        if (!(flags & SLINK_RECORD_BROADCAST))
+            txContext.putNode(cobsTxBody, cobsTxBodyLen, mp.to);
+        cobsTxBody[flagsPos] = flags;
+    } else
+#endif
+    {
+        cobsTxBody[cobsTxBodyLen++] = flags;
+        putVarint(cobsTxBody, cobsTxBodyLen, mp.from);
+        if (!(flags & SLINK_RECORD_BROADCAST))
+            putVarint(cobsTxBody, cobsTxBodyLen, mp.to);
+        putVarint(cobsTxBody, cobsTxBodyLen, mp.id);
+    }
+    cobsTxCompressed = compress;
+    cobsTxBody[cobsTxBodyLen++] = mp.channel;
+    putVarint(cobsTxBody, cobsTxBodyLen,
+              ((mp.hop_start & PACKET_FLAGS_HOP_START_MASK) << SLINK_RECORD_HOP_START_SHIFT) |
+                  (mp.hop_limit & PACKET_FLAGS_HOP_LIMIT_MASK));
+    putVarint(cobsTxBody, cobsTxBodyLen, payloadLen);
+    memcpy(cobsTxBody + cobsTxBodyLen, payload, payloadLen);
+    cobsTxBodyLen += payloadLen;
+    return cobsTxBodyLen - start;
+}
+
+// Hand the packet records of a COBS frame to the mesh, decompressing their headers with context if there is one.
+// Returns false if a record was malformed.
+static bool insertCobsRecords(const uint8_t *records, size_t len, SerialLinkContext *context) {
+    size_t pos = 0;
+    while (pos < len) {
+        meshtastic_serialPacket sp;
+        uint8_t flags = records[pos++];
+        uint32_t from, to = NODENUM_BROADCAST, id, hops, payloadLen;
+        bool ok;
+        if (context) {
+            ok = context->getNode(records, len, pos, from) &&
+                 context->getId(records, len, pos, flags & SLINK_RECORD_ID_STEP, id) &&
+                 ((flags & SLINK_RECORD_BROADCAST) || context->getNode(records, len, pos, to));
+        } else {
+            ok = getVarint(records, len, pos, from) &&
+                 ((flags & SLINK_RECORD_BROADCAST) || getVarint(records, len, pos, to)) && getVarint(records, len, pos, id);
+        }
+        if (!ok || pos >= len) {
+            LOG_WARN("Serial Module RX malformed packet record in COBS frame");
+            return false;
+        }
+        sp.header.channel = records[pos++];
+        if (!getVarint(records, len, pos, hops) || !getVarint(records, len, pos, payloadLen) ||
+            !isPayloadLenValid(flags & SLINK_RECORD_ENCRYPTED, payloadLen) || payloadLen > len - pos) {
+            LOG_WARN("Serial Module RX malformed packet record in COBS frame");
+            return false;
+        }
+
+        sp.header.hbyte1 = headerByte1;
+        sp.header.hbyte2 = headerByte2;
+        sp.header.size = sizeof(SerialPacketHeader) + payloadLen;
+        sp.header.crc = 0;
+        sp.header.from = from;
+        sp.header.to = to;
+        sp.header.id = id;
+        sp.header.hop_limit = hops & PACKET_FLAGS_HOP_LIMIT_MASK;
+        sp.header.hop_start = (hops >> SLINK_RECORD_HOP_START_SHIFT) & PACKET_FLAGS_HOP_START_MASK;
+        sp.header.flags = ((flags & SLINK_RECORD_WANT_ACK) ? PACKET_FLAGS_WANT_ACK_MASK : 0) |
+                          ((flags & SLINK_RECORD_ENCRYPTED) ? PACKET_FLAGS_ENCRYPTED_MASK : 0);
+        memcpy(sp.payload, records + pos, payloadLen);
+        pos += payloadLen;
+        insertSerialPacketToMesh(&sp);
+    }
+    return true;
+}
+
+#if SLINK_ARQ
+// Hand a batch the ARQ delivered to the mesh. A NULL batch means some went missing, and with them context updates.
+static void insertArqBatch(const uint8_t *batch, size_t len) {
+    if (!batch) {
+        rxContextValid = false;
+        return;
+    }
+    if (len < 1)
+        return;
+    if (batch[0] & SLINK_BATCH_CONTEXT_RESET) {
+        rxContext.reset();
+        rxContextValid = true;
+    }
+    if (!rxContextValid) {
+        LOG_DEBUG("Serial Module RX dropping compressed batch, waiting for the peer to start its context over");
+        return;
+    }
+    if (!insertCobsRecords(batch + 1, len - 1, &rxContext))
+        rxContextValid = false;
+}
+#endif
+
+// Hand a received COBS frame (without its delimiters) to whoever handles its kind
+static void handleCobsFrame(const uint8_t *frame, size_t len, SerialModule::LinkStats &stats) {
+    int bodyLen = slinkDecodeFrame(frame, len, cobsRxBody, sizeof(cobsRxBody));
+    if (bodyLen == SLINK_FRAME_BAD_CRC) {
+        LOG_DEBUG("Serial Module RX COBS frame failed CRC");
+        stats.crcErrors++;
+        return;
+    }
+    if (bodyLen < 1) {
+        LOG_DEBUG("Serial Module RX bad COBS frame");
+        stats.framingErrors++;
+        return;
+    }
+
+    if (cobsRxBody[0] == SLINK_COBS_MAGIC) {
+        insertCobsRecords(cobsRxBody + 1, bodyLen - 1, NULL);
+#if SLINK_ARQ
+    } else if (cobsRxBody[0] == SLINK_ARQ_MAGIC && linkArq) {
+        linkArq->handleFrame(cobsRxBody, bodyLen);
+#endif
+    } else {
+        LOG_DEBUG("Serial Module RX COBS frame of unknown kind 0x%02x", cobsRxBody[0]);
+        stats.framingErrors++;
+        return;
+    }
+    stats.framesReceived++;
+    setPeerSpeaksCrc32(true);
+    setPeerSpeaksCobs(true);
+}
+
+SerialModuleRadio::SerialModuleRadio()
+    : MeshModule("SerialModuleRadio"), txQueue(SLINK_TX_QUEUE_SIZE), txHistory(SLINK_TX_HISTORY_SIZE)
 {
     ourPortNum = meshtastic_PortNum_SERIAL_APP;
     
@@ -203,23 +496,212 @@ int32_t SerialModule::runOnce()
         Serial1.begin(baud, SERIAL_8N1);
         Serial1.setTimeout(moduleConfig.serial.timeout > 0 ? moduleConfig.serial.timeout : TIMEOUT);
         serialModuleRadio = new SerialModuleRadio();
+#if SLINK_ARQ
+        linkArq = new SerialLinkArq(
+            &Serial1, insertArqBatch, random(1, 256), []() {
+                // The peer's context may be missing updates, drop what was compressed against it and start over
+                txContextReset = true;
+                if (cobsTxCompressed)
+                    cobsTxBodyLen = 0;
+            });
+#endif
         firstTime = 0;
     } else {
-            //stream.cpp/readBytes  arduinofruit library
-            while (Serial1.available()) {
-                serialPayloadSize = Serial1.readBytes((uint8_t *) &inPacket, sizeof(meshtastic_serialPacket));
-                 if (!checkIfValidPacket(&inPacket)) {
-                    LOG_DEBUG("Serial Module failed CRC on RX");
-                } else {
-                    // checks passed, pass this packet on
-                    LOG_DEBUG("Serial Module RX Insert packet to mesh");
-                    insertSerialPacketToMesh(&inPacket);
-                }
+        readLink();
+        int32_t txDelay = serialModuleRadio->sendQueued(getBaudRate());
+#if SLINK_ARQ
+        if (peerSpeaksCobs && !linkArq->peerSpeaksArq() &&
+            !Throttle::isWithinTimespanMs(lastArqProbeMsec, SLINK_ARQ_PROBE_INTERVAL)) {
+            lastArqProbeMsec = millis();
+            linkArq->probe();
+        }
+        txDelay = std::min(txDelay, linkArq->poll());
+#endif
+
+        if (!Throttle::isWithinTimespanMs(lastLinkStatsMsec, SLINK_STATS_INTERVAL)) {
+            lastLinkStatsMsec = millis();
+            const SerialModuleRadio::TxStats &tx = serialModuleRadio->getTxStats();
+            LOG_INFO("Serial Module link: %u frames, %u framing errors, %u CRC errors, %u resyncs", linkStats.framesReceived,
+                     linkStats.framingErrors, linkStats.crcErrors, linkStats.resyncs);
+            LOG_INFO("Serial Module link: %u sent, %u dropped, %u duplicates, queue %u/%u deep", tx.sent, tx.dropped,
+                     tx.duplicates, serialModuleRadio->getTxQueueDepth(), tx.maxDepth);
+#if SLINK_ARQ
+            if (linkArq->peerSpeaksArq()) {
+                const SerialLinkArq::Stats &arq = linkArq->getStats();
+                LOG_INFO("Serial Module link ARQ: RTT %u ms, RTO %u ms, %u frames, %u retransmitted, %u expired, %u duplicates",
+                         linkArq->getSrttMsec(), linkArq->getRtoMsec(), arq.framesSent, arq.retransmissions, arq.expired,
+                         arq.duplicates);
             }
+#endif
+            logLinkEvent();
+        } else if (peerSpeaksCobs != reportedCobs || isArqUp() != reportedArq) {
+            logLinkEvent();
         }
+
+        // Poll faster while a frame is coming in, so the UART buffer can't overflow
+        return std::min<int32_t>(txDelay, (linkRxPtr > 0 || (inCobsFrame && cobsRxPtr > 0)) ? 10 : 50);
+    }
     return (50);
 }
 
+bool SerialModule::isArqUp()
+{
+#if SLINK_ARQ
+    return linkArq->peerSpeaksArq();
+#else
+    return false;
+#endif
+}
+
+void SerialModule::logLinkEvent()
+{
+    reportedCobs = peerSpeaksCobs;
+    reportedArq = isArqUp();
+    if (!incidentLog)
+        return;
+
+    const SerialModuleRadio::TxStats &tx = serialModuleRadio->getTxStats();
+    IncidentLog::LinkStatus status = {"slink", reportedCobs, reportedArq, linkStats.framesReceived, linkStats.crcErrors,
+                                      tx.sent, tx.dropped, -1, 0, 0};
+#if SLINK_ARQ
+    if (reportedArq) {
+        const SerialLinkArq::Stats &arq = linkArq->getStats();
+        status.srttMsec = linkArq->getSrttMsec();
+        status.retransmissions = arq.retransmissions;
+        status.expired = arq.expired;
+    }
+#endif
+    incidentLog->logLink(status);
+}
+
+/*
+ Incremental frame parser, in the spirit of StreamAPI::handleRecStream.
+ Hunts for 0xAA 0x55, checks the length as soon as it arrives, then collects the rest of the frame and checks the CRC.
+ When a candidate frame is rejected its first byte is dropped and the bytes after it are searched again for a frame start,
+ so a single lost or corrupted byte costs at most the frame it hit instead of misaligning every frame after it.
+ While hunting, a 0x00 followed by a COBS code byte and SLINK_COBS_MAGIC or SLINK_ARQ_MAGIC starts a COBS frame
+ instead, which runs up to the next 0x00.
+*/
+void SerialModule::readLink()
+{
+    uint8_t *buf = (uint8_t *)&inPacket;
+    // Bytes of a rejected frame still to be parsed again: buf[replayPos..replayEnd)
+    uint16_t replayPos = 0, replayEnd = 0;
+
+    if (!Serial1.available() && !Throttle::isWithinTimespanMs(lastLinkRxMsec, SLINK_FRAME_TIMEOUT)) {
+        if (linkRxPtr > 0) {
+            LOG_DEBUG("Serial Module RX line idle after %u bytes of a frame", linkRxPtr);
+            linkStats.framingErrors++;
+            linkStats.resyncs++;
+            replayPos = 1;
+            replayEnd = linkRxPtr;
+            linkRxPtr = 0;
+        } else if (inCobsFrame && cobsRxPtr > 0) {
+            LOG_DEBUG("Serial Module RX line idle after %u bytes of a COBS frame", cobsRxPtr);
+            linkStats.framingErrors++;
+            inCobsFrame = false;
+        }
+    }
+
+    while (replayPos < replayEnd || Serial1.available()) {
+        uint8_t c;
+        if (replayPos < replayEnd) {
+            c = buf[replayPos++];
+        } else {
+            int r = Serial1.read();
+            if (r < 0)
+                break;
+            c = r;
+            lastLinkRxMsec = millis();
+        }
+
+        bool rejected;
+        if (inCobsFrame) {
+            if (c == 0) {
+                // A 0x00 right after the opening one means the previous frame lost its closing one, this one starts here
+                if (cobsRxPtr > 0) {
+                    handleCobsFrame(cobsRxFrame, cobsRxPtr, linkStats);
+                    inCobsFrame = false;
+                }
+                continue;
+            }
+            if (cobsRxPtr == sizeof(cobsRxFrame)) {
+                LOG_DEBUG("Serial Module RX COBS frame too long");
+                linkStats.framingErrors++;
+                inCobsFrame = false;
+                continue;
+            }
+            cobsRxFrame[cobsRxPtr++] = c;
+            if (cobsRxPtr < 2 || cobsRxFrame[1] == SLINK_COBS_MAGIC || cobsRxFrame[1] == SLINK_ARQ_MAGIC)
+                continue;
+
+            // Just a stray 0x00, look for a fixed header frame in the bytes after it. The first can't complete a frame.
+            inCobsFrame = false;
+            parseFixedHeaderByte(cobsRxFrame[0]);
+            rejected = parseFixedHeaderByte(c);
+        } else if (linkRxPtr == 0 && c == 0) {
+            inCobsFrame = true;
+            cobsRxPtr = 0;
+            continue;
+        } else {
+            rejected = parseFixedHeaderByte(c);
+        }
+
+        if (rejected) {
+            // Drop the first byte and search everything after it, including what was still waiting to be replayed
+            uint16_t pending = replayEnd - replayPos;
+            memmove(buf + linkRxPtr, buf + replayPos, pending);
+            replayPos = 1;
+            replayEnd = linkRxPtr + pending;
+            linkRxPtr = 0;
+            linkStats.resyncs++;
+        }
+    }
+}
+
+/*
+ Add one byte to the fixed header frame being received, handing the frame to the mesh when it's complete.
+ Returns true if the frame turned out to be bad, linkRxPtr is then left at the number of bytes it had.
+ While replaying, linkRxPtr is always behind the replay position, so this never overwrites a byte still to be parsed.
+*/
+bool SerialModule::parseFixedHeaderByte(uint8_t c)
+{
+    uint8_t *buf = (uint8_t *)&inPacket;
+    buf[linkRxPtr++] = c;
+
+    if (linkRxPtr == 1) {
+        if (c != headerByte1)
+            linkRxPtr = 0;
+    } else if (linkRxPtr == 2) {
+        if (c != headerByte2)
+            linkRxPtr = (c == headerByte1) ? 1 : 0;
+    } else if (linkRxPtr == offsetof(SerialPacketHeader, size) + sizeof(inPacket.header.size)) {
+        if (inPacket.header.size < sizeof(SerialPacketHeader) || inPacket.header.size > sizeof(meshtastic_serialPacket)) {
+            LOG_DEBUG("Serial Module RX bad frame length %u", inPacket.header.size);
+            linkStats.framingErrors++;
+            return true;
+        }
+    } else if (linkRxPtr >= sizeof(SerialPacketHeader) && linkRxPtr == inPacket.header.size) {
+        if (!checkIfValidPacket(&inPacket)) {
+            linkStats.crcErrors++;
+            return true;
+        }
+        if (!isPayloadLenValid(inPacket.header.flags & PACKET_FLAGS_ENCRYPTED_MASK,
+                               inPacket.header.size - sizeof(SerialPacketHeader))) {
+            LOG_DEBUG("Serial Module RX payload too long, frame length %u", inPacket.header.size);
+            linkStats.framingErrors++;
+            return true;
+        }
+        linkStats.framesReceived++;
+        setPeerSpeaksCrc32((inPacket.header.flags & SLINK_FLAGS_CRC32_CAPABLE) ||
+                           (inPacket.header.flags & SLINK_FLAGS_VERSION_MASK) == SLINK_FLAGS_VERSION_2);
+        setPeerSpeaksCobs(SLINK_COBS && (inPacket.header.flags & SLINK_FLAGS_COBS_CAPABLE));
+        insertSerialPacketToMesh(&inPacket);
+        linkRxPtr = 0;
+    }
+    return false;
+}
+
 bool SerialModule::isValidConfig(const meshtastic_ModuleConfig_SerialConfig &config)
 {
     return true;
@@ -267,21 +749,78 @@ void SerialModuleRadio::onSend(const meshtastic_MeshPacket &mp) {
 
     if (mp.via_slink) {
         LOG_DEBUG("Serial Module Onsend TX - ignoring packet that came from slink");
+        txStats.duplicates++;
+        return;
     }
-    
+    // Only packets actually written go into txHistory, so one that got dropped here can still go out when it comes again
+    bool wasUpgraded = false;
+    if ((txHistory.wasSeenRecently(&mp, false, nullptr, nullptr, &wasUpgraded) && !wasUpgraded) ||
+        txQueue.find(getFrom(&mp), mp.id)) {
+        LOG_DEBUG("Serial Module Onsend TX - ignoring packet 0x%0x that is queued or already went over the link", mp.id);
+        txStats.duplicates++;
+        return;
+    }
+
     LOG_DEBUG("Serial Module Onsend TX   from=0x%0x, to=0x%0x, packet_id=0x%0x",
               mp.from, mp.to, mp.id);
-    meshPacketToSerialPacket(mp, &outPacket);
-    // debug check
-    if (!checkIfValidPacket(&outPacket)) {
-        LOG_DEBUG("Serial Module failed CRC on TX");
-    } else {
-        if (Serial1.availableForWrite()) {
-            LOG_DEBUG("Serial Module onSend TX packet of %d bytes", outPacket.header.size);
-            Serial1.write((uint8_t *) &outPacket, outPacket.header.size);
-        }
+    meshtastic_MeshPacket *p = packetPool.allocCopy(mp);
+    if (!p) {
+        txStats.dropped++;
+        return;
     }
+    bool dropped = false;
+    if (!txQueue.enqueue(p, &dropped)) {
+        packetPool.release(p);
+        txStats.dropped++;
+    } else if (dropped) {
+        txStats.dropped++; // A lower priority packet made room for this one
+    }
+    txStats.maxDepth = std::max<uint16_t>(txStats.maxDepth, getTxQueueDepth());
+
+    // Everything the router sends before the serial thread runs goes out together
+    serialModule->wakeForTx();
+}
 
+int32_t SerialModuleRadio::sendQueued(uint32_t baud) {
+    // 10 bits per byte on the wire with 8N1. Allow a burst of up to two full frames to fill the UART buffer.
+    uint32_t now = millis();
+    int32_t maxCredit = 2 * sizeof(meshtastic_serialPacket);
+    txCredit = std::min<int32_t>(maxCredit, txCredit + (int64_t)(now - lastTxCreditMsec) * baud / 10000);
+    lastTxCreditMsec = now;
+
+    bool windowFull = false;
+    while (txCredit > 0 && Serial1.availableForWrite()) {
+        meshtastic_MeshPacket *p = txQueue.getFront();
+        if (!p)
+            break;
+#if SLINK_COBS
+        if (peerSpeaksCobs) {
+            size_t recordLen = batchCobsRecord(*p);
+            if (!recordLen) {
+                windowFull = true;
+                break;
+            }
+            txCredit -= recordLen;
+        } else
+#endif
+        {
+            meshPacketToSerialPacket(*p, &outPacket);
+            LOG_DEBUG("Serial Module TX packet of %d bytes", outPacket.header.size);
+            Serial1.write((uint8_t *)&outPacket, outPacket.header.size);
+            txCredit -= outPacket.header.size;
+        }
+        txHistory.wasSeenRecently(p, true);
+        packetPool.release(txQueue.dequeue());
+        txStats.sent++;
+    }
+    if (!flushCobsBatch())
+        windowFull = true;
+
+    if (windowFull)
+        return 10; // Until the ACKs that make room come in
+    if (txQueue.empty())
+        return INT32_MAX;
+    return txCredit > 0 ? 1 : 1 + (-txCredit) * 10000 / (int32_t)baud;
 }
 
 /**
@@ -3,7 +3,10 @@
 #if defined(FLAMINGO) && defined(FLAMINGO_SLINK)
 
 #include "MeshModule.h"
+#include "MeshPacketQueue.h"
+#include "PacketHistory.h"
 #include "Router.h"
+#include "SerialLink.h"
 #include "SinglePortModule.h"
 #include "concurrency/OSThread.h"
 #include "configuration.h"
@@ -39,6 +42,58 @@ typedef struct _SerialPacketHeader{
 } SerialPacketHeader;
 
 
+/**
+ * Framing version, carried in bits 5 and 6 of the header flags so the receiver knows which CRC the sender used.
+ * Version 1 used a bit-serial, nonstandard CRC. Version 2 uses the standard CRC-32 (IEEE 802.3).
+ *
+ * Older firmware only understands version 1, so it is negotiated per link: a node that understands version 2 sets
+ * SLINK_FLAGS_CRC32_CAPABLE in every fixed header frame, but sends version 1 until it hears that flag, a version 2 frame or
+ * a COBS frame from its peer. A fixed header frame with none of them switches it back. Every node accepts both versions.
+ **/
+#define SLINK_FLAGS_VERSION_MASK 0x60
+#define SLINK_FLAGS_VERSION_1 0x20
+#define SLINK_FLAGS_VERSION_2 0x40
+#define SLINK_FLAGS_CRC32_CAPABLE 0x01
+
+/**
+ * COBS framing, negotiated per link so nodes with older firmware keep working.
+ *
+ * A node that understands it sets SLINK_FLAGS_COBS_CAPABLE in the fixed header frames it sends. Once a node hears that flag,
+ * or any valid COBS frame, from its peer it sends COBS frames only; a fixed header frame without the flag switches it back.
+ * Every node always accepts both kinds of frames.
+ *
+ * A COBS frame (see SerialLink.h) carries all the packets that were ready to go in the same tick: its body is
+ * SLINK_COBS_MAGIC followed by one or more packet records. A packet record is flags (SLINK_RECORD_*), varint from,
+ * varint to (left out for broadcasts), varint id, channel, varint (hop_start << 5 | hop_limit), varint payload length and
+ * the payload.
+ *
+ * Over COBS framing the packet records can also go through SerialLinkArq, which acknowledges and retransmits them. Nodes
+ * built with it probe their peer every SLINK_ARQ_PROBE_INTERVAL until it answers, and only then use it. Build with
+ * SLINK_ARQ=0 to leave it out.
+ *
+ * Since the ARQ delivers in order, the records going through it have their headers compressed against a SerialLinkContext
+ * per direction: from, the id and to (left out for broadcasts) are coded by the context instead of as varints, with
+ * SLINK_RECORD_ID_STEP set when the id went out as a step. Each ARQ payload starts with batch flags, where
+ * SLINK_BATCH_CONTEXT_RESET says the sender started its context over for this batch. The sender does that after anything
+ * it sent went missing, and every SLINK_CONTEXT_REFRESH batches. A receiver that missed something drops batches until the
+ * next one with that flag.
+ **/
+#define SLINK_FLAGS_COBS_CAPABLE 0x80
+#ifndef SLINK_COBS
+#define SLINK_COBS 1
+#endif
+#define SLINK_COBS_MAGIC 0xC5
+#ifndef SLINK_ARQ
+#define SLINK_ARQ SLINK_COBS
+#endif
+
+#define SLINK_RECORD_WANT_ACK 0x01
+#define SLINK_RECORD_ENCRYPTED 0x02
+#define SLINK_RECORD_BROADCAST 0x04
+#define SLINK_RECORD_ID_STEP 0x08
+
+#define SLINK_BATCH_CONTEXT_RESET 0x01
+
 typedef struct _meshtastic_serialPacket{
     SerialPacketHeader header;
     uint8_t payload[256];    // 256 is max payload size
@@ -53,9 +108,22 @@ class SerialModule : public StreamAPI, private concurrency::OSThread
     char outbuf[90] = "";
 
   public:
+    /// Receive counters of the serial link
+    struct LinkStats {
+        uint32_t framesReceived; // Frames that passed all checks and were handed to the router
+        uint32_t framingErrors;  // Candidate frames with an impossible length, or cut short by the line going idle
+        uint32_t crcErrors;      // Candidate frames with a bad CRC or an unknown framing version
+        uint32_t resyncs;        // Times the parser went back to hunting for 0xAA 0x55 in bytes it already had
+    };
+
     SerialModule();
     static bool isValidConfig(const meshtastic_ModuleConfig_SerialConfig &config);
 
+    const LinkStats &getLinkStats() const { return linkStats; }
+
+    /// Run soon to send what SerialModuleRadio just queued
+    void wakeForTx() { setIntervalFromNow(0); }
+
   protected:
     virtual int32_t runOnce() override;
 
@@ -64,7 +132,27 @@ class SerialModule : public StreamAPI, private concurrency::OSThread
    
   private:
     uint32_t getBaudRate();
-    
+
+    /// @return true while the peer speaks ARQ
+    bool isArqUp();
+    /// Report the link state and stats as an incident log event
+    void logLinkEvent();
+
+    /// Feed whatever bytes the link has to the frame parser, without blocking
+    void readLink();
+    bool parseFixedHeaderByte(uint8_t c);
+
+    // Bytes of the fixed header frame being received so far
+    uint16_t linkRxPtr = 0;
+    // Set after the 0x00 that starts a COBS frame, with the encoded bytes received so far
+    bool inCobsFrame = false;
+    uint16_t cobsRxPtr = 0;
+    uint32_t lastLinkRxMsec = 0;
+    uint32_t lastLinkStatsMsec = 0;
+    // Link state in the last incident log event
+    bool reportedCobs = false, reportedArq = false;
+    uint32_t lastArqProbeMsec = 0;
+    LinkStats linkStats = {};
 };
 
 extern SerialModule *serialModule;
@@ -76,14 +164,37 @@ extern SerialModule *serialModule;
 class SerialModuleRadio : public MeshModule
 {
     uint32_t lastRxID = 0;
-   
 
+    // Packets waiting for the serial thread, highest priority first
+    MeshPacketQueue txQueue;
+    // Packets that already went over the link
+    PacketHistory txHistory;
+    // Bytes the line can take right now, refilled at the baud rate
+    int32_t txCredit = 0;
+    uint32_t lastTxCreditMsec = 0;
 
   public:
+    /// Transmit counters of the serial link
+    struct TxStats {
+        uint32_t sent;       // Packets written to the link
+        uint32_t dropped;    // Packets lost to a full queue, or because there was no packet buffer to copy them into
+        uint32_t duplicates; // Packets not sent because they came from the link, are queued or already went over it
+        uint16_t maxDepth;   // Most packets the queue has held
+    };
+
     SerialModuleRadio();
+
+    /// Queue a packet for the link, never blocks
     void onSend(const meshtastic_MeshPacket &mp);
-    
 
+    /**
+     * Called from the serial thread: write queued packets for as long as the line keeps up.
+     * @return msecs until the line can take the next one, or INT32_MAX when the queue is empty
+     */
+    int32_t sendQueued(uint32_t baud);
+
+    const TxStats &getTxStats() const { return txStats; }
+    size_t getTxQueueDepth() { return txQueue.getMaxLen() - txQueue.getFree(); }
 
   protected:
     virtual meshtastic_MeshPacket *allocReply() override;
@@ -108,6 +219,9 @@ class SerialModuleRadio : public MeshModule
 
         return p;
     }
+
+  private:
+    TxStats txStats = {};
 };
 
 extern SerialModuleRadio *serialModuleRadio;
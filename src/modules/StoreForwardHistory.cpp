@@ -0,0 +1,586 @@
+#include "StoreForwardHistory.h"
+#include "SPILock.h"
+#include "SafeFile.h"
+#include "mesh/compression/unishox2.h"
+#include <ErriezCRC32.h>
+#include <algorithm>
+
+#define SF_LOG_SEGMENT_MAGIC 0x31474553 // "SEG1"
+#define SF_LOG_INDEX_MAGIC 0x31584449   // "IDX1"
+#define SF_LOG_SEGMENT_HEADER_LEN 8     // Magic, first sequence number
+#define SF_LOG_RECORD_HEADER_LEN 8      // Body length, its complement, CRC-32 of the body
+// Body: seq, time, to, from, id, reply_id, rx_rssi, rx_snr, then one byte each for channel, hop_start, hop_limit, flags,
+// transport_mechanism and payload_size, then the payload
+#define SF_LOG_BODY_FIXED_LEN 38
+// A segment this small isn't worth keeping a log in
+#define SF_LOG_MIN_SEGMENT_BYTES 1024
+
+static_assert(SF_LOG_RECORD_HEADER_LEN + SF_LOG_BODY_FIXED_LEN + meshtastic_Constants_DATA_PAYLOAD_LEN <= SF_LOG_MAX_RECORD,
+              "SF_LOG_MAX_RECORD too small");
+
+template <typename T> static void putField(uint8_t *&p, T v)
+{
+    memcpy(p, &v, sizeof(v));
+    p += sizeof(v);
+}
+
+template <typename T> static T getField(const uint8_t *&p)
+{
+    T v;
+    memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return v;
+}
+
+size_t StoreForwardHistory::encodeRecord(uint32_t seq, const PacketHistoryStruct &r, uint8_t *buf)
+{
+    uint8_t *body = buf + SF_LOG_RECORD_HEADER_LEN;
+    uint8_t *p = body;
+    putField(p, seq);
+    putField(p, r.time);
+    putField(p, r.to);
+    putField(p, r.from);
+    putField(p, r.id);
+    putField(p, r.reply_id);
+    putField(p, r.rx_rssi);
+    putField(p, r.rx_snr);
+    putField(p, r.channel);
+    putField(p, r.hop_start);
+    putField(p, r.hop_limit);
+    putField(p, (uint8_t)((r.emoji ? SF_HISTORY_FLAG_EMOJI : 0) | (r.via_mqtt ? SF_HISTORY_FLAG_VIA_MQTT : 0)));
+    putField(p, r.transport_mechanism);
+    uint8_t payloadSize = std::min<pb_size_t>(r.payload_size, meshtastic_Constants_DATA_PAYLOAD_LEN);
+    putField(p, payloadSize);
+    memcpy(p, r.payload, payloadSize);
+    p += payloadSize;
+
+    uint16_t bodyLen = p - body;
+    uint8_t *h = buf;
+    putField(h, bodyLen);
+    putField(h, (uint16_t)~bodyLen);
+    putField(h, crc32Buffer(body, bodyLen));
+    return SF_LOG_RECORD_HEADER_LEN + bodyLen;
+}
+
+size_t StoreForwardHistory::decodeRecord(const uint8_t *buf, size_t len, uint32_t &seq, PacketHistoryStruct &r)
+{
+    if (len < SF_LOG_RECORD_HEADER_LEN)
+        return 0;
+    const uint8_t *h = buf;
+    uint16_t bodyLen = getField<uint16_t>(h);
+    uint16_t check = getField<uint16_t>(h);
+    uint32_t crc = getField<uint32_t>(h);
+    if (check != (uint16_t)~bodyLen || bodyLen < SF_LOG_BODY_FIXED_LEN || (size_t)SF_LOG_RECORD_HEADER_LEN + bodyLen > len)
+        return 0;
+    const uint8_t *p = buf + SF_LOG_RECORD_HEADER_LEN;
+    if (crc32Buffer(p, bodyLen) != crc)
+        return 0;
+
+    memset(&r, 0, sizeof(r));
+    seq = getField<uint32_t>(p);
+    r.time = getField<uint32_t>(p);
+    r.to = getField<uint32_t>(p);
+    r.from = getField<uint32_t>(p);
+    r.id = getField<uint32_t>(p);
+    r.reply_id = getField<uint32_t>(p);
+    r.rx_rssi = getField<int32_t>(p);
+    r.rx_snr = getField<float>(p);
+    r.channel = getField<uint8_t>(p);
+    r.hop_start = getField<uint8_t>(p);
+    r.hop_limit = getField<uint8_t>(p);
+    uint8_t flags = getField<uint8_t>(p);
+    r.emoji = flags & SF_HISTORY_FLAG_EMOJI;
+    r.via_mqtt = flags & SF_HISTORY_FLAG_VIA_MQTT;
+    r.transport_mechanism = getField<uint8_t>(p);
+    r.payload_size = getField<uint8_t>(p);
+    if (r.payload_size > meshtastic_Constants_DATA_PAYLOAD_LEN || SF_LOG_BODY_FIXED_LEN + r.payload_size != bodyLen)
+        return 0;
+    memcpy(r.payload, p, r.payload_size);
+    return SF_LOG_RECORD_HEADER_LEN + bodyLen;
+}
+
+StoreForwardHistory::~StoreForwardHistory()
+{
+    free(slots);
+}
+
+bool StoreForwardHistory::init(uint32_t bytes, uint32_t maxRecords, const char *dir, uint32_t segmentBytes)
+{
+    if (!maxRecords)
+        maxRecords = bytes / (SF_HISTORY_TYPICAL_RECORD + sizeof(Slot));
+    if (!maxRecords || bytes < maxRecords * sizeof(Slot) + SF_HISTORY_MAX_RECORD)
+        return false;
+#if defined(ARCH_ESP32)
+    slots = static_cast<Slot *>(ps_calloc(bytes, 1));
+#else
+    slots = static_cast<Slot *>(calloc(bytes, 1));
+#endif
+    if (!slots)
+        return false;
+    arena = reinterpret_cast<uint8_t *>(slots + maxRecords);
+    this->maxRecords = maxRecords;
+    arenaBytes = bytes - maxRecords * sizeof(Slot);
+
+#ifdef FSCom
+    if (!dir)
+        return true;
+    this->dir = dir;
+    this->segmentBytes = segmentBytes;
+    {
+        concurrency::LockGuard g(spiLock);
+        FSCom.mkdir(dir);
+    }
+    if (!loadIndex())
+        rebuildIndex();
+
+    // The index is only saved when segments come and go, so what the open one holds comes from the file
+    bool torn = false;
+    if (usedSlots && !readSegment(getOpenSlot(), segments[getOpenSlot()], true, UINT32_MAX, &torn)) {
+        rebuildIndex();
+        torn = false;
+    }
+
+#ifdef ARCH_ESP32
+    // Leave at least half the free space to everything else
+    uint32_t logBytes = 0;
+    for (uint8_t i = 0; i < usedSlots; i++)
+        logBytes += segments[(oldestSlot + i) % SF_LOG_SEGMENTS].bytes;
+    uint32_t budget = (FSCom.totalBytes() - FSCom.usedBytes()) / 2 + logBytes;
+    this->segmentBytes = std::min<uint32_t>(segmentBytes, budget / SF_LOG_SEGMENTS);
+#endif
+    if (this->segmentBytes < SF_LOG_MIN_SEGMENT_BYTES) {
+        LOG_WARN("S&F - Not enough room on the filesystem, history won't survive a reboot");
+        this->dir = nullptr;
+        return true;
+    }
+
+    replay();
+    if (torn) {
+        LOG_WARN("S&F - Log ended in a partly written record, carrying on in a new segment");
+        startSegment(nextSeq);
+    }
+    LOG_INFO("S&F - Loaded %u of %u logged messages from %u segment(s)", getCount(), nextSeq - segments[oldestSlot].firstSeq,
+             usedSlots);
+#endif
+    return true;
+}
+
+#if SF_HISTORY_COMPRESS
+/// Compress a payload, if that makes it smaller and it decompresses to the same. @return the compressed length, 0 if not
+static uint8_t compressPayload(const uint8_t *in, uint8_t len, char *out)
+{
+    if (len < 2)
+        return 0;
+    // With room for one byte less than the input, anything that wouldn't be smaller comes back as len
+    int packedLen = unishox2_compress((const char *)in, len, out, len - 1, USX_PSET_DFLT);
+    if (packedLen <= 0 || packedLen >= len)
+        return 0;
+    char check[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    if (unishox2_decompress(out, packedLen, check, sizeof(check), USX_PSET_DFLT) != len || memcmp(check, in, len) != 0)
+        return 0;
+    return packedLen;
+}
+#endif
+
+bool StoreForwardHistory::isFree(uint32_t off, uint32_t len) const
+{
+    if (firstSeq == nextSeq)
+        return true;
+    if (head < tail) // Held from head to tail
+        return off >= tail || off + len <= head;
+    // Held from head to the end of the arena, then from the start to tail
+    return off >= tail && off + len <= head;
+}
+
+void StoreForwardHistory::dropOldest()
+{
+    // The oldest message is always the first on its list
+    auto it = lists.find(getHeader(firstSeq)->to);
+    if (it->second.last == firstSeq)
+        lists.erase(it);
+    else
+        it->second.first = slots[firstSeq % maxRecords].nextTo;
+
+    if (++firstSeq == nextSeq)
+        head = tail = 0;
+    else
+        head = slots[firstSeq % maxRecords].offset;
+}
+
+void StoreForwardHistory::hold(uint32_t seq, const PacketHistoryStruct &r)
+{
+    if (seq != nextSeq) { // Only after a gap in the log
+        firstSeq = nextSeq = seq;
+        head = tail = 0;
+        lists.clear();
+    }
+
+    PacketHistoryHeader h;
+    h.time = r.time;
+    h.to = r.to;
+    h.from = r.from;
+    h.id = r.id;
+    h.reply_id = r.reply_id;
+    h.rx_snr = r.rx_snr;
+    h.rx_rssi = r.rx_rssi;
+    h.channel = r.channel;
+    h.hop_start = r.hop_start;
+    h.hop_limit = r.hop_limit;
+    h.transport_mechanism = r.transport_mechanism;
+    h.flags = (r.emoji ? SF_HISTORY_FLAG_EMOJI : 0) | (r.via_mqtt ? SF_HISTORY_FLAG_VIA_MQTT : 0);
+    h.size = std::min<pb_size_t>(r.payload_size, meshtastic_Constants_DATA_PAYLOAD_LEN);
+    const uint8_t *payload = r.payload;
+#if SF_HISTORY_COMPRESS
+    char packed[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    if (uint8_t packedLen = compressPayload(r.payload, h.size, packed)) {
+        h.flags |= SF_HISTORY_FLAG_COMPRESSED;
+        h.size = packedLen;
+        payload = reinterpret_cast<const uint8_t *>(packed);
+    }
+#endif
+
+    // A message is never split: one that doesn't fit before the end of the arena goes at the start
+    uint32_t len = sizeof(h) + h.size;
+    if (getCount() == maxRecords)
+        dropOldest();
+    uint32_t off;
+    for (;;) {
+        off = (tail + len <= arenaBytes) ? tail : 0;
+        if (isFree(off, len))
+            break;
+        dropOldest();
+    }
+    memcpy(arena + off, &h, sizeof(h));
+    memcpy(arena + off + sizeof(h), payload, h.size);
+    slots[seq % maxRecords] = {off, SF_NO_SEQ};
+    if (firstSeq == nextSeq)
+        head = off;
+    tail = off + len;
+    nextSeq = seq + 1;
+
+    auto it = lists.find(r.to);
+    if (it == lists.end()) {
+        lists.emplace(r.to, List{seq, seq});
+    } else {
+        slots[it->second.last % maxRecords].nextTo = seq;
+        it->second.last = seq;
+    }
+}
+
+uint32_t StoreForwardHistory::add(const PacketHistoryStruct &r)
+{
+    if (!maxRecords)
+        return nextSeq;
+    uint32_t seq = nextSeq;
+    hold(seq, r);
+#ifdef FSCom
+    if (dir)
+        append(seq, r);
+#endif
+    return seq;
+}
+
+const PacketHistoryHeader *StoreForwardHistory::getHeader(uint32_t seq) const
+{
+    if (seq - firstSeq >= nextSeq - firstSeq)
+        return nullptr;
+    return reinterpret_cast<const PacketHistoryHeader *>(arena + slots[seq % maxRecords].offset);
+}
+
+uint32_t StoreForwardHistory::getFirstTo(uint32_t to) const
+{
+    auto it = lists.find(to);
+    return it == lists.end() ? SF_NO_SEQ : it->second.first;
+}
+
+bool StoreForwardHistory::get(uint32_t seq, PacketHistoryStruct &r) const
+{
+    const PacketHistoryHeader *h = getHeader(seq);
+    if (!h)
+        return false;
+    memset(&r, 0, sizeof(r));
+    r.time = h->time;
+    r.to = h->to;
+    r.from = h->from;
+    r.id = h->id;
+    r.reply_id = h->reply_id;
+    r.rx_snr = h->rx_snr;
+    r.rx_rssi = h->rx_rssi;
+    r.channel = h->channel;
+    r.hop_start = h->hop_start;
+    r.hop_limit = h->hop_limit;
+    r.transport_mechanism = h->transport_mechanism;
+    r.emoji = h->flags & SF_HISTORY_FLAG_EMOJI;
+    r.via_mqtt = h->flags & SF_HISTORY_FLAG_VIA_MQTT;
+
+    const uint8_t *payload = reinterpret_cast<const uint8_t *>(h + 1);
+    if (h->flags & SF_HISTORY_FLAG_COMPRESSED) {
+        int len = unishox2_decompress((const char *)payload, h->size, (char *)r.payload, sizeof(r.payload), USX_PSET_DFLT);
+        r.payload_size = (len > 0 && len <= (int)sizeof(r.payload)) ? len : 0;
+    } else {
+        memcpy(r.payload, payload, h->size);
+        r.payload_size = h->size;
+    }
+    return true;
+}
+
+uint32_t StoreForwardHistory::getUsedBytes() const
+{
+    if (firstSeq == nextSeq)
+        return 0;
+    return head < tail ? tail - head : arenaBytes - head + tail;
+}
+
+#ifdef FSCom
+
+struct IndexFile {
+    uint32_t magic;
+    uint8_t oldestSlot;
+    uint8_t usedSlots;
+    uint16_t unused;
+};
+
+void StoreForwardHistory::getSegmentPath(uint8_t slot, char *path, size_t size) const
+{
+    snprintf(path, size, "%s/%u", dir, slot);
+}
+
+bool StoreForwardHistory::loadIndex()
+{
+    char path[32];
+    snprintf(path, sizeof(path), "%s/index", dir);
+    IndexFile header;
+    uint32_t crc;
+    bool ok;
+    {
+        concurrency::LockGuard g(spiLock);
+        File f = FSCom.open(path, FILE_O_READ);
+        ok = f && f.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+             f.read((uint8_t *)segments, sizeof(segments)) == sizeof(segments) &&
+             f.read((uint8_t *)&crc, sizeof(crc)) == sizeof(crc);
+        if (f)
+            f.close();
+    }
+    if (!ok || header.magic != SF_LOG_INDEX_MAGIC || header.oldestSlot >= SF_LOG_SEGMENTS ||
+        header.usedSlots > SF_LOG_SEGMENTS ||
+        crc != (crc32Buffer(segments, sizeof(segments)) ^ crc32Buffer(&header, sizeof(header)))) {
+        memset(segments, 0, sizeof(segments));
+        return false;
+    }
+    oldestSlot = header.oldestSlot;
+    usedSlots = header.usedSlots;
+
+    // Cheap check that the index and the files still agree
+    for (uint8_t i = 0; i + 1 < usedSlots; i++) {
+        uint8_t slot = (oldestSlot + i) % SF_LOG_SEGMENTS;
+        Segment s;
+        if (!readSegment(slot, s, false) || s.firstSeq != segments[slot].firstSeq) {
+            LOG_WARN("S&F - Log index doesn't match segment %u", slot);
+            return false;
+        }
+    }
+    return true;
+}
+
+void StoreForwardHistory::saveIndex()
+{
+    char path[32];
+    snprintf(path, sizeof(path), "%s/index", dir);
+    IndexFile header = {SF_LOG_INDEX_MAGIC, oldestSlot, usedSlots, 0};
+    uint32_t crc = crc32Buffer(segments, sizeof(segments)) ^ crc32Buffer(&header, sizeof(header));
+    auto f = SafeFile(path, true);
+    f.write((const uint8_t *)&header, sizeof(header));
+    f.write((const uint8_t *)segments, sizeof(segments));
+    f.write((const uint8_t *)&crc, sizeof(crc));
+    if (!f.close())
+        LOG_ERROR("S&F - Can't save log index %s", path);
+}
+
+bool StoreForwardHistory::readSegment(uint8_t slot, Segment &s, bool scan, uint32_t holdFrom, bool *torn)
+{
+    char path[32];
+    getSegmentPath(slot, path, sizeof(path));
+    concurrency::LockGuard g(spiLock);
+    File f = FSCom.open(path, FILE_O_READ);
+    if (!f)
+        return false;
+    uint32_t header[2];
+    if (f.read((uint8_t *)header, sizeof(header)) != sizeof(header) || header[0] != SF_LOG_SEGMENT_MAGIC) {
+        f.close();
+        return false;
+    }
+    s.firstSeq = header[1];
+    if (!scan) {
+        f.close();
+        return true;
+    }
+
+    s.count = 0;
+    s.bytes = SF_LOG_SEGMENT_HEADER_LEN;
+    uint32_t size = f.size();
+    uint8_t buf[SF_LOG_MAX_RECORD];
+    PacketHistoryStruct r;
+    while (s.bytes + SF_LOG_RECORD_HEADER_LEN <= size) {
+        if (f.read(buf, SF_LOG_RECORD_HEADER_LEN) != SF_LOG_RECORD_HEADER_LEN)
+            break;
+        uint16_t bodyLen;
+        memcpy(&bodyLen, buf, sizeof(bodyLen));
+        size_t len = SF_LOG_RECORD_HEADER_LEN + bodyLen;
+        if (len > sizeof(buf) || f.read(buf + SF_LOG_RECORD_HEADER_LEN, bodyLen) != bodyLen)
+            break;
+        uint32_t seq;
+        if (!decodeRecord(buf, len, seq, r) || seq != s.firstSeq + s.count)
+            break;
+        if (seq >= holdFrom)
+            hold(seq, r);
+        s.count++;
+        s.bytes += len;
+    }
+    f.close();
+    if (torn)
+        *torn = s.bytes < size;
+    return true;
+}
+
+void StoreForwardHistory::rebuildIndex()
+{
+    LOG_INFO("S&F - Rebuild log index from the segments");
+    Segment found[SF_LOG_SEGMENTS];
+    bool valid[SF_LOG_SEGMENTS];
+    int newest = -1;
+    for (uint8_t slot = 0; slot < SF_LOG_SEGMENTS; slot++) {
+        valid[slot] = readSegment(slot, found[slot], true);
+        if (valid[slot] && (newest < 0 || found[slot].firstSeq > found[newest].firstSeq))
+            newest = slot;
+    }
+
+    // The log is the newest segment and the ones right before it that lead up to it
+    memset(segments, 0, sizeof(segments));
+    usedSlots = 0;
+    if (newest >= 0) {
+        uint8_t slot = newest;
+        do {
+            segments[slot] = found[slot];
+            oldestSlot = slot;
+            usedSlots++;
+            uint8_t prev = (slot + SF_LOG_SEGMENTS - 1) % SF_LOG_SEGMENTS;
+            if (!valid[prev] || found[prev].firstSeq + found[prev].count != found[slot].firstSeq)
+                break;
+            slot = prev;
+        } while (usedSlots < SF_LOG_SEGMENTS);
+    }
+
+    // Anything else is left over from before, it would only confuse the next rebuild
+    for (uint8_t slot = 0; slot < SF_LOG_SEGMENTS; slot++) {
+        if (valid[slot] && !segments[slot].bytes) {
+            char path[32];
+            getSegmentPath(slot, path, sizeof(path));
+            concurrency::LockGuard g(spiLock);
+            FSCom.remove(path);
+        }
+    }
+    saveIndex();
+}
+
+void StoreForwardHistory::replay()
+{
+    if (!usedSlots)
+        return;
+    const Segment &open = segments[getOpenSlot()];
+    uint32_t end = open.firstSeq + open.count;
+    uint32_t start = segments[oldestSlot].firstSeq;
+    if (end - start > maxRecords)
+        start = end - maxRecords;
+
+    firstSeq = nextSeq = start;
+    for (uint8_t i = 0; i < usedSlots; i++) {
+        uint8_t slot = (oldestSlot + i) % SF_LOG_SEGMENTS;
+        Segment &s = segments[slot];
+        if (s.firstSeq + s.count <= start)
+            continue; // All of it is older than what fits
+        Segment read;
+        if (!readSegment(slot, read, true, start))
+            break;
+    }
+    // Carry on from the end of the log, even if some of it couldn't be read back
+    if (nextSeq != end)
+        firstSeq = nextSeq = end;
+}
+
+bool StoreForwardHistory::startSegment(uint32_t seq)
+{
+    if (usedSlots == SF_LOG_SEGMENTS)
+        dropOldestSegment();
+    uint8_t slot = (oldestSlot + usedSlots) % SF_LOG_SEGMENTS;
+    char path[32];
+    getSegmentPath(slot, path, sizeof(path));
+    uint32_t header[2] = {SF_LOG_SEGMENT_MAGIC, seq};
+    bool ok;
+    {
+        concurrency::LockGuard g(spiLock);
+        File f = FSCom.open(path, FILE_O_WRITE);
+        ok = f && f.write((const uint8_t *)header, sizeof(header)) == sizeof(header);
+        if (f)
+            f.close();
+    }
+    if (!ok) {
+        LOG_ERROR("S&F - Can't start log segment %s", path);
+        return false;
+    }
+    segments[slot] = {seq, 0, SF_LOG_SEGMENT_HEADER_LEN};
+    usedSlots++;
+    saveIndex();
+    return true;
+}
+
+void StoreForwardHistory::dropOldestSegment()
+{
+    char path[32];
+    getSegmentPath(oldestSlot, path, sizeof(path));
+    {
+        concurrency::LockGuard g(spiLock);
+        FSCom.remove(path);
+    }
+    LOG_DEBUG("S&F - Dropped log segment %u, %u messages from %u on", oldestSlot, segments[oldestSlot].count,
+              segments[oldestSlot].firstSeq);
+    segments[oldestSlot] = {};
+    oldestSlot = (oldestSlot + 1) % SF_LOG_SEGMENTS;
+    usedSlots--;
+}
+
+void StoreForwardHistory::append(uint32_t seq, const PacketHistoryStruct &r)
+{
+    uint8_t rec[SF_LOG_MAX_RECORD];
+    size_t len = encodeRecord(seq, r, rec);
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if ((!usedSlots || segments[getOpenSlot()].bytes + len > segmentBytes) && !startSegment(seq))
+            return;
+        Segment &open = segments[getOpenSlot()];
+        char path[32];
+        getSegmentPath(getOpenSlot(), path, sizeof(path));
+        bool ok;
+        {
+            concurrency::LockGuard g(spiLock);
+            File f = FSCom.open(path, FILE_O_APPEND);
+            ok = f && f.write(rec, len) == len;
+            if (f)
+                f.close();
+        }
+        if (ok) {
+            open.count++;
+            open.bytes += len;
+            return;
+        }
+
+        // Most likely the filesystem is full. Make room, and leave whatever part of the record made it behind.
+        LOG_WARN("S&F - Can't append to log segment %s", path);
+        if (usedSlots < 2)
+            return;
+        dropOldestSegment();
+        if (!startSegment(seq))
+            return;
+    }
+}
+
+#endif
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "FSCommon.h"
+#include "configuration.h"
+#include "mesh/generated/meshtastic/mesh.pb.h"
+#include <Arduino.h>
+#include <unordered_map>
+
+struct PacketHistoryStruct {
+    uint32_t time;
+    uint32_t to;
+    uint32_t from;
+    uint32_t id;
+    uint8_t channel;
+    uint32_t reply_id;
+    bool emoji;
+    uint8_t payload[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    pb_size_t payload_size;
+    int32_t rx_rssi;
+    float rx_snr;
+    uint8_t hop_start;
+    uint8_t hop_limit;
+    bool via_mqtt;
+    uint8_t transport_mechanism;
+};
+
+/// How a message is held in RAM: this, then `size` bytes of payload, unishox2 compressed if the flag says so
+struct __attribute__((packed)) PacketHistoryHeader {
+    uint32_t time;
+    uint32_t to;
+    uint32_t from;
+    uint32_t id;
+    uint32_t reply_id;
+    float rx_snr;
+    int16_t rx_rssi;
+    uint8_t channel;
+    uint8_t hop_start;
+    uint8_t hop_limit;
+    uint8_t transport_mechanism;
+    uint8_t flags;
+    uint8_t size; // Payload bytes that follow
+};
+
+#define SF_HISTORY_FLAG_EMOJI 0x01
+#define SF_HISTORY_FLAG_VIA_MQTT 0x02
+#define SF_HISTORY_FLAG_COMPRESSED 0x04
+
+// Compress text payloads in RAM with unishox2, whenever that makes them smaller
+#ifndef SF_HISTORY_COMPRESS
+#define SF_HISTORY_COMPRESS 1
+#endif
+// Longest message in RAM
+#define SF_HISTORY_MAX_RECORD (sizeof(PacketHistoryHeader) + meshtastic_Constants_DATA_PAYLOAD_LEN)
+// Size of a typical message in RAM, what the number of sequence number slots is worked out from when it's not given
+#define SF_HISTORY_TYPICAL_RECORD (sizeof(PacketHistoryHeader) + 24)
+// No such message, at the end of a list
+#define SF_NO_SEQ UINT32_MAX
+
+// Segment files in the log, reused in turn: when they're all in use the oldest one is dropped
+#define SF_LOG_SEGMENTS 16
+// A segment is closed and the next one started once it reaches this size
+#ifndef SF_LOG_SEGMENT_BYTES
+#define SF_LOG_SEGMENT_BYTES (16 * 1024)
+#endif
+// Where the log lives on the filesystem
+#define SF_LOG_DIR "/sf"
+// Longest record in the log, header included
+#define SF_LOG_MAX_RECORD (48 + meshtastic_Constants_DATA_PAYLOAD_LEN)
+
+/**
+ * Store & Forward message history.
+ *
+ * Every message gets the next sequence number, counting up for as long as the log is kept, and the newest ones are held in RAM
+ * to be sent out. Clients remember the sequence number they got up to, so when the oldest messages make room for new ones a
+ * client only misses those, instead of starting over.
+ *
+ * In RAM, messages are packed one after the other in an arena, each a PacketHistoryHeader and only as much payload as it has,
+ * compressed when unishox2 makes it smaller. A table of offsets, one slot per sequence number, finds them again. The oldest
+ * messages make room when the arena or the table is full, so short texts fit many times more than a fixed size slot each.
+ *
+ * The messages to each destination, and to NODENUM_BROADCAST, are also linked into a list of their own through the table, so
+ * the ones meant for a client can be walked without looking at all the rest.
+ *
+ * With a log directory, every message is also appended to a log on the filesystem, and the RAM copy is reloaded from it at
+ * boot. The log is SF_LOG_SEGMENTS segment files used in turn, each a header and then records with their own CRC. A small
+ * index file keeps the first sequence number, record count and size of each closed segment, so boot only reads what will fit
+ * in RAM and only needs to check the open segment: a record torn by a reset while it was written ends that segment there, and
+ * the log carries on in the next one. If the index is missing or doesn't match the segments, it's rebuilt from them.
+ */
+class StoreForwardHistory
+{
+  public:
+    ~StoreForwardHistory();
+
+    /**
+     * Allocate the arena and reload what the log has.
+     * @param bytes memory to use, arena and offset table together
+     * @param maxRecords most messages to hold, 0 to work it out from bytes for messages of a typical size
+     * @param dir log directory, nullptr to keep history in RAM only
+     * @return false if there's no memory for it
+     */
+    bool init(uint32_t bytes, uint32_t maxRecords = 0, const char *dir = nullptr, uint32_t segmentBytes = SF_LOG_SEGMENT_BYTES);
+
+    /// Store a message, making room by dropping the oldest. @return its sequence number
+    uint32_t add(const PacketHistoryStruct &r);
+
+    /// @return the header of the message with this sequence number, nullptr if it was dropped or is yet to come
+    const PacketHistoryHeader *getHeader(uint32_t seq) const;
+    /// Unpack the message with this sequence number. @return false if it was dropped or is yet to come
+    bool get(uint32_t seq, PacketHistoryStruct &r) const;
+
+    /// Oldest message held that is addressed to `to`, SF_NO_SEQ if none
+    uint32_t getFirstTo(uint32_t to) const;
+    /// Next message after seq addressed to the same node, SF_NO_SEQ if none yet. seq must be held.
+    uint32_t getNextTo(uint32_t seq) const { return slots[seq % maxRecords].nextTo; }
+
+    /// Oldest sequence number still held
+    uint32_t getFirstSeq() const { return firstSeq; }
+    /// Sequence number the next message will get, also how many have ever been stored
+    uint32_t getNextSeq() const { return nextSeq; }
+    uint32_t getCount() const { return nextSeq - firstSeq; }
+    /// Most messages that can be held, if they're all short
+    uint32_t getCapacity() const { return maxRecords; }
+    /// Arena bytes in use, padding at its end included
+    uint32_t getUsedBytes() const;
+    /// Memory it takes for records messages of any length
+    static uint64_t getBytesFor(uint32_t records) { return (uint64_t)records * (SF_HISTORY_MAX_RECORD + sizeof(Slot)); }
+
+    /// Log record encoding. @return the record length, buf must have room for SF_LOG_MAX_RECORD
+    static size_t encodeRecord(uint32_t seq, const PacketHistoryStruct &r, uint8_t *buf);
+    /// @return the length of the record at buf, 0 if it's not a whole, valid record
+    static size_t decodeRecord(const uint8_t *buf, size_t len, uint32_t &seq, PacketHistoryStruct &r);
+
+  private:
+    struct Slot {
+        uint32_t offset; // Where the message starts in the arena
+        uint32_t nextTo; // Next message to the same node
+    };
+    struct List {
+        uint32_t first, last;
+    };
+
+    Slot *slots = nullptr;    // By sequence number modulo maxRecords
+    uint8_t *arena = nullptr; // Right after the slots, in the same allocation
+    uint32_t maxRecords = 0;
+    uint32_t arenaBytes = 0;
+    uint32_t head = 0, tail = 0; // Arena offsets of the oldest message and of the end of the newest
+    uint32_t firstSeq = 0, nextSeq = 0;
+    std::unordered_map<uint32_t, List> lists; // Messages held for each destination
+
+    /// Put a message in RAM
+    void hold(uint32_t seq, const PacketHistoryStruct &r);
+    /// Whether len bytes at offset off are clear of the messages held
+    bool isFree(uint32_t off, uint32_t len) const;
+    void dropOldest();
+
+#ifdef FSCom
+    struct Segment {
+        uint32_t firstSeq;
+        uint32_t count; // Records
+        uint32_t bytes; // File size up to the end of the last valid record, 0 if the slot is unused
+    };
+
+    const char *dir = nullptr;
+    uint32_t segmentBytes = 0;
+    Segment segments[SF_LOG_SEGMENTS] = {};
+    uint8_t oldestSlot = 0;
+    uint8_t usedSlots = 0;
+
+    void getSegmentPath(uint8_t slot, char *path, size_t size) const;
+    uint8_t getOpenSlot() const { return (oldestSlot + usedSlots - 1) % SF_LOG_SEGMENTS; }
+
+    bool loadIndex();
+    void saveIndex();
+    /**
+     * Read a segment's header, and with scan its records too: count and bytes then come from what's in the file.
+     * Records from holdFrom on are put in RAM. torn is set if the file goes on past the last valid record.
+     * @return false if the file isn't a segment
+     */
+    bool readSegment(uint8_t slot, Segment &s, bool scan, uint32_t holdFrom = UINT32_MAX, bool *torn = nullptr);
+    /// Work out the segments from the files, when the index can't be trusted
+    void rebuildIndex();
+    /// Load the newest messages that fit in RAM
+    void replay();
+    /// Close the open segment and start a new one at seq, dropping the oldest if all are in use
+    bool startSegment(uint32_t seq);
+    void dropOldestSegment();
+    void append(uint32_t seq, const PacketHistoryStruct &r);
+#endif
+};
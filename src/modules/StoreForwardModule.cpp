@@ -16,6 +16,7 @@
 #include "MeshService.h"
 #include "NodeDB.h"
 #include "RTC.h"
+#include "RadioLibInterface.h"
 #include "Router.h"
 #include "Throttle.h"
 #include "airtime.h"
@@ -25,6 +26,7 @@
 #include "mesh/generated/meshtastic/storeforward.pb.h"
 #include "modules/ModuleDev.h"
 #include <Arduino.h>
+#include <algorithm>
 #include <iterator>
 #include <map>
 
@@ -35,14 +37,17 @@ int32_t StoreForwardModule::runOnce()
 #if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
     if (moduleConfig.store_forward.enabled && is_server) {
         // Send out the message queue.
-        if (this->busy) {
-            // Only send packets if the channel is less than 25% utilized and until historyReturnMax
-            if (airTime->isTxAllowedChannelUtil(true) && this->requestCount < this->historyReturnMax) {
-                if (!storeForwardModule->sendPayload(this->busyTo, this->last_time)) {
-                    this->requestCount = 0;
-                    this->busy = false;
-                }
-            }
+        if (!this->replay.isIdle()) {
+            // Only send packets if the channel is less than 25% utilized
+            if (!airTime->isTxAllowedChannelUtil(true))
+                return (this->packetTimeMax);
+            uint32_t waitMs;
+            StoreForwardScheduler::Session *session = this->replay.next(millis(), waitMs);
+            if (!session)
+                return waitMs;
+            if (!storeForwardModule->sendPayload(*session))
+                this->replay.stop(session->to); // Nothing more for this client, on to the next
+            return 0;                           // The next turn says how long to wait
         } else if (this->heartbeat && (!Throttle::isWithinTimespanMs(lastHeartbeat, heartbeatInterval * 1000)) &&
                    airTime->isTxAllowedChannelUtil(true)) {
             lastHeartbeat = millis();
@@ -73,22 +78,20 @@ void StoreForwardModule::populatePSRAM()
     LOG_DEBUG("Before PSRAM init: heap %d/%d PSRAM %d/%d", memGet.getFreeHeap(), memGet.getHeapSize(), memGet.getFreePsram(),
               memGet.getPsramSize());
 
-    /* Use a maximum of 3/4 the available PSRAM unless otherwise specified.
+    /* Use a maximum of 3/4 the available PSRAM, and no more than the configured number of records would need at most.
         Note: This needs to be done after every thing that would use PSRAM
     */
-    uint32_t numberOfPackets =
-        (this->records ? this->records : (((memGet.getFreePsram() / 4) * 3) / sizeof(PacketHistoryStruct)));
-    this->records = numberOfPackets;
-#if defined(ARCH_ESP32)
-    this->packetHistory = static_cast<PacketHistoryStruct *>(ps_calloc(numberOfPackets, sizeof(PacketHistoryStruct)));
-#elif defined(ARCH_PORTDUINO)
-    this->packetHistory = static_cast<PacketHistoryStruct *>(calloc(numberOfPackets, sizeof(PacketHistoryStruct)));
-
-#endif
+    uint32_t historyBytes = (memGet.getFreePsram() / 4) * 3;
+    if (this->records)
+        historyBytes = std::min<uint64_t>(historyBytes, StoreForwardHistory::getBytesFor(this->records));
+    // Also reloads what the log kept from before a reboot
+    if (!this->history.init(historyBytes, this->records, SF_LOG_DIR))
+        LOG_ERROR("S&F - Can't allocate %u bytes of history", historyBytes);
+    this->records = this->history.getCapacity();
 
     LOG_DEBUG("After PSRAM init: heap %d/%d PSRAM %d/%d", memGet.getFreeHeap(), memGet.getHeapSize(), memGet.getFreePsram(),
               memGet.getPsramSize());
-    LOG_DEBUG("numberOfPackets for packetHistory - %u", numberOfPackets);
+    LOG_DEBUG("S&F - History of %u bytes for up to %u packets", historyBytes, this->records);
 }
 
 /**
@@ -99,15 +102,17 @@ void StoreForwardModule::populatePSRAM()
  */
 void StoreForwardModule::historySend(uint32_t secAgo, uint32_t to)
 {
-    this->last_time = getTime() < secAgo ? 0 : getTime() - secAgo;
-    uint32_t queueSize = getNumAvailablePackets(to, last_time);
-    if (queueSize > this->historyReturnMax)
-        queueSize = this->historyReturnMax;
+    uint32_t last_time = getTime() < secAgo ? 0 : getTime() - secAgo;
+    uint32_t queueSize = getNumAvailablePackets(to, last_time, this->historyReturnMax);
 
     if (queueSize) {
-        LOG_INFO("S&F - Send %u message(s)", queueSize);
-        this->busy = true; // runOnce() will pickup the next steps once busy = true.
-        this->busyTo = to;
+        // Pace the replay for how far away the client is, or the furthest a packet can go if that's not known
+        const meshtastic_NodeInfoLite *node = nodeDB->getMeshNode(to);
+        uint8_t hops = (node && node->has_hops_away) ? node->hops_away : config.lora.hop_limit;
+        LOG_INFO("S&F - Send %u message(s) to 0x%x, %u hop(s) away", queueSize, to, hops);
+        // runOnce() will pickup the next steps, after a delay for the client to take in the response
+        this->replay.start(to, last_time, queueSize, hops, millis() + this->packetTimeMax);
+        setIntervalFromNow(0);
     } else {
         LOG_INFO("S&F - No history");
     }
@@ -116,9 +121,8 @@ void StoreForwardModule::historySend(uint32_t secAgo, uint32_t to)
     sf.which_variant = meshtastic_StoreAndForward_history_tag;
     sf.variant.history.history_messages = queueSize;
     sf.variant.history.window = secAgo * 1000;
-    sf.variant.history.last_request = lastRequest[to];
+    sf.variant.history.last_request = lastRequest[to].seq;
     storeForwardModule->sendMessage(to, sf);
-    setIntervalFromNow(this->packetTimeMax); // Delay start of sending payloads
 }
 
 /**
@@ -126,24 +130,51 @@ void StoreForwardModule::historySend(uint32_t secAgo, uint32_t to)
  *
  * @param dest The destination node number.
  * @param last_time The relative time to start counting messages from.
+ * @param limit Stop counting at this many.
  * @return The number of available packets in the message history.
  */
-uint32_t StoreForwardModule::getNumAvailablePackets(NodeNum dest, uint32_t last_time)
+uint32_t StoreForwardModule::getNumAvailablePackets(NodeNum dest, uint32_t last_time, uint32_t limit)
 {
+    ClientCursor cursor = lastRequest[dest];
     uint32_t count = 0;
-    if (lastRequest.find(dest) == lastRequest.end()) {
-        lastRequest.emplace(dest, 0);
-    }
-    for (uint32_t i = lastRequest[dest]; i < this->packetHistoryTotalCount; i++) {
-        if (this->packetHistory[i].time && (this->packetHistory[i].time > last_time)) {
-            // Client is only interested in packets not from itself and only in broadcast packets or packets towards it.
-            if (this->packetHistory[i].from != dest &&
-                (this->packetHistory[i].to == NODENUM_BROADCAST || this->packetHistory[i].to == dest)) {
-                count++;
-            }
+    while (count < limit && nextForClient(dest, cursor, last_time) != SF_NO_SEQ)
+        count++;
+    return count;
+}
+
+/**
+ * Finds the next message for a client, from the broadcast list and the list of messages to it, in sequence order.
+ * Only these two lists are walked, so the time it takes is down to the messages meant for the client.
+ *
+ * @param dest The destination node number.
+ * @param cursor Where the client is up to, moved past the message found and any it skipped.
+ * @param last_time The relative time to start from.
+ * @return The sequence number of the message, SF_NO_SEQ if there is none.
+ */
+uint32_t StoreForwardModule::nextForClient(NodeNum dest, ClientCursor &cursor, uint32_t last_time)
+{
+    // Carry on after the last message from each list, or from the start of it when that one made room for newer ones
+    auto next = [this](uint32_t last, uint32_t to) {
+        return this->history.getHeader(last) ? this->history.getNextTo(last) : this->history.getFirstTo(to);
+    };
+    uint32_t broadcast = next(cursor.broadcast, NODENUM_BROADCAST);
+    uint32_t direct = next(cursor.direct, dest);
+
+    while (broadcast != SF_NO_SEQ || direct != SF_NO_SEQ) {
+        uint32_t seq;
+        if (broadcast < direct) {
+            seq = cursor.broadcast = broadcast;
+            broadcast = this->history.getNextTo(seq);
+        } else {
+            seq = cursor.direct = direct;
+            direct = this->history.getNextTo(seq);
         }
+        // Client is only interested in packets not from itself, received by the server in the time asked for
+        const PacketHistoryHeader *h = this->history.getHeader(seq);
+        if (h->time && (h->time > last_time) && h->from != dest)
+            return seq;
     }
-    return count;
+    return SF_NO_SEQ;
 }
 
 /**
@@ -154,25 +185,8 @@ uint32_t StoreForwardModule::getNumAvailablePackets(NodeNum dest, uint32_t last_
 meshtastic_MeshPacket *StoreForwardModule::getForPhone()
 {
     if (moduleConfig.store_forward.enabled && is_server) {
-        NodeNum to = nodeDB->getNodeNum();
-        if (!this->busy) {
-            // Get number of packets we're going to send in this loop
-            uint32_t histSize = getNumAvailablePackets(to, 0); // No time limit
-            if (histSize) {
-                this->busy = true;
-                this->busyTo = to;
-            } else {
-                return nullptr;
-            }
-        }
-
-        // We're busy with sending to us until no payload is available anymore
-        if (this->busy && this->busyTo == to) {
-            meshtastic_MeshPacket *p = preparePayload(to, 0, true); // No time limit
-            if (!p)                                                 // No more messages to send
-                this->busy = false;
-            return p;
-        }
+        // Keep sending to us until no payload is available anymore
+        return preparePayload(nodeDB->getNodeNum(), 0, true); // No time limit
     }
     return nullptr;
 }
@@ -186,50 +200,48 @@ void StoreForwardModule::historyAdd(const meshtastic_MeshPacket &mp)
 {
     const auto &p = mp.decoded;
 
-    if (this->packetHistoryTotalCount == this->records) {
-        LOG_WARN("S&F - PSRAM Full. Starting overwrite");
-        this->packetHistoryTotalCount = 0;
-        for (auto &i : lastRequest) {
-            i.second = 0; // Clear the last request index for each client device
-        }
-    }
-
-    this->packetHistory[this->packetHistoryTotalCount].time = getTime();
-    this->packetHistory[this->packetHistoryTotalCount].to = mp.to;
-    this->packetHistory[this->packetHistoryTotalCount].channel = mp.channel;
-    this->packetHistory[this->packetHistoryTotalCount].from = getFrom(&mp);
-    this->packetHistory[this->packetHistoryTotalCount].id = mp.id;
-    this->packetHistory[this->packetHistoryTotalCount].reply_id = p.reply_id;
-    this->packetHistory[this->packetHistoryTotalCount].emoji = (bool)p.emoji;
-    this->packetHistory[this->packetHistoryTotalCount].payload_size = p.payload.size;
-    this->packetHistory[this->packetHistoryTotalCount].rx_rssi = mp.rx_rssi;
-    this->packetHistory[this->packetHistoryTotalCount].rx_snr = mp.rx_snr;
-    this->packetHistory[this->packetHistoryTotalCount].hop_start = mp.hop_start;
-    this->packetHistory[this->packetHistoryTotalCount].hop_limit = mp.hop_limit;
-    this->packetHistory[this->packetHistoryTotalCount].via_mqtt = mp.via_mqtt;
-    this->packetHistory[this->packetHistoryTotalCount].transport_mechanism = mp.transport_mechanism;
-    memcpy(this->packetHistory[this->packetHistoryTotalCount].payload, p.payload.bytes, meshtastic_Constants_DATA_PAYLOAD_LEN);
-
-    this->packetHistoryTotalCount++;
+    PacketHistoryStruct h = {};
+    h.time = getTime();
+    h.to = mp.to;
+    h.channel = mp.channel;
+    h.from = getFrom(&mp);
+    h.id = mp.id;
+    h.reply_id = p.reply_id;
+    h.emoji = (bool)p.emoji;
+    h.payload_size = p.payload.size;
+    h.rx_rssi = mp.rx_rssi;
+    h.rx_snr = mp.rx_snr;
+    h.hop_start = mp.hop_start;
+    h.hop_limit = mp.hop_limit;
+    h.via_mqtt = mp.via_mqtt;
+    h.transport_mechanism = mp.transport_mechanism;
+    memcpy(h.payload, p.payload.bytes, p.payload.size);
+
+    this->history.add(h);
 }
 
 /**
- * Sends a payload to a specified destination node using the store and forward mechanism.
+ * Sends the next payload of a history replay session, and holds the one after it back for the airtime this one takes.
  *
- * @param dest The destination node number.
- * @param last_time The relative time to start sending messages from.
- * @return True if a packet was successfully sent, false otherwise.
+ * @param session The client's replay session.
+ * @return True if a packet was successfully sent, false if there was none left for the client.
  */
-bool StoreForwardModule::sendPayload(NodeNum dest, uint32_t last_time)
+bool StoreForwardModule::sendPayload(StoreForwardScheduler::Session &session)
 {
-    meshtastic_MeshPacket *p = preparePayload(dest, last_time);
-    if (p) {
-        LOG_INFO("Send S&F Payload");
-        service->sendToMesh(p);
-        this->requestCount++;
-        return true;
+    meshtastic_MeshPacket *p = preparePayload(session.to, session.last_time);
+    if (!p)
+        return false;
+
+    // Without a radio to ask, keep to the fixed pace
+    uint32_t intervalMs = this->packetTimeMax;
+    if (RadioLibInterface::instance) {
+        uint32_t airtimeMs = RadioLibInterface::instance->getPacketTime(p);
+        intervalMs = StoreForwardScheduler::getInterval(airtimeMs, session.hops, airTime->channelUtilizationPercent());
     }
-    return false;
+    LOG_INFO("Send S&F Payload to 0x%x, next in %u ms", session.to, intervalMs);
+    service->sendToMesh(p);
+    this->replay.sent(session, millis(), intervalMs);
+    return true;
 }
 
 /**
@@ -241,60 +253,57 @@ bool StoreForwardModule::sendPayload(NodeNum dest, uint32_t last_time)
  */
 meshtastic_MeshPacket *StoreForwardModule::preparePayload(NodeNum dest, uint32_t last_time, bool local)
 {
-    for (uint32_t i = lastRequest[dest]; i < this->packetHistoryTotalCount; i++) {
-        if (this->packetHistory[i].time && (this->packetHistory[i].time > last_time)) {
-            /*  Copy the messages that were received by the server in the last msAgo
-                to the packetHistoryTXQueue structure.
-                Client not interested in packets from itself and only in broadcast packets or packets towards it. */
-            if (this->packetHistory[i].from != dest &&
-                (this->packetHistory[i].to == NODENUM_BROADCAST || this->packetHistory[i].to == dest)) {
-
-                meshtastic_MeshPacket *p = allocDataPacket();
-
-                p->to = local ? this->packetHistory[i].to : dest; // PhoneAPI can handle original `to`
-                p->from = this->packetHistory[i].from;
-                p->id = this->packetHistory[i].id;
-                p->channel = this->packetHistory[i].channel;
-                p->decoded.reply_id = this->packetHistory[i].reply_id;
-                p->rx_time = this->packetHistory[i].time;
-                p->decoded.emoji = (uint32_t)this->packetHistory[i].emoji;
-                p->rx_rssi = this->packetHistory[i].rx_rssi;
-                p->rx_snr = this->packetHistory[i].rx_snr;
-                p->hop_start = this->packetHistory[i].hop_start;
-                p->hop_limit = this->packetHistory[i].hop_limit;
-                p->via_mqtt = this->packetHistory[i].via_mqtt;
-                p->transport_mechanism = (meshtastic_MeshPacket_TransportMechanism)this->packetHistory[i].transport_mechanism;
-
-                // Let's assume that if the server received the S&F request that the client is in range.
-                //   TODO: Make this configurable.
-                p->want_ack = false;
-
-                if (local) { // PhoneAPI gets normal TEXT_MESSAGE_APP
-                    p->decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
-                    memcpy(p->decoded.payload.bytes, this->packetHistory[i].payload, this->packetHistory[i].payload_size);
-                    p->decoded.payload.size = this->packetHistory[i].payload_size;
-                } else {
-                    meshtastic_StoreAndForward sf = meshtastic_StoreAndForward_init_zero;
-                    sf.which_variant = meshtastic_StoreAndForward_text_tag;
-                    sf.variant.text.size = this->packetHistory[i].payload_size;
-                    memcpy(sf.variant.text.bytes, this->packetHistory[i].payload, this->packetHistory[i].payload_size);
-                    if (this->packetHistory[i].to == NODENUM_BROADCAST) {
-                        sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_TEXT_BROADCAST;
-                    } else {
-                        sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_TEXT_DIRECT;
-                    }
-
-                    p->decoded.payload.size = pb_encode_to_bytes(p->decoded.payload.bytes, sizeof(p->decoded.payload.bytes),
-                                                                 &meshtastic_StoreAndForward_msg, &sf);
-                }
+    ClientCursor cursor = lastRequest[dest];
+    uint32_t seq = nextForClient(dest, cursor, last_time);
+    if (seq == SF_NO_SEQ)
+        return nullptr;
+    cursor.seq = seq + 1;
+    lastRequest[dest] = cursor; // Update where the client device got up to
+
+    PacketHistoryStruct stored;
+    this->history.get(seq, stored);
+    const PacketHistoryStruct *h = &stored;
+
+    meshtastic_MeshPacket *p = allocDataPacket();
+
+    p->to = local ? h->to : dest; // PhoneAPI can handle original `to`
+    p->from = h->from;
+    p->id = h->id;
+    p->channel = h->channel;
+    p->decoded.reply_id = h->reply_id;
+    p->rx_time = h->time;
+    p->decoded.emoji = (uint32_t)h->emoji;
+    p->rx_rssi = h->rx_rssi;
+    p->rx_snr = h->rx_snr;
+    p->hop_start = h->hop_start;
+    p->hop_limit = h->hop_limit;
+    p->via_mqtt = h->via_mqtt;
+    p->transport_mechanism = (meshtastic_MeshPacket_TransportMechanism)h->transport_mechanism;
 
-                lastRequest[dest] = i + 1; // Update the last request index for the client device
+    // Let's assume that if the server received the S&F request that the client is in range.
+    //   TODO: Make this configurable.
+    p->want_ack = false;
 
-                return p;
-            }
+    if (local) { // PhoneAPI gets normal TEXT_MESSAGE_APP
+        p->decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
+        memcpy(p->decoded.payload.bytes, h->payload, h->payload_size);
+        p->decoded.payload.size = h->payload_size;
+    } else {
+        meshtastic_StoreAndForward sf = meshtastic_StoreAndForward_init_zero;
+        sf.which_variant = meshtastic_StoreAndForward_text_tag;
+        sf.variant.text.size = h->payload_size;
+        memcpy(sf.variant.text.bytes, h->payload, h->payload_size);
+        if (h->to == NODENUM_BROADCAST) {
+            sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_TEXT_BROADCAST;
+        } else {
+            sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_TEXT_DIRECT;
         }
+
+        p->decoded.payload.size = pb_encode_to_bytes(p->decoded.payload.bytes, sizeof(p->decoded.payload.bytes),
+                                                     &meshtastic_StoreAndForward_msg, &sf);
     }
-    return nullptr;
+
+    return p;
 }
 
 /**
@@ -348,7 +357,7 @@ void StoreForwardModule::sendErrorTextMessage(NodeNum dest, bool want_response)
     pr->decoded.want_response = false;
     pr->decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
     const char *str;
-    if (this->busy) {
+    if (this->replay.isFull()) {
         str = "S&F - Busy. Try again shortly.";
     } else {
         str = "S&F not permitted on the public channel.";
@@ -373,8 +382,8 @@ void StoreForwardModule::statsSend(uint32_t to)
 
     sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_STATS;
     sf.which_variant = meshtastic_StoreAndForward_stats_tag;
-    sf.variant.stats.messages_total = this->records;
-    sf.variant.stats.messages_saved = this->packetHistoryTotalCount;
+    sf.variant.stats.messages_total = this->history.getNextSeq();
+    sf.variant.stats.messages_saved = this->history.getCount();
     sf.variant.stats.messages_max = this->records;
     sf.variant.stats.up_time = millis() / 1000;
     sf.variant.stats.requests = this->requests;
@@ -404,14 +413,14 @@ ProcessMessage StoreForwardModule::handleReceived(const meshtastic_MeshPacket &m
                 LOG_DEBUG("Legacy Request to send");
 
                 // Send the last 60 minutes of messages.
-                if (this->busy || channels.isDefaultChannel(mp.channel)) {
+                if (!this->replay.canStart(getFrom(&mp)) || channels.isDefaultChannel(mp.channel)) {
                     sendErrorTextMessage(getFrom(&mp), mp.decoded.want_response);
                 } else {
                     storeForwardModule->historySend(historyReturnWindow * 60, getFrom(&mp));
                 }
             } else {
                 storeForwardModule->historyAdd(mp);
-                LOG_INFO("S&F stored. Message history contains %u records now", this->packetHistoryTotalCount);
+                LOG_INFO("S&F stored. Message history contains %u records now", this->history.getCount());
             }
         } else if (!isFromUs(&mp) && mp.decoded.portnum == meshtastic_PortNum_STORE_FORWARD_APP) {
             auto &p = mp.decoded;
@@ -456,10 +465,9 @@ bool StoreForwardModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp,
     case meshtastic_StoreAndForward_RequestResponse_CLIENT_ABORT:
         if (is_server) {
             // stop sending stuff, the client wants to abort or has another error
-            if ((this->busy) && (this->busyTo == getFrom(&mp))) {
+            if (this->replay.isActive(getFrom(&mp))) {
                 LOG_ERROR("Client in ERROR or ABORT requested");
-                this->requestCount = 0;
-                this->busy = false;
+                this->replay.stop(getFrom(&mp));
             }
         }
         break;
@@ -469,7 +477,7 @@ bool StoreForwardModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp,
             requests_history++;
             LOG_INFO("Client Request to send HISTORY");
             // Send the last 60 minutes of messages.
-            if (this->busy || channels.isDefaultChannel(mp.channel)) {
+            if (!this->replay.canStart(getFrom(&mp)) || channels.isDefaultChannel(mp.channel)) {
                 sendErrorTextMessage(getFrom(&mp), mp.decoded.want_response);
             } else {
                 if ((p->which_variant == meshtastic_StoreAndForward_history_tag) && (p->variant.history.window > 0)) {
@@ -498,7 +506,7 @@ bool StoreForwardModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp,
     case meshtastic_StoreAndForward_RequestResponse_CLIENT_STATS:
         if (is_server) {
             LOG_INFO("Client Request to send STATS");
-            if (this->busy) {
+            if (this->replay.isFull()) {
                 storeForwardModule->sendMessage(getFrom(&mp), meshtastic_StoreAndForward_RequestResponse_ROUTER_BUSY);
                 LOG_INFO("S&F - Busy. Try again shortly");
             } else {
@@ -512,7 +520,7 @@ bool StoreForwardModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp,
         if (is_client) {
             LOG_DEBUG("StoreAndForward_RequestResponse_ROUTER_BUSY");
             // retry in messages_saved * packetTimeMax ms
-            retry_delay = millis() + getNumAvailablePackets(this->busyTo, this->last_time) * packetTimeMax *
+            retry_delay = millis() + getNumAvailablePackets(getFrom(&mp), 0) * packetTimeMax *
                                          (meshtastic_StoreAndForward_RequestResponse_ROUTER_ERROR ? 2 : 1);
         }
         break;
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "ProtobufModule.h"
+#include "StoreForwardHistory.h"
+#include "StoreForwardScheduler.h"
 #include "concurrency/OSThread.h"
 #include "mesh/generated/meshtastic/storeforward.pb.h"
 
@@ -9,42 +11,29 @@
 #include <functional>
 #include <unordered_map>
 
-struct PacketHistoryStruct {
-    uint32_t time;
-    uint32_t to;
-    uint32_t from;
-    uint32_t id;
-    uint8_t channel;
-    uint32_t reply_id;
-    bool emoji;
-    uint8_t payload[meshtastic_Constants_DATA_PAYLOAD_LEN];
-    pb_size_t payload_size;
-    int32_t rx_rssi;
-    float rx_snr;
-    uint8_t hop_start;
-    uint8_t hop_limit;
-    bool via_mqtt;
-    uint8_t transport_mechanism;
-};
-
 class StoreForwardModule : private concurrency::OSThread, public ProtobufModule<meshtastic_StoreAndForward>
 {
-    bool busy = 0;
-    uint32_t busyTo = 0;
     char routerMessage[meshtastic_Constants_DATA_PAYLOAD_LEN] = {0};
 
-    PacketHistoryStruct *packetHistory = 0;
-    uint32_t packetHistoryTotalCount = 0;
-    uint32_t last_time = 0;
-    uint32_t requestCount = 0;
+    StoreForwardHistory history;
+    StoreForwardScheduler replay; // Clients being sent history
 
-    uint32_t packetTimeMax = 5000; // Interval between sending history packets as a server.
+    uint32_t packetTimeMax = 5000; // Delay before sending history, and between packets when the airtime isn't known.
 
     bool is_client = false;
     bool is_server = false;
 
-    // Unordered_map stores the last request for each nodeNum (`to` field)
-    std::unordered_map<NodeNum, uint32_t> lastRequest;
+    // Where a client is up to: the last message it got, or skipped, from the broadcast list and from its own
+    struct ClientCursor {
+        uint32_t seq = 0; // Sequence number after the last message sent
+        uint32_t broadcast = SF_NO_SEQ;
+        uint32_t direct = SF_NO_SEQ;
+    };
+    // Unordered_map stores where each nodeNum (`to` field) got up to in the history
+    std::unordered_map<NodeNum, ClientCursor> lastRequest;
+
+    /// Next message for dest after the cursor, moving the cursor to it. @return its sequence number, SF_NO_SEQ if none
+    uint32_t nextForClient(NodeNum dest, ClientCursor &cursor, uint32_t last_time);
 
   public:
     StoreForwardModule();
@@ -59,13 +48,13 @@ class StoreForwardModule : private concurrency::OSThread, public ProtobufModule<
     void historyAdd(const meshtastic_MeshPacket &mp);
     void statsSend(uint32_t to);
     void historySend(uint32_t secAgo, uint32_t to);
-    uint32_t getNumAvailablePackets(NodeNum dest, uint32_t last_time);
+    uint32_t getNumAvailablePackets(NodeNum dest, uint32_t last_time, uint32_t limit = UINT32_MAX);
 
     /**
      * Send our payload into the mesh
      */
-    bool sendPayload(NodeNum dest = NODENUM_BROADCAST, uint32_t packetHistory_index = 0);
-    meshtastic_MeshPacket *preparePayload(NodeNum dest, uint32_t packetHistory_index, bool local = false);
+    bool sendPayload(StoreForwardScheduler::Session &session);
+    meshtastic_MeshPacket *preparePayload(NodeNum dest, uint32_t last_time, bool local = false);
     void sendMessage(NodeNum dest, const meshtastic_StoreAndForward &payload);
     void sendMessage(NodeNum dest, meshtastic_StoreAndForward_RequestResponse rr);
     void sendErrorTextMessage(NodeNum dest, bool want_response);
@@ -0,0 +1,76 @@
+#include "StoreForwardScheduler.h"
+#include <algorithm>
+
+int StoreForwardScheduler::indexOf(uint32_t to) const
+{
+    for (int i = 0; i < SF_REPLAY_MAX_SESSIONS; i++) {
+        if (sessions[i].active && sessions[i].to == to)
+            return i;
+    }
+    return -1;
+}
+
+bool StoreForwardScheduler::start(uint32_t to, uint32_t last_time, uint32_t count, uint8_t hops, uint32_t startMs)
+{
+    int i = indexOf(to);
+    if (i < 0) {
+        i = 0;
+        while (i < SF_REPLAY_MAX_SESSIONS && sessions[i].active)
+            i++;
+        if (i == SF_REPLAY_MAX_SESSIONS)
+            return false;
+        // With others going, the new one joins in at their pace
+        if (!active)
+            nextTxMs = startMs;
+        active++;
+    }
+    sessions[i] = {to, last_time, count, hops, true};
+    return true;
+}
+
+void StoreForwardScheduler::stop(uint32_t to)
+{
+    int i = indexOf(to);
+    if (i >= 0) {
+        sessions[i].active = false;
+        active--;
+    }
+}
+
+StoreForwardScheduler::Session *StoreForwardScheduler::next(uint32_t nowMs, uint32_t &waitMs)
+{
+    waitMs = 0;
+    if (!active)
+        return nullptr;
+    if ((int32_t)(nextTxMs - nowMs) > 0) {
+        waitMs = nextTxMs - nowMs;
+        return nullptr;
+    }
+    for (uint8_t i = 0; i < SF_REPLAY_MAX_SESSIONS; i++) {
+        Session &s = sessions[(turn + i) % SF_REPLAY_MAX_SESSIONS];
+        if (s.active) {
+            turn = (turn + i) % SF_REPLAY_MAX_SESSIONS;
+            return &s;
+        }
+    }
+    return nullptr;
+}
+
+void StoreForwardScheduler::sent(Session &s, uint32_t nowMs, uint32_t intervalMs)
+{
+    if (s.remaining)
+        s.remaining--;
+    if (!s.remaining)
+        stop(s.to);
+    turn = (turn + 1) % SF_REPLAY_MAX_SESSIONS;
+    nextTxMs = nowMs + intervalMs;
+}
+
+uint32_t StoreForwardScheduler::getInterval(uint32_t airtimeMs, uint8_t hops, float channelUtil)
+{
+    // Every node on the way to the client repeats the message once
+    float channelMs = (float)airtimeMs * (hops + 1);
+    float sharePercent = std::max<float>(SF_REPLAY_TARGET_UTIL_PERCENT - channelUtil, SF_REPLAY_MIN_SHARE_PERCENT);
+    float intervalMs = channelMs * 100 / sharePercent;
+    return std::min<float>(intervalMs, SF_REPLAY_MAX_INTERVAL_MS);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+// Clients that can be sent history at the same time
+#ifndef SF_REPLAY_MAX_SESSIONS
+#define SF_REPLAY_MAX_SESSIONS 4
+#endif
+// Replay fills the channel up to this utilization, the same level the polite airtime check allows
+#define SF_REPLAY_TARGET_UTIL_PERCENT 25
+// Even on a busy channel, replay may take this much of it
+#define SF_REPLAY_MIN_SHARE_PERCENT 2
+// Never wait longer than this between messages, so a session can't stall
+#define SF_REPLAY_MAX_INTERVAL_MS (60 * 1000)
+
+/**
+ * Paces Store & Forward history replay to the airtime it takes, and shares it between clients.
+ *
+ * Each client asking for history gets a session of its own. After every message, the next one waits for the airtime the
+ * message took on every hop to the client, stretched so that replay only uses what the channel has left below
+ * SF_REPLAY_TARGET_UTIL_PERCENT. Sessions take turns, so one client's long history doesn't hold up the others.
+ */
+class StoreForwardScheduler
+{
+  public:
+    struct Session {
+        uint32_t to;
+        uint32_t last_time; // Only messages received after this
+        uint32_t remaining; // Messages still to send
+        uint8_t hops;       // How far away the client is
+        bool active;
+    };
+
+    /**
+     * Start sending history to a client, or start over if it's already being sent some.
+     * @param startMs when the first message may go out if no other client is being sent any, millis()
+     * @return false if every session is in use
+     */
+    bool start(uint32_t to, uint32_t last_time, uint32_t count, uint8_t hops, uint32_t startMs);
+    void stop(uint32_t to);
+
+    bool isActive(uint32_t to) const { return indexOf(to) >= 0; }
+    bool isIdle() const { return !active; }
+    bool isFull() const { return active == SF_REPLAY_MAX_SESSIONS; }
+    /// Whether a history request from this client can be taken on now
+    bool canStart(uint32_t to) const { return isActive(to) || !isFull(); }
+
+    /**
+     * The session whose turn it is.
+     * @param waitMs set to how long until the next message may go out, when it's not yet time
+     * @return nullptr if it's not yet time, or there are no sessions
+     */
+    Session *next(uint32_t nowMs, uint32_t &waitMs);
+
+    /// A message was sent for session s: end the session if that was its last, and hold the next one back intervalMs
+    void sent(Session &s, uint32_t nowMs, uint32_t intervalMs);
+
+    /// How long to wait after a message of airtimeMs to a client this many hops away
+    static uint32_t getInterval(uint32_t airtimeMs, uint8_t hops, float channelUtil);
+
+  private:
+    Session sessions[SF_REPLAY_MAX_SESSIONS] = {};
+    uint8_t active = 0;
+    uint8_t turn = 0; // Session to look at first for the next message
+    uint32_t nextTxMs = 0;
+
+    /// @return the index of the client's session, -1 if it has none
+    int indexOf(uint32_t to) const;
+};
@@ -8,6 +8,7 @@
 #include "buzz.h"
 #include "configuration.h"
 #ifdef FLAMINGO
+#include "IncidentLog.h"
 #include "RangeTestModule.h"
 #endif
 
@@ -76,10 +77,6 @@ void parseAdmin(pb_size_t size, char* payload){
 
 }
 
-#ifdef DEBUG_PORT
-char textmsg[201];
-#endif
-
 #endif
 
 
@@ -87,33 +84,14 @@ ProcessMessage TextMessageModule::handleReceived(const meshtastic_MeshPacket &mp
 {
 #ifdef FLAMINGO
     /*
-     Improve debug messages so that can parsed as part of log at Incident Command
+     Incident Command reads the message from the event log, the console only gets a summary
     */
 #if defined(DEBUG_PORT) && !defined(DEBUG_MUTE)
-    auto rssi = mp.rx_rssi;
     auto &p = mp.decoded;
-    meshtastic_NodeInfoLite *n = nodeDB->getMeshNode(getFrom(&mp));
-    
-    LOG_INFO("TextModule msg: from=0x%0x, id=0x%x, ln=%s, rxSNR=%g, hop_limit=%d, hop_start=%d",
-        mp.from, mp.id, n->user.long_name, mp.rx_snr, mp.hop_limit, mp.hop_start);
-    uint16_t offset;
-    uint16_t bytes_left = p.payload.size;
-    bool do_loop = 1;
-    offset = 0;
-    /* apparently, the maximum size log message is about 150 characters. Deal this with this*/
-    while (do_loop) {
-        if (bytes_left <= 150) {
-            memset(textmsg, 0, sizeof(textmsg));
-            strncpy(textmsg, (char *)(p.payload.bytes+offset), bytes_left);
-            do_loop = 0;
-        } else {
-            memset(textmsg, 0, sizeof(textmsg));
-            strncpy(textmsg, (char *)(p.payload.bytes+offset), 150);
-            offset = offset + 150;
-            bytes_left = bytes_left-150;
-        }
-        LOG_INFO("z=%s",textmsg);
-    }
+    LOG_INFO("TextModule msg: from=0x%0x, id=0x%x, rxSNR=%g, hop_limit=%d, hop_start=%d", mp.from, mp.id, mp.rx_snr,
+             mp.hop_limit, mp.hop_start);
+    if (incidentLog)
+        incidentLog->logMessage(mp, "rx");
     if (!isBroadcast(mp.to)) {
         // Direct message, check if admin
         parseAdmin(p.payload.size, (char *)p.payload.bytes);
@@ -598,8 +598,7 @@ int32_t MQTT::runOnce()
 
     // If connected poll rapidly, otherwise only occasionally check for a wifi connection change and ability to contact server
     if (moduleConfig.mqtt.proxy_to_client_enabled) {
-        publishQueuedMessages();
-        return 200;
+        return publishQueuedMessages() ? 0 : 200;
     }
 #if HAS_NETWORKING
     else if (!pubSub.loop()) {
@@ -607,11 +606,10 @@ int32_t MQTT::runOnce()
             return 5000; // If we don't want connection now, check again in 5 secs
         else {
             reconnect();
-            // If we succeeded, empty the queue one by one and start reading rapidly, else try again in 30 seconds (TCP
+            // If we succeeded, empty the queue in batches and start reading rapidly, else try again in 30 seconds (TCP
             // connections are EXPENSIVE so try rarely)
             if (isConnectedDirectly()) {
-                publishQueuedMessages();
-                return 200;
+                return publishQueuedMessages() ? 0 : 200;
             } else
                 return 30000;
         }
@@ -620,6 +618,8 @@ int32_t MQTT::runOnce()
         if (!wantConnection) {
             LOG_INFO("MQTT link not needed, drop");
             pubSub.disconnect();
+        } else if (publishQueuedMessages()) {
+            return 0; // Keep going while there's a backlog
         }
 
         powerFSM.trigger(EVENT_CONTACT_FROM_PHONE); // Suppress entering light sleep (because that would turn off bluetooth)
@@ -690,45 +690,56 @@ void MQTT::publishNodeInfo()
 {
     // TODO: NodeInfo broadcast over MQTT only (NODENUM_BROADCAST_NO_LORA)
 }
-void MQTT::publishQueuedMessages()
+bool MQTT::publishQueuedMessages()
 {
     if (mqttQueue.isEmpty())
-        return;
+        return false;
 
     if (!moduleConfig.mqtt.proxy_to_client_enabled && !isConnected)
-        return;
+        return false;
+
+    const uint32_t batchStartMs = millis();
+    if (!drainedMessages)
+        drainStartMs = batchStartMs;
+    uint32_t batchMessages = 0;
+    size_t batchBytes = 0;
+    while (!mqttQueue.isEmpty() && batchMessages < MQTT_DRAIN_MAX_MESSAGES && batchBytes < MQTT_DRAIN_MAX_BYTES &&
+           Throttle::isWithinTimespanMs(batchStartMs, MQTT_DRAIN_MAX_MS)) {
+        // Each entry can take two messages, and the phone queue discards the oldest rather than wait
+        if (moduleConfig.mqtt.proxy_to_client_enabled && service->numFreeMqttClientProxyMessages() < 2)
+            break;
 
-    LOG_DEBUG("Publish enqueued MQTT message");
-    const std::unique_ptr<QueueEntry> entry(mqttQueue.dequeuePtr(0));
-    LOG_INFO("publish %s, %u bytes from queue", entry->topic.c_str(), entry->envBytes.size());
-    publish(entry->topic.c_str(), entry->envBytes.data(), entry->envBytes.size(), false);
+        const std::unique_ptr<QueueEntry> entry(mqttQueue.dequeuePtr(0));
+        LOG_DEBUG("Publish %s, %u bytes from queue", entry->topic.c_str(), entry->envBytes.size());
+        bool published = publish(entry->topic.c_str(), entry->envBytes.data(), entry->envBytes.size(), false);
+        batchBytes += entry->envBytes.size();
 
 #if !defined(ARCH_NRF52) ||                                                                                                      \
     defined(NRF52_USE_JSON) // JSON is not supported on nRF52, see issue #2804 ### Fixed by using ArduinoJson ###
-    if (!moduleConfig.mqtt.json_enabled)
-        return;
-
-    // handle json topic
-    const DecodedServiceEnvelope env(entry->envBytes.data(), entry->envBytes.size());
-    if (!env.validDecode || env.packet == NULL || env.channel_id == NULL)
-        return;
-
-    auto jsonString = MeshPacketSerializer::JsonSerialize(env.packet);
-    if (jsonString.length() == 0)
-        return;
+        if (published && !entry->json.empty()) {
+            LOG_DEBUG("JSON publish %s, %u bytes from queue", entry->topicJson.c_str(), entry->json.length());
+            published = publish(entry->topicJson.c_str(), entry->json.c_str(), false);
+            batchBytes += entry->json.length();
+        }
+#endif // ARCH_NRF52 NRF52_USE_JSON
 
-    // Generate node ID from nodenum for topic
-    std::string nodeId = nodeDB->getNodeId();
+        if (!published) {
+            LOG_WARN("MQTT publish from queue failed, %u left", mqttQueue.numUsed());
+            break;
+        }
+        batchMessages++;
+    }
+    drainedMessages += batchMessages;
+    drainedBytes += batchBytes;
 
-    std::string topicJson;
-    if (env.packet->pki_encrypted) {
-        topicJson = jsonTopic + "PKI/" + nodeId;
-    } else {
-        topicJson = jsonTopic + env.channel_id + "/" + nodeId;
+    if (mqttQueue.isEmpty()) {
+        const uint32_t drainMs = millis() - drainStartMs;
+        LOG_INFO("MQTT queue drained, %u messages, %u bytes in %u ms (%u msg/s), %u discarded while full", drainedMessages,
+                 drainedBytes, drainMs, drainedMessages * 1000 / std::max<uint32_t>(drainMs, 1), discardedMessages);
+        drainedMessages = drainedBytes = discardedMessages = 0;
+        return false;
     }
-    LOG_INFO("JSON publish message to %s, %u bytes: %s", topicJson.c_str(), jsonString.length(), jsonString.c_str());
-    publish(topicJson.c_str(), jsonString.c_str(), false);
-#endif // ARCH_NRF52 NRF52_USE_JSON
+    return batchMessages > 0;
 }
 
 void MQTT::onSend(const meshtastic_MeshPacket &mp_encrypted, const meshtastic_MeshPacket &mp_decoded, ChannelIndex chIndex)
@@ -815,11 +826,18 @@ void MQTT::onSend(const meshtastic_MeshPacket &mp_encrypted, const meshtastic_Me
         if (mqttQueue.numFree() == 0) {
             LOG_WARN("MQTT queue is full, discard oldest");
             entry = mqttQueue.dequeuePtr(0);
+            discardedMessages++;
         } else {
             entry = new QueueEntry;
         }
         entry->topic = std::move(topic);
         entry->envBytes.assign(bytes, numBytes);
+#if !defined(ARCH_NRF52) ||                                                                                                      \
+    defined(NRF52_USE_JSON) // JSON is not supported on nRF52, see issue #2804 ### Fixed by using ArduinoJson ###
+        // Serialize while the decoded packet is at hand, rather than decoding the envelope again when the queue drains
+        entry->topicJson = jsonTopic + channelId + "/" + nodeId;
+        entry->json = moduleConfig.mqtt.json_enabled ? MeshPacketSerializer::JsonSerialize(&mp_decoded) : "";
+#endif // ARCH_NRF52 NRF52_USE_JSON
         if (mqttQueue.enqueue(entry, 0) == false) {
             LOG_CRIT("Failed to add a message to mqttQueue!");
             abort();
@@ -25,6 +25,12 @@
 #endif
 
 #define MAX_MQTT_QUEUE 16
+// Queued messages are published in batches of at most this many messages, bytes and milliseconds, so other threads get a turn
+#ifndef MQTT_DRAIN_MAX_MESSAGES
+#define MQTT_DRAIN_MAX_MESSAGES 8
+#endif
+#define MQTT_DRAIN_MAX_BYTES 4096
+#define MQTT_DRAIN_MAX_MS 50
 
 /**
  * Our wrapper/singleton for sending/receiving MQTT "udp" packets.  This object isolates the MQTT protocol implementation from
@@ -68,9 +74,17 @@ class MQTT : private concurrency::OSThread
     struct QueueEntry {
         std::string topic;
         std::basic_string<uint8_t> envBytes; // binary/pb_encode_to_bytes ServiceEnvelope
+        std::string topicJson;
+        std::string json; // Serialized when queued, empty if JSON is disabled
     };
     PointerQueue<QueueEntry> mqttQueue;
 
+    // Backlog metrics, from the first batch published until the queue is empty again
+    uint32_t drainStartMs = 0;
+    uint32_t drainedMessages = 0;
+    uint32_t drainedBytes = 0;
+    uint32_t discardedMessages = 0; // Dropped because the queue was full
+
     int reconnectCount = 0;
     bool isConfiguredForDefaultServer = true;
     bool isConfiguredForDefaultRootTopic = true;
@@ -127,7 +141,10 @@ class MQTT : private concurrency::OSThread
     /// Called when a new publish arrives from the MQTT server
     void onReceive(char *topic, byte *payload, size_t length);
 
-    void publishQueuedMessages();
+    /** Publish a batch of queued messages, within the MQTT_DRAIN_MAX_* budget
+     * @return true if messages are left that could be published right away
+     */
+    bool publishQueuedMessages();
 
     void publishNodeInfo();
 
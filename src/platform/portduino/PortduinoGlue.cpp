@@ -499,6 +499,13 @@ int initGPIOPin(int pinNum, const std::string gpioChipName, int line)
 #endif
 }
 
+// Names for the LOG_SUBSYS_* bits in Logging: Subsystems
+static const std::map<std::string, uint32_t> logSubsystemBits = {{"packets", LOG_SUBSYS_PACKETS},
+                                                                 {"json", LOG_SUBSYS_JSON},
+                                                                 {"history", LOG_SUBSYS_PACKET_HISTORY},
+                                                                 {"radio", LOG_SUBSYS_RADIO},
+                                                                 {"crypto", LOG_SUBSYS_CRYPTO}};
+
 bool loadConfig(const char *configPath)
 {
     YAML::Node yamlConfig;
@@ -517,6 +524,17 @@ bool loadConfig(const char *configPath)
                 portduino_config.logoutputlevel = level_error;
             }
             portduino_config.traceFilename = yamlConfig["Logging"]["TraceFile"].as<std::string>("");
+            if (yamlConfig["Logging"]["Subsystems"]) {
+                portduino_config.logSubsystemNames = yamlConfig["Logging"]["Subsystems"].as<std::vector<std::string>>();
+                logSubsystems = 0;
+                for (auto &name : portduino_config.logSubsystemNames) {
+                    auto bit = logSubsystemBits.find(name);
+                    if (bit != logSubsystemBits.end())
+                        logSubsystems |= bit->second;
+                    else
+                        std::cout << "Unknown logging subsystem " << name << std::endl;
+                }
+            }
             if (yamlConfig["Logging"]["AsciiLogs"]) {
                 // Default is !isatty(1) but can be set explicitly in config.yaml
                 portduino_config.ascii_logs = yamlConfig["Logging"]["AsciiLogs"].as<bool>();
@@ -145,6 +145,7 @@ extern struct portduino_config_struct {
     // Logging
     portduino_log_level logoutputlevel = level_debug;
     std::string traceFilename;
+    std::vector<std::string> logSubsystemNames; // Subsystems to log, empty for all of them
     bool ascii_logs = !isatty(1);
     bool ascii_logs_explicit = false;
 
@@ -413,6 +414,8 @@ extern struct portduino_config_struct {
         }
         if (traceFilename != "")
             out << YAML::Key << "TraceFile" << YAML::Value << traceFilename;
+        if (!logSubsystemNames.empty())
+            out << YAML::Key << "Subsystems" << YAML::Value << YAML::Flow << logSubsystemNames;
         if (ascii_logs_explicit) {
             out << YAML::Key << "AsciiLogs" << YAML::Value << ascii_logs;
         }
@@ -310,8 +310,7 @@ void SimRadio::handleReceiveInterrupt()
     LOG_DEBUG("HANDLE RECEIVE INTERRUPT");
     rxGood++;
 
-    meshtastic_MeshPacket *mp = packetPool.allocCopy(*receivingPacket); // keep a copy in packetPool
-    packetPool.release(receivingPacket);                                // release the original
+    meshtastic_MeshPacket *mp = receivingPacket; // already in packetPool, hand it over to the router
     receivingPacket = nullptr;
 
     printPacket("Lora RX", mp);
@@ -3,7 +3,7 @@
 
 #include "configuration.h"
 
-#ifdef SENSECAP_INDICATOR
+#if defined(SENSECAP_INDICATOR) || defined(FLAMINGO_SLINK) || defined(ARCH_PORTDUINO)
 
 #include <stdint.h>
 #include <stdlib.h>
@@ -70,6 +70,6 @@ cobs_decode_result cobs_decode(uint8_t *dst_buf_ptr, size_t dst_buf_len, const u
 } /* extern "C" */
 #endif
 
-#endif /* SENSECAP_INDICATOR */
+#endif /* SENSECAP_INDICATOR || FLAMINGO_SLINK || ARCH_PORTDUINO */
 
 #endif /* COBS_H_ */
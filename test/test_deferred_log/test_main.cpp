@@ -0,0 +1,181 @@
+#include "DebugConfiguration.h"
+#include "TestUtil.h"
+#include <unity.h>
+
+#ifdef ARCH_PORTDUINO
+#include "DeferredLog.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static DeferredLog::PushResult push(DeferredLog &log, const char *threadName, const char *format, ...)
+{
+    va_list arg;
+    va_start(arg, format);
+    DeferredLog::PushResult r = log.push(MESHTASTIC_LOG_LEVEL_DEBUG, threadName, format, arg);
+    va_end(arg);
+    return r;
+}
+
+/// Push a message, then check it comes out the way vsnprintf formats it right away
+#define ASSERT_SAME_AS_PRINTF(format, ...)                                                                                       \
+    do {                                                                                                                         \
+        char expected[LOG_DEFERRED_MAX_RECORD];                                                                                  \
+        snprintf(expected, sizeof(expected), format, __VA_ARGS__);                                                               \
+        TEST_ASSERT_EQUAL(DeferredLog::PUSHED, push(log, "Router", format, __VA_ARGS__));                                        \
+        DeferredLog::Message m;                                                                                                  \
+        TEST_ASSERT_TRUE(log.pop(m));                                                                                            \
+        TEST_ASSERT_EQUAL_STRING(expected, m.text);                                                                              \
+        TEST_ASSERT_EQUAL_STRING("Router", m.threadName);                                                                        \
+        TEST_ASSERT_EQUAL_STRING(MESHTASTIC_LOG_LEVEL_DEBUG, m.logLevel);                                                        \
+    } while (0)
+
+void test_formatsLikePrintf()
+{
+    DeferredLog log;
+    ASSERT_SAME_AS_PRINTF("Received routing from=0x%0x, id=0x%x, portnum=%d", 0xa1b2c3d4u, 0x1234u, 5);
+    ASSERT_SAME_AS_PRINTF("rxSNR=%g rxRSSI=%i %.2f%% %5.1f|%-6d|%06x", 6.25f, -87, 99.5, -3.25, 42, 0xbeefu);
+    ASSERT_SAME_AS_PRINTF("%llu %lld %lu %ld %zu %hhu %c", 1ull << 40, -(1ll << 40), 4000000000ul, -5l, (size_t)7, 300, 'x');
+    ASSERT_SAME_AS_PRINTF("%*d|%-*s|%.*s|%p", 6, 42, 8, "left", 3, "truncate", (void *)0x1234);
+    ASSERT_SAME_AS_PRINTF("name=%s, empty=%s, end", "Base camp", "");
+    ASSERT_SAME_AS_PRINTF("%s", "no conversions after this one");
+
+    // No conversions at all
+    TEST_ASSERT_EQUAL(DeferredLog::PUSHED, push(log, nullptr, "plain 100%% text"));
+    DeferredLog::Message m;
+    TEST_ASSERT_TRUE(log.pop(m));
+    TEST_ASSERT_EQUAL_STRING("plain 100% text", m.text);
+    TEST_ASSERT_EQUAL_STRING("", m.threadName);
+    TEST_ASSERT_FALSE(log.pop(m));
+}
+
+void test_stringsAreCopied()
+{
+    DeferredLog log;
+    char name[16] = "before";
+    push(log, "Main", "name=%s", name);
+    strcpy(name, "after");
+
+    DeferredLog::Message m;
+    TEST_ASSERT_TRUE(log.pop(m));
+    TEST_ASSERT_EQUAL_STRING("name=before", m.text);
+
+    // Long strings are cut short, a null one prints like printf's
+    std::string longString(LOG_DEFERRED_MAX_STRING * 2, 'x');
+    push(log, "Main", "[%s] [%s]", longString.c_str(), (const char *)nullptr);
+    TEST_ASSERT_TRUE(log.pop(m));
+    TEST_ASSERT_EQUAL_STRING(("[" + longString.substr(0, LOG_DEFERRED_MAX_STRING) + "] [(null)]").c_str(), m.text);
+
+    // With a precision, nothing past it is read: the bytes need not be NUL terminated
+    const char payload[4] = {'a', 'b', 'c', 'd'};
+    push(log, "Main", "%.*s|%.2s|%.*s", (int)sizeof(payload), payload, payload, -1, "all of it");
+    TEST_ASSERT_TRUE(log.pop(m));
+    TEST_ASSERT_EQUAL_STRING("abcd|ab|all of it", m.text);
+}
+
+void test_unsupportedGoesOutDirectly()
+{
+    DeferredLog log;
+    int n;
+    TEST_ASSERT_EQUAL(DeferredLog::UNSUPPORTED, push(log, "Main", "%Lf", (long double)1.5));
+    TEST_ASSERT_EQUAL(DeferredLog::UNSUPPORTED, push(log, "Main", "abc%n", &n));
+    TEST_ASSERT_EQUAL(DeferredLog::UNSUPPORTED, push(log, "Main", "trailing %"));
+    DeferredLog::Message m;
+    TEST_ASSERT_FALSE(log.pop(m));
+}
+
+void test_fullBufferDrops()
+{
+    DeferredLog log;
+    int pushed = 0;
+    while (push(log, "Main", "message %d", pushed) == DeferredLog::PUSHED)
+        pushed++;
+    TEST_ASSERT_GREATER_THAN(10, pushed);
+    TEST_ASSERT_EQUAL(1, log.takeDropped());
+    TEST_ASSERT_EQUAL(0, log.takeDropped());
+
+    // Everything that made it comes out in order, and around the end of the buffer more than once
+    DeferredLog::Message m;
+    char expected[32];
+    int next = 0;
+    const int rounds = 5 * pushed;
+    for (int round = 0; round < rounds; round++) {
+        TEST_ASSERT_TRUE(log.pop(m));
+        snprintf(expected, sizeof(expected), "message %d", next++);
+        TEST_ASSERT_EQUAL_STRING(expected, m.text);
+        TEST_ASSERT_EQUAL(DeferredLog::PUSHED, push(log, "Main", "message %d", pushed++));
+    }
+    TEST_ASSERT_EQUAL(0, log.takeDropped());
+}
+
+void test_concurrentProducers()
+{
+    static DeferredLog log;
+    const int threads = 4, perThread = 2000;
+    std::atomic<bool> done{false};
+    std::vector<int> lastSeen(threads, -1);
+    int popped = 0, malformed = 0, outOfOrder = 0;
+
+    // Unity asserts only work on the main thread, so the workers just count what went wrong
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; t++) {
+        producers.emplace_back([t]() {
+            for (int i = 0; i < perThread; i++) {
+                while (push(log, "Worker", "thread %d message %d %s", t, i, "padding to vary the length" + (i % 20)) !=
+                       DeferredLog::PUSHED)
+                    std::this_thread::yield();
+            }
+        });
+    }
+    std::thread consumer([&]() {
+        DeferredLog::Message m;
+        while (!done || popped < threads * perThread) {
+            if (!log.pop(m)) {
+                std::this_thread::yield();
+                continue;
+            }
+            popped++;
+            int t, i;
+            if (sscanf(m.text, "thread %d message %d", &t, &i) != 2 || t < 0 || t >= threads) {
+                malformed++;
+                continue;
+            }
+            // Each producer's messages come out in the order it pushed them, none twice or lost
+            if (i != lastSeen[t] + 1)
+                outOfOrder++;
+            lastSeen[t] = i;
+        }
+    });
+    for (auto &p : producers)
+        p.join();
+    done = true;
+    consumer.join();
+    TEST_ASSERT_EQUAL(threads * perThread, popped);
+    TEST_ASSERT_EQUAL(0, malformed);
+    TEST_ASSERT_EQUAL(0, outOfOrder);
+}
+
+void setup()
+{
+    initializeTestEnvironment();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_formatsLikePrintf);
+    RUN_TEST(test_stringsAreCopied);
+    RUN_TEST(test_unsupportedGoesOutDirectly);
+    RUN_TEST(test_fullBufferDrops);
+    RUN_TEST(test_concurrentProducers);
+    exit(UNITY_END());
+}
+#else
+void setup()
+{
+    initializeTestEnvironment();
+    LOG_WARN("This test requires the ARCH_PORTDUINO variant");
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+void loop() {}
@@ -0,0 +1,152 @@
+#include "DebugConfiguration.h"
+#include "TestUtil.h"
+#include <unity.h>
+
+#ifdef ARCH_PORTDUINO
+#include "IncidentLog.h"
+
+#include <string>
+#include <vector>
+
+/// Catches the lines instead of writing them to the console
+class TestIncidentLog : public IncidentLog
+{
+  public:
+    std::vector<std::string> lines;
+    bool busy = false;
+
+    using IncidentLog::drain;
+
+  protected:
+    bool writeLine(const char *line, size_t len) override
+    {
+        if (busy)
+            return false;
+        lines.emplace_back(line, len);
+        return true;
+    }
+};
+
+static meshtastic_MeshPacket makeMessage(const char *text)
+{
+    meshtastic_MeshPacket mp = meshtastic_MeshPacket_init_zero;
+    mp.from = 0xa1b2c3d4;
+    mp.to = 0xffffffff;
+    mp.id = 42;
+    mp.rx_snr = 6.25;
+    mp.rx_rssi = -87;
+    mp.hop_limit = 2;
+    mp.hop_start = 3;
+    mp.which_payload_variant = meshtastic_MeshPacket_decoded_tag;
+    mp.decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
+    mp.decoded.payload.size = strlen(text);
+    memcpy(mp.decoded.payload.bytes, text, mp.decoded.payload.size);
+    return mp;
+}
+
+static uint32_t getSeq(const std::string &line)
+{
+    size_t pos = line.find("\"seq\":");
+    TEST_ASSERT_TRUE(pos != std::string::npos);
+    return strtoul(line.c_str() + pos + 6, NULL, 10);
+}
+
+void test_messageEvent()
+{
+    TestIncidentLog log;
+    log.logMessage(makeMessage("Team 2 at \"the sump\"\n\\ok"), "rx");
+    TEST_ASSERT_FALSE(log.drain(10));
+    TEST_ASSERT_EQUAL(1, log.lines.size());
+
+    const std::string &line = log.lines[0];
+    TEST_ASSERT_EQUAL(0, line.find("{\"t\":\"msg\",\"seq\":0,"));
+    TEST_ASSERT_TRUE(line.find(",\"dir\":\"rx\",\"from\":\"!a1b2c3d4\",\"to\":\"!ffffffff\",\"id\":42,\"ch\":0,") !=
+                     std::string::npos);
+    TEST_ASSERT_TRUE(line.find(",\"snr\":6.25,\"rssi\":-87,\"hop_limit\":2,\"hop_start\":3,\"trunc\":0,") != std::string::npos);
+    // Quotes, backslashes and newlines are escaped, so the event stays on one line
+    TEST_ASSERT_TRUE(line.find("\"text\":\"Team 2 at \\\"the sump\\\"\\u000a\\\\ok\"}\n") != std::string::npos);
+    TEST_ASSERT_EQUAL(line.size() - 1, line.find('\n'));
+}
+
+void test_longMessageIsCutShort()
+{
+    TestIncidentLog log;
+    // Every byte needs 6 to escape, that can't all fit
+    std::string text(meshtastic_Constants_DATA_PAYLOAD_LEN, '\x01');
+    log.logMessage(makeMessage(text.c_str()), "phone");
+    log.drain(10);
+    TEST_ASSERT_EQUAL(1, log.lines.size());
+
+    const std::string &line = log.lines[0];
+    TEST_ASSERT_TRUE(line.size() <= INCIDENTLOG_MAX_LINE);
+    TEST_ASSERT_TRUE(line.find("\"trunc\":1,") != std::string::npos);
+    TEST_ASSERT_EQUAL(line.size() - 3, line.find("\"}\n"));
+}
+
+void test_rangeTestAndLinkEvents()
+{
+    TestIncidentLog log;
+    LinkQualityTable table;
+    for (uint32_t seq = 1; seq <= 10; seq++) {
+        if (seq != 5)
+            table.update(0x1234, 4.5, -90, true, seq * 1000, seq);
+    }
+    log.logRangeTest(*table.get(0x1234));
+    log.logLink({"slink", true, true, 120, 1, 118, 0, 35, 2, 0});
+    log.drain(10);
+    TEST_ASSERT_EQUAL(2, log.lines.size());
+    TEST_ASSERT_TRUE(log.lines[0].find(",\"from\":\"!00001234\",\"rx\":9,\"span\":10,\"burst\":1,") != std::string::npos);
+    TEST_ASSERT_TRUE(log.lines[1].find(",\"link\":\"slink\",\"cobs\":1,\"arq\":1,\"rx_frames\":120,\"crc_errors\":1,\"sent\":118,"
+                                       "\"dropped\":0,\"srtt_ms\":35,\"retx\":2,\"expired\":0}\n") != std::string::npos);
+}
+
+void test_fullQueueDropsWholeEvents()
+{
+    TestIncidentLog log;
+    log.busy = true;
+    const int events = 50;
+    for (int i = 0; i < events; i++)
+        log.logMessage(makeMessage("are you there?"), "rx");
+    TEST_ASSERT_TRUE(log.drain(10));
+    TEST_ASSERT_EQUAL(0, log.lines.size());
+    TEST_ASSERT_GREATER_THAN(0, log.getDropped());
+
+    log.busy = false;
+    while (log.drain(4))
+        ;
+    TEST_ASSERT_EQUAL(events - log.getDropped(), log.lines.size());
+
+    // The ones that made it are whole and in order, the dropped ones show as the gap at the end
+    for (size_t i = 0; i < log.lines.size(); i++) {
+        TEST_ASSERT_EQUAL(i, getSeq(log.lines[i]));
+        TEST_ASSERT_EQUAL(0, log.lines[i].find("{\"t\":\"msg\""));
+        TEST_ASSERT_EQUAL(log.lines[i].size() - 1, log.lines[i].find('\n'));
+    }
+
+    // Room again once drained
+    log.logMessage(makeMessage("yes"), "rx");
+    log.drain(10);
+    TEST_ASSERT_EQUAL(events, getSeq(log.lines.back()));
+}
+
+void setup()
+{
+    initializeTestEnvironment();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_messageEvent);
+    RUN_TEST(test_longMessageIsCutShort);
+    RUN_TEST(test_rangeTestAndLinkEvents);
+    RUN_TEST(test_fullQueueDropsWholeEvents);
+    exit(UNITY_END());
+}
+#else
+void setup()
+{
+    initializeTestEnvironment();
+    LOG_WARN("This test requires the ARCH_PORTDUINO variant");
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+void loop() {}
@@ -0,0 +1,178 @@
+#include "DebugConfiguration.h"
+#include "TestUtil.h"
+#include <unity.h>
+
+#ifdef ARCH_PORTDUINO
+#include "mesh/LinkQualityTable.h"
+
+static const NodeNum kSender = 0x11223344;
+
+void test_rollingMeans()
+{
+    LinkQualityTable table;
+    table.update(kSender, 10, -80, true, 0);
+    table.update(kSender, 10, -80, true, 0);
+    const LinkQualityTable::Entry *e = table.get(kSender);
+    TEST_ASSERT_NOT_NULL(e);
+    TEST_ASSERT_FALSE(LinkQualityTable::hasSnr(*e));
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 10, e->snrMean);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0, e->snrVar);
+
+    // The mean moves towards a new level, and the variance shows the jump
+    for (int i = 0; i < 20; i++)
+        table.update(kSender, 0, -100, true, 0);
+    TEST_ASSERT_TRUE(LinkQualityTable::hasSnr(*e));
+    TEST_ASSERT_FLOAT_WITHIN(0.1, 0, e->snrMean);
+    TEST_ASSERT_FLOAT_WITHIN(0.5, -100, e->rssiMean);
+
+    // Relayed copies don't count
+    for (int i = 0; i < 20; i++)
+        table.update(kSender, -15, -120, false, 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.1, 0, e->snrMean);
+
+    // A noisy link has a larger variance than a steady one
+    for (int i = 0; i < 20; i++)
+        table.update(kSender, (i & 1) ? 5 : -5, -90, true, 0);
+    TEST_ASSERT_GREATER_THAN(10, e->snrVar);
+}
+
+void test_lossRate()
+{
+    LinkQualityTable table;
+    table.update(kSender, 0, -90, true, 0);
+    TEST_ASSERT_EQUAL(-1, LinkQualityTable::getLossPercent(*table.get(kSender)));
+
+    // Every fourth one lost
+    for (uint32_t seq = 1; seq <= 40; seq++) {
+        if (seq % 4)
+            table.update(kSender, 0, -90, true, 0, seq);
+    }
+    TEST_ASSERT_EQUAL(25, LinkQualityTable::getLossPercent(*table.get(kSender)));
+}
+
+void test_burstLoss()
+{
+    LinkQualityTable table;
+    for (uint32_t seq = 1; seq <= 30; seq++) {
+        // A burst of 5 and a burst of 3
+        if ((seq < 5 || seq > 9) && (seq < 20 || seq > 22))
+            table.update(kSender, 0, -90, true, 0, seq);
+    }
+    const LinkQualityTable::Entry *e = table.get(kSender);
+    TEST_ASSERT_EQUAL(22, LinkQualityTable::getHeard(*e));
+    TEST_ASSERT_EQUAL(5, LinkQualityTable::getLongestBurst(*e));
+
+    // Once the longer burst slides out of the window, the shorter one is the longest
+    for (uint32_t seq = 31; seq <= 41; seq++)
+        table.update(kSender, 0, -90, true, 0, seq);
+    TEST_ASSERT_EQUAL(3, LinkQualityTable::getLongestBurst(*e));
+}
+
+void test_jitter()
+{
+    LinkQualityTable table;
+    uint32_t seq = 1, now = 0;
+    for (int i = 0; i < 50; i++) {
+        table.update(kSender, 0, -90, true, now, seq++);
+        now += 1000;
+    }
+    const LinkQualityTable::Entry *e = table.get(kSender);
+    TEST_ASSERT_FLOAT_WITHIN(1, 1000, e->intervalMsec);
+    TEST_ASSERT_FLOAT_WITHIN(1, 0, e->jitterMsec);
+
+    // A lost one doesn't count as a late one
+    seq++;
+    now += 1000;
+    table.update(kSender, 0, -90, true, now, seq++);
+    TEST_ASSERT_FLOAT_WITHIN(1, 0, e->jitterMsec);
+
+    // Arrivals 200ms early and late
+    for (int i = 0; i < 100; i++) {
+        now += (i & 1) ? 800 : 1200;
+        table.update(kSender, 0, -90, true, now, seq++);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(40, 200, e->jitterMsec);
+    TEST_ASSERT_FLOAT_WITHIN(100, 1000, e->intervalMsec);
+}
+
+void test_lateAndDuplicateCopies()
+{
+    LinkQualityTable table;
+    table.update(kSender, 0, -90, true, 0, 1);
+    table.update(kSender, 0, -90, true, 0, 3);
+    table.update(kSender, 0, -90, true, 0, 4);
+    TEST_ASSERT_EQUAL(25, LinkQualityTable::getLossPercent(*table.get(kSender)));
+
+    // 2 arrives late through a relay, then 4 again
+    table.update(kSender, 0, -90, false, 0, 2);
+    table.update(kSender, 0, -90, false, 0, 4);
+    const LinkQualityTable::Entry *e = table.get(kSender);
+    TEST_ASSERT_EQUAL(0, LinkQualityTable::getLossPercent(*e));
+    TEST_ASSERT_EQUAL(4, e->lastSeq);
+}
+
+void test_senderRestart()
+{
+    LinkQualityTable table;
+    for (uint32_t seq = 100; seq < 110; seq += 2)
+        table.update(kSender, 0, -90, true, 0, seq);
+    TEST_ASSERT_GREATER_THAN(0, LinkQualityTable::getLossPercent(*table.get(kSender)));
+
+    // Counting from 1 again starts a new window instead of looking like 100 lost
+    table.update(kSender, 0, -90, true, 0, 1);
+    table.update(kSender, 0, -90, true, 0, 2);
+    TEST_ASSERT_EQUAL(0, LinkQualityTable::getLossPercent(*table.get(kSender)));
+}
+
+void test_eviction()
+{
+    LinkQualityTable table;
+    uint32_t now = 0;
+    for (NodeNum n = 1; n <= LINKQUALITY_MAX_SENDERS; n++) {
+        table.update(n, 0, -90, true, now);
+        now += 10;
+    }
+    // Hearing 1 again makes 2 the one heard least recently
+    table.update(1, 0, -90, true, now);
+    now += 10;
+    table.update(LINKQUALITY_MAX_SENDERS + 1, 0, -90, true, now);
+
+    TEST_ASSERT_NOT_NULL(table.get(1));
+    TEST_ASSERT_NULL(table.get(2));
+    TEST_ASSERT_NOT_NULL(table.get(LINKQUALITY_MAX_SENDERS + 1));
+
+    int count = 0;
+    table.forEach([&](const LinkQualityTable::Entry &) {
+        count++;
+        return true;
+    });
+    TEST_ASSERT_EQUAL(LINKQUALITY_MAX_SENDERS, count);
+
+    table.clear();
+    TEST_ASSERT_NULL(table.get(1));
+}
+
+void setup()
+{
+    initializeTestEnvironment();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_rollingMeans);
+    RUN_TEST(test_lossRate);
+    RUN_TEST(test_burstLoss);
+    RUN_TEST(test_jitter);
+    RUN_TEST(test_lateAndDuplicateCopies);
+    RUN_TEST(test_senderRestart);
+    RUN_TEST(test_eviction);
+    exit(UNITY_END());
+}
+#else
+void setup()
+{
+    initializeTestEnvironment();
+    LOG_WARN("This test requires the ARCH_PORTDUINO variant");
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+void loop() {}
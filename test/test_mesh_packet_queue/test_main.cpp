@@ -0,0 +1,173 @@
+#include "DebugConfiguration.h"
+#include "TestUtil.h"
+#include <unity.h>
+
+#ifdef ARCH_PORTDUINO
+#include "mesh/MeshPacketQueue.h"
+#include "mesh/NodeDB.h"
+#include "mesh/RadioInterface.h"
+
+#include <memory>
+
+namespace
+{
+constexpr NodeNum kRemoteNode = 0x11223344;
+constexpr uint32_t kBenchmarkRounds = 20000;
+
+meshtastic_MeshPacket *makePacket(NodeNum from, PacketId id, meshtastic_MeshPacket_Priority priority, uint32_t txAfter = 0)
+{
+    meshtastic_MeshPacket *p = packetPool.allocZeroed();
+    p->from = from;
+    p->to = NODENUM_BROADCAST;
+    p->id = id;
+    p->hop_limit = 3;
+    p->priority = priority;
+    p->tx_after = txAfter;
+    return p;
+}
+
+void drain(MeshPacketQueue &queue)
+{
+    while (auto p = queue.dequeue())
+        packetPool.release(p);
+}
+} // namespace
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Higher priority goes first, late packets go last and equal priorities keep their arrival order.
+void test_ordering(void)
+{
+    MeshPacketQueue queue(MAX_TX_QUEUE);
+    queue.enqueue(makePacket(kRemoteNode, 1, meshtastic_MeshPacket_Priority_DEFAULT));
+    queue.enqueue(makePacket(kRemoteNode, 2, meshtastic_MeshPacket_Priority_DEFAULT, 1000));
+    queue.enqueue(makePacket(kRemoteNode, 3, meshtastic_MeshPacket_Priority_HIGH));
+    queue.enqueue(makePacket(kRemoteNode, 4, meshtastic_MeshPacket_Priority_DEFAULT));
+    queue.enqueue(makePacket(kRemoteNode, 5, meshtastic_MeshPacket_Priority_ACK));
+
+    const PacketId expected[] = {5, 3, 1, 4, 2};
+    TEST_ASSERT_EQUAL(MAX_TX_QUEUE - 5, queue.getFree());
+    for (PacketId id : expected) {
+        meshtastic_MeshPacket *p = queue.dequeue();
+        TEST_ASSERT_NOT_NULL(p);
+        TEST_ASSERT_EQUAL_UINT32(id, p->id);
+        packetPool.release(p);
+    }
+    TEST_ASSERT_TRUE(queue.empty());
+    TEST_ASSERT_NULL(queue.dequeue());
+}
+
+// Packets are found and removed by (from, id), honouring the tx window and hop limit filters.
+void test_indexedRemove(void)
+{
+    MeshPacketQueue queue(MAX_TX_QUEUE);
+    for (PacketId id = 1; id <= 8; id++)
+        queue.enqueue(makePacket(kRemoteNode + id % 2, id, meshtastic_MeshPacket_Priority_DEFAULT, id > 6 ? 1000 : 0));
+
+    TEST_ASSERT_TRUE(queue.find(kRemoteNode, 4));
+    TEST_ASSERT_FALSE(queue.find(kRemoteNode, 5));
+    TEST_ASSERT_NULL(queue.getPacketFromQueue(kRemoteNode + 1, 4));
+
+    // Late packets are skipped when only normal ones are asked for
+    TEST_ASSERT_NULL(queue.remove(kRemoteNode + 1, 7, true, false));
+    meshtastic_MeshPacket *p = queue.remove(kRemoteNode + 1, 7, false, true);
+    TEST_ASSERT_NOT_NULL(p);
+    packetPool.release(p);
+
+    // Hop limit filter
+    TEST_ASSERT_NULL(queue.remove(kRemoteNode, 4, true, true, 3));
+    p = queue.remove(kRemoteNode, 4, true, true, 4);
+    TEST_ASSERT_NOT_NULL(p);
+    packetPool.release(p);
+    TEST_ASSERT_FALSE(queue.find(kRemoteNode, 4));
+
+    // What is left keeps its order
+    const PacketId expected[] = {1, 2, 3, 5, 6, 8};
+    for (PacketId id : expected) {
+        p = queue.dequeue();
+        TEST_ASSERT_EQUAL_UINT32(id, p->id);
+        packetPool.release(p);
+    }
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+// A full queue evicts its lowest priority packet for a more important one, but never the other way around.
+void test_evictLowerPriority(void)
+{
+    MeshPacketQueue queue(4);
+    for (PacketId id = 1; id <= 4; id++)
+        TEST_ASSERT_TRUE(queue.enqueue(makePacket(kRemoteNode, id, meshtastic_MeshPacket_Priority_BACKGROUND)));
+
+    bool dropped = false;
+    meshtastic_MeshPacket *low = makePacket(kRemoteNode, 5, meshtastic_MeshPacket_Priority_MIN);
+    TEST_ASSERT_FALSE(queue.enqueue(low, &dropped));
+    TEST_ASSERT_TRUE(dropped);
+    packetPool.release(low);
+
+    TEST_ASSERT_TRUE(queue.enqueue(makePacket(kRemoteNode, 6, meshtastic_MeshPacket_Priority_HIGH), &dropped));
+    TEST_ASSERT_TRUE(dropped);
+    TEST_ASSERT_EQUAL(0, queue.getFree());
+    TEST_ASSERT_FALSE(queue.find(kRemoteNode, 4));
+    TEST_ASSERT_EQUAL_UINT32(6, queue.getFront()->id);
+    drain(queue);
+}
+
+// Keeps the queue full of rebroadcasts while removing and re-queueing random entries, as during a flood storm.
+void test_benchmarkFlood(void)
+{
+    MeshPacketQueue queue(MAX_TX_QUEUE);
+    PacketId nextId = 1;
+    uint32_t rng = 0x12345678;
+    uint32_t removed = 0;
+
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < kBenchmarkRounds; i++) {
+        while (queue.getFree() > 0) {
+            rng = rng * 1664525 + 1013904223; // LCG, good enough for picking priorities and delays
+            auto priority = (rng >> 24) & 1 ? meshtastic_MeshPacket_Priority_DEFAULT : meshtastic_MeshPacket_Priority_RELIABLE;
+            queue.enqueue(makePacket(kRemoteNode + nextId % 7, nextId, priority, (rng >> 16) & 1 ? 1000 : 0));
+            nextId++;
+        }
+
+        // Someone else rebroadcast a recent packet: cancel ours, then send the front one
+        PacketId id = nextId - 1 - (rng >> 8) % MAX_TX_QUEUE;
+        meshtastic_MeshPacket *p = queue.remove(kRemoteNode + id % 7, id);
+        if (p) {
+            removed++;
+            packetPool.release(p);
+        }
+        TEST_ASSERT_FALSE(queue.find(kRemoteNode + id % 7, id));
+        packetPool.release(queue.dequeue());
+    }
+    uint32_t elapsed = micros() - start;
+
+    LOG_INFO("MeshPacketQueue benchmark: %u rounds in %u us (%u ns/round), %u removed by id", kBenchmarkRounds, elapsed,
+             (uint32_t)((uint64_t)elapsed * 1000 / kBenchmarkRounds), removed);
+    TEST_ASSERT_GREATER_THAN(0, removed);
+    drain(queue);
+}
+
+void setup()
+{
+    initializeTestEnvironment();
+    const std::unique_ptr<NodeDB> testNodeDB(new NodeDB());
+    nodeDB = testNodeDB.get();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_ordering);
+    RUN_TEST(test_indexedRemove);
+    RUN_TEST(test_evictLowerPriority);
+    RUN_TEST(test_benchmarkFlood);
+    exit(UNITY_END());
+}
+#else
+void setup()
+{
+    initializeTestEnvironment();
+    LOG_WARN("This test requires the ARCH_PORTDUINO variant");
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+void loop() {}
@@ -0,0 +1,294 @@
+#include "MeshSim.h"
+#include "mesh/RadioInterface.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+// Same contention window bounds as RadioInterface
+static const uint8_t CWmin = 3;
+static const uint8_t CWmax = 8;
+
+// Per node, plenty for the packets of one simulation
+static const uint32_t historySize = 256;
+
+MeshSim::MeshSim(size_t numNodes, uint32_t seed) : MeshSim(numNodes, seed, Modem()) {}
+
+MeshSim::MeshSim(size_t numNodes, uint32_t seed, const Modem &_modem) : modem(_modem), rng(seed), nodes(numNodes)
+{
+    links.resize(numNodes * numNodes);
+    for (auto &node : nodes) {
+        node.history.reset(new PacketHistory(historySize));
+        node.txQueue.reset(new MeshPacketQueue(MAX_TX_QUEUE));
+    }
+
+    // Like RadioInterface::computeSlotTimeMsec() for sub-GHz radios, with CAD taking 2 symbols
+    float symbolTime = pow(2, modem.sf) / modem.bwKHz;
+    slotTimeMsec = 2.5 * symbolTime + 0.2 + 0.4 + 7;
+}
+
+MeshSim::~MeshSim()
+{
+    for (auto &node : nodes) {
+        while (meshtastic_MeshPacket *p = node.txQueue->dequeue())
+            packetPool.release(p);
+    }
+}
+
+void MeshSim::setRole(size_t node, meshtastic_Config_DeviceConfig_Role role)
+{
+    nodes[node].role = role;
+}
+
+void MeshSim::setLink(size_t a, size_t b, float snr, float lossProbability)
+{
+    for (auto dir : {std::make_pair(a, b), std::make_pair(b, a)}) {
+        Link &l = link(dir.first, dir.second);
+        if (!l.connected)
+            nodes[dir.first].neighbours.push_back(dir.second);
+        l.connected = true;
+        l.snr = snr;
+        l.lossProbability = lossProbability;
+    }
+}
+
+void MeshSim::makeChain(float snr, float lossProbability)
+{
+    for (size_t i = 0; i + 1 < nodes.size(); i++)
+        setLink(i, i + 1, snr, lossProbability);
+}
+
+/// The LoRa time on air formula from the Semtech datasheets, explicit header and CRC on
+uint32_t MeshSim::getPacketTime(size_t payloadLen) const
+{
+    float symbolTime = pow(2, modem.sf) / modem.bwKHz;
+    int lowDataRateOptimize = symbolTime > 16 ? 1 : 0;
+    int pl = payloadLen + MESHTASTIC_HEADER_LENGTH;
+    float payloadSymbols =
+        8 + std::max(ceilf((8.0f * pl - 4 * modem.sf + 28 + 16) / (4 * (modem.sf - 2 * lowDataRateOptimize))) * modem.cr, 0.0f);
+    return (modem.preambleLength + 4.25f + payloadSymbols) * symbolTime;
+}
+
+PacketId MeshSim::send(size_t from, NodeNum to, size_t payloadLen, uint8_t hopLimit)
+{
+    assert(payloadLen <= sizeof(meshtastic_MeshPacket_encrypted_t::bytes));
+    Node &node = nodes[from];
+
+    meshtastic_MeshPacket *p = packetPool.allocZeroed();
+    p->from = getNodeNum(from);
+    p->to = to;
+    p->id = nextId++;
+    p->hop_limit = p->hop_start = hopLimit;
+    p->relay_node = p->from & 0xFF;
+    p->next_hop = NO_NEXT_HOP_PREFERENCE;
+    p->priority = meshtastic_MeshPacket_Priority_DEFAULT;
+    p->transport_mechanism = meshtastic_MeshPacket_TransportMechanism_TRANSPORT_LORA;
+    p->which_payload_variant = meshtastic_MeshPacket_encrypted_tag;
+    p->encrypted.size = payloadLen;
+
+    Delivery &d = deliveries[p->id];
+    d.sentMsec = nowMsec;
+    d.receivedMsec.assign(nodes.size(), UINT32_MAX);
+
+    PacketId id = p->id;
+    node.history->wasSeenRecently(p); // So we ignore the relays of our own packet
+    if (!node.txQueue->enqueue(p)) {
+        stats.queueDrops++;
+        packetPool.release(p);
+    } else if (!node.timerPending && node.transmitting < 0) {
+        armTxTimer(from, getTxDelayMsec());
+    }
+    return id;
+}
+
+void MeshSim::run(uint32_t untilMsec)
+{
+    while (!events.empty() && events.top().time <= untilMsec) {
+        Event e = events.top();
+        events.pop();
+        nowMsec = e.time;
+        if (e.type == TX_TIMER)
+            onTxTimer(e.node, e.arg);
+        else
+            onTxEnd(e.arg);
+    }
+}
+
+uint32_t MeshSim::getLatency(PacketId id, size_t node) const
+{
+    auto it = deliveries.find(id);
+    if (it == deliveries.end() || it->second.receivedMsec[node] == UINT32_MAX)
+        return UINT32_MAX;
+    return it->second.receivedMsec[node] - it->second.sentMsec;
+}
+
+size_t MeshSim::getDeliveryCount(PacketId id) const
+{
+    auto it = deliveries.find(id);
+    if (it == deliveries.end())
+        return 0;
+    return std::count_if(it->second.receivedMsec.begin(), it->second.receivedMsec.end(),
+                         [](uint32_t t) { return t != UINT32_MAX; });
+}
+
+void MeshSim::schedule(uint32_t delayMsec, EventType type, size_t node, uint32_t arg)
+{
+    events.push(Event{nowMsec + delayMsec, nextSeq++, type, node, arg});
+}
+
+void MeshSim::armTxTimer(size_t node, uint32_t delayMsec)
+{
+    Node &n = nodes[node];
+    n.timerPending = true;
+    schedule(delayMsec, TX_TIMER, node, ++n.timerGeneration);
+}
+
+uint32_t MeshSim::getTxDelayMsec()
+{
+    // The simulated channel utilization is not tracked, so this is the window of an idle channel
+    return randomBetween(0, 1 << CWmin) * slotTimeMsec;
+}
+
+uint32_t MeshSim::getTxDelayMsecWeighted(size_t node, float snr)
+{
+    // Same mapping as RadioInterface::getCWsize(), low SNR relays go first
+    const int32_t SNR_MIN = -20, SNR_MAX = 10;
+    int32_t clamped = std::min(std::max((int32_t)snr, SNR_MIN), SNR_MAX);
+    uint8_t CWsize = (clamped - SNR_MIN) * (CWmax - CWmin) / (SNR_MAX - SNR_MIN) + CWmin;
+
+    if (nodes[node].role == meshtastic_Config_DeviceConfig_Role_ROUTER)
+        return randomBetween(0, 2 * CWsize) * slotTimeMsec;
+    return (2 * CWmax * slotTimeMsec) + randomBetween(0, 1 << CWsize) * slotTimeMsec;
+}
+
+bool MeshSim::isChannelActive(size_t node)
+{
+    // A transmission that started in this very millisecond can't have been detected yet
+    for (size_t t : nodes[node].receiving) {
+        if (transmissions[t].start < nowMsec)
+            return true;
+    }
+    return false;
+}
+
+void MeshSim::onTxTimer(size_t node, uint32_t generation)
+{
+    Node &n = nodes[node];
+    if (generation != n.timerGeneration)
+        return; // Superseded by a newer timer
+    n.timerPending = false;
+
+    if (n.transmitting >= 0 || n.txQueue->empty())
+        return;
+
+    if (isChannelActive(node)) {
+        // Like RadioLibInterface, back off for a random contention window and check again
+        armTxTimer(node, getTxDelayMsec());
+        return;
+    }
+
+    meshtastic_MeshPacket *p = n.txQueue->dequeue();
+    uint32_t airtime = getPacketTime(p->encrypted.size);
+
+    Transmission tx;
+    tx.sender = node;
+    tx.packet = *p;
+    tx.start = nowMsec;
+    tx.end = nowMsec + airtime;
+    packetPool.release(p);
+
+    uint32_t txIndex = transmissions.size();
+    for (size_t neighbour : n.neighbours) {
+        Node &r = nodes[neighbour];
+        bool lost = false;
+        if (r.transmitting >= 0) {
+            lost = true; // Half duplex, it can't hear us while sending
+        } else {
+            // Anything this node was already hearing collides with us, and we with it
+            for (size_t other : r.receiving) {
+                for (auto &rx : transmissions[other].receptions) {
+                    if (rx.node == neighbour)
+                        rx.lost = true;
+                }
+                lost = true;
+            }
+            r.receiving.push_back(txIndex);
+        }
+        tx.receptions.push_back(Reception{neighbour, lost});
+    }
+    transmissions.push_back(tx);
+
+    n.transmitting = txIndex;
+    stats.transmissions++;
+    stats.airtimeMsec += airtime;
+    schedule(airtime, TX_END, node, txIndex);
+}
+
+void MeshSim::onTxEnd(uint32_t txIndex)
+{
+    // Copy, delivering may start transmissions and grow the vector
+    Transmission tx = transmissions[txIndex];
+    Node &sender = nodes[tx.sender];
+    sender.transmitting = -1;
+
+    for (const auto &rx : tx.receptions) {
+        Node &r = nodes[rx.node];
+        auto it = std::find(r.receiving.begin(), r.receiving.end(), txIndex);
+        if (it != r.receiving.end())
+            r.receiving.erase(it);
+
+        const Link &l = link(tx.sender, rx.node);
+        if (rx.lost) {
+            stats.collisions++;
+        } else if (l.lossProbability > 0 && (rng() % 10000) < l.lossProbability * 10000) {
+            stats.linkLosses++;
+        } else {
+            onReceive(rx.node, tx.packet, l.snr);
+        }
+    }
+
+    // Like RadioLibInterface::setTransmitDelay(), local packets wait a plain contention window and relays a weighted one
+    if (!sender.txQueue->empty() && !sender.timerPending) {
+        const meshtastic_MeshPacket *front = sender.txQueue->getFront();
+        armTxTimer(tx.sender, front->rx_snr == 0 ? getTxDelayMsec() : getTxDelayMsecWeighted(tx.sender, front->rx_snr));
+    }
+}
+
+void MeshSim::onReceive(size_t node, const meshtastic_MeshPacket &received, float snr)
+{
+    Node &n = nodes[node];
+    meshtastic_MeshPacket p = received;
+    p.rx_snr = snr;
+
+    if (n.history->wasSeenRecently(&p)) {
+        stats.duplicates++;
+        // Like FloodingRouter::perhapsCancelDupe(), only routers insist on relaying what someone else already relayed
+        if (n.role != meshtastic_Config_DeviceConfig_Role_ROUTER) {
+            meshtastic_MeshPacket *queued = n.txQueue->remove(p.from, p.id);
+            if (queued) {
+                stats.relaysCancelled++;
+                packetPool.release(queued);
+            }
+        }
+        return;
+    }
+
+    Delivery &d = deliveries[p.id];
+    if (d.receivedMsec[node] == UINT32_MAX)
+        d.receivedMsec[node] = nowMsec;
+
+    if (p.to == getNodeNum(node) || p.hop_limit == 0 || n.role == meshtastic_Config_DeviceConfig_Role_CLIENT_MUTE)
+        return;
+
+    meshtastic_MeshPacket *relay = packetPool.allocCopy(p);
+    relay->hop_limit--;
+    relay->relay_node = getNodeNum(node) & 0xFF;
+    relay->tx_after = 0;
+    if (!n.txQueue->enqueue(relay)) {
+        stats.queueDrops++;
+        packetPool.release(relay);
+        return;
+    }
+    if (!n.timerPending && n.transmitting < 0)
+        armTxTimer(node, getTxDelayMsecWeighted(node, snr));
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "mesh/MeshPacketQueue.h"
+#include "mesh/PacketHistory.h"
+
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <vector>
+
+/**
+ * A deterministic discrete-event simulation of a LoRa mesh, to test flooding on large topologies (like relay chains through a
+ * cave) faster than real time.
+ *
+ * Every node gets its own PacketHistory and MeshPacketQueue and follows the relay rules of FloodingRouter and
+ * RadioLibInterface: SNR weighted contention windows, channel activity detection before transmitting, half duplex radios,
+ * overlapping receptions destroying each other, and dropping a queued rebroadcast when another node is heard relaying it.
+ * Time is virtual, links come from a loss/SNR matrix and all randomness comes from a seeded generator, so a run only depends
+ * on its seed.
+ */
+class MeshSim
+{
+  public:
+    /// LoRa modem settings used for airtime and slot time, the defaults are LongFast
+    struct Modem {
+        uint8_t sf = 11;
+        float bwKHz = 250;
+        uint8_t cr = 5; // coding rate 4/cr
+        uint16_t preambleLength = 16;
+    };
+
+    /// Totals over the whole run
+    struct Stats {
+        uint32_t transmissions = 0;   // Packets put on the air, originals and relays
+        uint32_t airtimeMsec = 0;     // Sum of the airtime of all transmissions
+        uint32_t collisions = 0;      // Receptions lost to an overlapping transmission or because the receiver was sending
+        uint32_t linkLosses = 0;      // Receptions lost to the link loss probability
+        uint32_t duplicates = 0;      // Receptions of packets the receiver had already seen
+        uint32_t relaysCancelled = 0; // Queued rebroadcasts dropped because another node was heard relaying them
+        uint32_t queueDrops = 0;      // Rebroadcasts that didn't fit in the TX queue
+    };
+
+    MeshSim(size_t numNodes, uint32_t seed);
+    MeshSim(size_t numNodes, uint32_t seed, const Modem &modem);
+    ~MeshSim();
+
+    size_t getNumNodes() const { return nodes.size(); }
+    NodeNum getNodeNum(size_t node) const { return firstNodeNum + node; }
+
+    /// Only CLIENT_MUTE and ROUTER change behaviour, every other role floods like a CLIENT
+    void setRole(size_t node, meshtastic_Config_DeviceConfig_Role role);
+
+    /// Connect two nodes in both directions
+    void setLink(size_t a, size_t b, float snr, float lossProbability = 0);
+
+    /// Connect every node to the next one
+    void makeChain(float snr, float lossProbability = 0);
+
+    /// Originate a packet of payloadLen bytes at node 'from', returns its id
+    PacketId send(size_t from, NodeNum to, size_t payloadLen, uint8_t hopLimit);
+
+    /// Process events until none are left or the virtual clock would pass untilMsec
+    void run(uint32_t untilMsec = UINT32_MAX);
+
+    uint32_t now() const { return nowMsec; }
+    const Stats &getStats() const { return stats; }
+
+    /// @return the time from sending packet 'id' until 'node' first received it, or UINT32_MAX if it never did
+    uint32_t getLatency(PacketId id, size_t node) const;
+
+    /// @return how many nodes other than the originator received packet 'id'
+    size_t getDeliveryCount(PacketId id) const;
+
+    /// @return the airtime of a packet with payloadLen bytes of payload
+    uint32_t getPacketTime(size_t payloadLen) const;
+
+    uint32_t getSlotTimeMsec() const { return slotTimeMsec; }
+
+  private:
+    static constexpr NodeNum firstNodeNum = 0x5100000;
+
+    struct Link {
+        bool connected = false;
+        float snr = 0;
+        float lossProbability = 0;
+    };
+
+    struct Reception {
+        size_t node;
+        bool lost;
+    };
+
+    struct Transmission {
+        size_t sender;
+        meshtastic_MeshPacket packet;
+        uint32_t start, end;
+        std::vector<Reception> receptions;
+    };
+
+    struct Node {
+        meshtastic_Config_DeviceConfig_Role role = meshtastic_Config_DeviceConfig_Role_CLIENT;
+        std::unique_ptr<PacketHistory> history;
+        std::unique_ptr<MeshPacketQueue> txQueue;
+        std::vector<size_t> neighbours;
+        std::vector<size_t> receiving; // Transmissions this node is currently hearing
+        int32_t transmitting = -1;     // Transmission this node is sending, or -1
+        uint32_t timerGeneration = 0;  // Bumped to invalidate a pending TX timer
+        bool timerPending = false;
+    };
+
+    enum EventType { TX_TIMER, TX_END };
+
+    struct Event {
+        uint32_t time;
+        uint32_t seq; // Keeps events at the same time in the order they were scheduled
+        EventType type;
+        size_t node;
+        uint32_t arg; // Timer generation for TX_TIMER, transmission index for TX_END
+
+        bool operator>(const Event &e) const { return time != e.time ? time > e.time : seq > e.seq; }
+    };
+
+    struct Delivery {
+        uint32_t sentMsec;
+        std::vector<uint32_t> receivedMsec; // Per node, UINT32_MAX until received
+    };
+
+    Modem modem;
+    uint32_t slotTimeMsec;
+    uint32_t nowMsec = 0;
+    uint32_t nextSeq = 0;
+    PacketId nextId = 1;
+    std::mt19937 rng;
+    std::vector<Node> nodes;
+    std::vector<Link> links; // nodes.size() * nodes.size(), links[from * n + to]
+    std::vector<Transmission> transmissions;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    std::map<PacketId, Delivery> deliveries;
+    Stats stats;
+
+    Link &link(size_t from, size_t to) { return links[from * nodes.size() + to]; }
+    uint32_t randomBetween(uint32_t min, uint32_t max) { return min + rng() % (max - min); }
+
+    void schedule(uint32_t delayMsec, EventType type, size_t node, uint32_t arg);
+    void armTxTimer(size_t node, uint32_t delayMsec);
+
+    /// Same contention windows as RadioInterface::getTxDelayMsec() and getTxDelayMsecWeighted()
+    uint32_t getTxDelayMsec();
+    uint32_t getTxDelayMsecWeighted(size_t node, float snr);
+
+    bool isChannelActive(size_t node);
+    void onTxTimer(size_t node, uint32_t generation);
+    void onTxEnd(uint32_t txIndex);
+    void onReceive(size_t node, const meshtastic_MeshPacket &p, float snr);
+};
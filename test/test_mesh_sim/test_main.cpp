@@ -0,0 +1,166 @@
+#include "DebugConfiguration.h"
+#include "TestUtil.h"
+#include <unity.h>
+
+#ifdef ARCH_PORTDUINO
+#include "MeshSim.h"
+#include "mesh/NodeDB.h"
+
+#include <memory>
+
+namespace
+{
+constexpr size_t kCaveNodes = 24;
+constexpr size_t kPayloadLen = 40;
+constexpr float kCaveSnr = -5;
+
+struct StrategyResult {
+    MeshSim::Stats stats;
+    size_t delivered;
+    size_t expected;
+};
+
+/// Floods kPackets broadcasts from random nodes of a dense cluster where everybody has the same role
+StrategyResult floodCluster(meshtastic_Config_DeviceConfig_Role role, uint32_t seed)
+{
+    constexpr size_t kNodes = 12;
+    constexpr size_t kPackets = 20;
+    MeshSim sim(kNodes, seed);
+    for (size_t a = 0; a < kNodes; a++) {
+        sim.setRole(a, role);
+        for (size_t b = a + 1; b < kNodes; b++)
+            sim.setLink(a, b, -10 + (float)((a * 7 + b * 3) % 18));
+    }
+
+    StrategyResult result = {};
+    for (size_t i = 0; i < kPackets; i++) {
+        PacketId id = sim.send((i * 5) % kNodes, NODENUM_BROADCAST, kPayloadLen, 3);
+        sim.run();
+        result.delivered += sim.getDeliveryCount(id);
+        result.expected += kNodes - 1;
+    }
+    result.stats = sim.getStats();
+    return result;
+}
+
+void logStats(const char *name, const MeshSim::Stats &s)
+{
+    LOG_INFO("%s: %u tx, %u ms airtime, %u collisions, %u lost, %u dupes, %u relays cancelled", name, s.transmissions,
+             s.airtimeMsec, s.collisions, s.linkLosses, s.duplicates, s.relaysCancelled);
+}
+} // namespace
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// A broadcast walks down a relay chain through a cave one hop at a time, and stops when it runs out of hops.
+void test_caveChain(void)
+{
+    MeshSim sim(kCaveNodes, 1);
+    sim.makeChain(kCaveSnr);
+
+    // Flamingo builds allow HOP_MAX 31, enough for the whole chain
+    uint32_t start = millis();
+    PacketId id = sim.send(0, NODENUM_BROADCAST, kPayloadLen, kCaveNodes - 1);
+    sim.run();
+    uint32_t elapsed = millis() - start;
+
+    TEST_ASSERT_EQUAL(kCaveNodes - 1, sim.getDeliveryCount(id));
+    uint32_t last = 0;
+    for (size_t node = 1; node < kCaveNodes; node++) {
+        uint32_t latency = sim.getLatency(id, node);
+        TEST_ASSERT_GREATER_THAN(last + sim.getPacketTime(kPayloadLen) - 1, latency);
+        last = latency;
+    }
+    // Every node relays once, the last one to nobody new
+    TEST_ASSERT_EQUAL(kCaveNodes, sim.getStats().transmissions);
+    TEST_ASSERT_EQUAL(0, sim.getStats().collisions);
+    TEST_ASSERT_LESS_THAN(sim.now(), elapsed);
+    LOG_INFO("Cave chain: %u hops in %u ms of virtual time, %u ms of real time", kCaveNodes - 1, last, elapsed);
+    logStats("Cave chain", sim.getStats());
+
+    // Seven relays after the original transmission, so eight hops
+    PacketId limited = sim.send(0, NODENUM_BROADCAST, kPayloadLen, 7);
+    sim.run();
+    TEST_ASSERT_EQUAL(8, sim.getDeliveryCount(limited));
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, sim.getLatency(limited, 8));
+    TEST_ASSERT_EQUAL(UINT32_MAX, sim.getLatency(limited, 9));
+}
+
+// A direct message stops at its destination instead of flooding the rest of the chain.
+void test_directMessageStopsAtDestination(void)
+{
+    MeshSim sim(kCaveNodes, 2);
+    sim.makeChain(kCaveSnr);
+
+    PacketId id = sim.send(0, sim.getNodeNum(5), kPayloadLen, kCaveNodes - 1);
+    sim.run();
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, sim.getLatency(id, 5));
+    TEST_ASSERT_EQUAL(UINT32_MAX, sim.getLatency(id, 6));
+    TEST_ASSERT_EQUAL(5, sim.getStats().transmissions);
+}
+
+// Lossy links lose packets, and the same seed replays exactly the same run.
+void test_lossyChainIsDeterministic(void)
+{
+    MeshSim::Stats runs[2];
+    size_t delivered[2] = {0, 0};
+    for (int run = 0; run < 2; run++) {
+        MeshSim sim(kCaveNodes, 3);
+        sim.makeChain(kCaveSnr, 0.05);
+        for (int i = 0; i < 20; i++) {
+            PacketId id = sim.send(0, NODENUM_BROADCAST, kPayloadLen, kCaveNodes - 1);
+            sim.run();
+            delivered[run] += sim.getDeliveryCount(id);
+        }
+        runs[run] = sim.getStats();
+    }
+
+    TEST_ASSERT_GREATER_THAN(0, runs[0].linkLosses);
+    TEST_ASSERT_EQUAL(runs[0].transmissions, runs[1].transmissions);
+    TEST_ASSERT_EQUAL(runs[0].airtimeMsec, runs[1].airtimeMsec);
+    TEST_ASSERT_EQUAL(runs[0].linkLosses, runs[1].linkLosses);
+    TEST_ASSERT_EQUAL(delivered[0], delivered[1]);
+    logStats("Lossy chain", runs[0]);
+}
+
+// Clients drop rebroadcasts they heard someone else make, routers always relay: same reach, less airtime for clients.
+void test_compareStrategies(void)
+{
+    StrategyResult clients = floodCluster(meshtastic_Config_DeviceConfig_Role_CLIENT, 4);
+    StrategyResult routers = floodCluster(meshtastic_Config_DeviceConfig_Role_ROUTER, 4);
+
+    LOG_INFO("Managed flooding delivered %u/%u, always relaying %u/%u", clients.delivered, clients.expected, routers.delivered,
+             routers.expected);
+    logStats("Managed flooding", clients.stats);
+    logStats("Always relaying", routers.stats);
+
+    TEST_ASSERT_EQUAL(clients.expected, clients.delivered);
+    TEST_ASSERT_GREATER_THAN(0, clients.stats.relaysCancelled);
+    TEST_ASSERT_EQUAL(0, routers.stats.relaysCancelled);
+    TEST_ASSERT_LESS_THAN(routers.stats.airtimeMsec, clients.stats.airtimeMsec);
+}
+
+void setup()
+{
+    initializeTestEnvironment();
+    const std::unique_ptr<NodeDB> testNodeDB(new NodeDB());
+    nodeDB = testNodeDB.get();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_caveChain);
+    RUN_TEST(test_directMessageStopsAtDestination);
+    RUN_TEST(test_lossyChainIsDeterministic);
+    RUN_TEST(test_compareStrategies);
+    exit(UNITY_END());
+}
+#else
+void setup()
+{
+    initializeTestEnvironment();
+    LOG_WARN("This test requires the ARCH_PORTDUINO variant");
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+void loop() {}
@@ -503,6 +503,34 @@ void test_sendQueued(void)
     TEST_ASSERT_EQUAL(decoded.id, env.packet->id);
 }
 
+// Verify a full queue is published in order after reconnecting, more than one batch at a time.
+void test_sendQueuedBacklog(void)
+{
+    pubsub->connected_ = false;
+    pubsub->refuseConnection_ = true;
+    TEST_ASSERT_TRUE(loopUntil([] { return !unitTest->getPubSub().connected(); }));
+
+    meshtastic_MeshPacket p = decoded;
+    for (int i = 0; i < MAX_MQTT_QUEUE; i++) {
+        p.id = 100 + i;
+        mqtt->onSend(p, p, 0);
+    }
+    TEST_ASSERT_EQUAL(MAX_MQTT_QUEUE, unitTest->queueSize());
+    static_assert(MAX_MQTT_QUEUE > MQTT_DRAIN_MAX_MESSAGES);
+
+    pubsub->refuseConnection_ = false;
+    TEST_ASSERT_TRUE(loopUntil([] { return pubsub->published_.size() == MAX_MQTT_QUEUE; }));
+
+    TEST_ASSERT_EQUAL(0, unitTest->queueSize());
+    uint32_t id = 100;
+    for (const auto &[topic, payload] : pubsub->published_) {
+        const DecodedServiceEnvelope &env = std::get<DecodedServiceEnvelope>(payload);
+        TEST_ASSERT_EQUAL_STRING("msh/2/e/test/!12345678", topic.c_str());
+        TEST_ASSERT_TRUE(env.validDecode);
+        TEST_ASSERT_EQUAL(id++, env.packet->id);
+    }
+}
+
 // Verify reconnecting with the proxy enabled does not reconnect to a MQTT server.
 void test_reconnectProxyDoesNotReconnectMqtt(void)
 {
@@ -886,6 +914,7 @@ void setup()
     RUN_TEST(test_noRangeTestAppOnDefaultServer);
     RUN_TEST(test_noDetectionSensorAppOnDefaultServer);
     RUN_TEST(test_sendQueued);
+    RUN_TEST(test_sendQueuedBacklog);
     RUN_TEST(test_reconnectProxyDoesNotReconnectMqtt);
     RUN_TEST(test_receiveEmptyMeshPacket);
     RUN_TEST(test_receiveDecodedProto);
@@ -0,0 +1,152 @@
+#include "DebugConfiguration.h"
+#include "TestUtil.h"
+#include <unity.h>
+
+#ifdef ARCH_PORTDUINO
+#include "mesh/NodeDB.h"
+#include "mesh/PacketHistory.h"
+
+#include <memory>
+
+namespace
+{
+constexpr uint32_t kHistorySize = 200;
+constexpr uint32_t kNumSenders = 100;
+constexpr uint32_t kBenchmarkPackets = 100000;
+
+meshtastic_MeshPacket makePacket(NodeNum from, PacketId id)
+{
+    meshtastic_MeshPacket p = meshtastic_MeshPacket_init_zero;
+    p.from = from;
+    p.to = NODENUM_BROADCAST;
+    p.id = id;
+    p.hop_limit = 3;
+    p.next_hop = NO_NEXT_HOP_PREFERENCE;
+    p.relay_node = 0x42;
+    return p;
+}
+} // namespace
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// A packet is only reported as seen after it was recorded.
+void test_seenAfterInsert(void)
+{
+    PacketHistory history(kHistorySize);
+    meshtastic_MeshPacket p = makePacket(0x11223344, 1);
+
+    TEST_ASSERT_FALSE(history.wasSeenRecently(&p));
+    TEST_ASSERT_TRUE(history.wasSeenRecently(&p));
+    TEST_ASSERT_EQUAL(1, history.getNumRecentPackets());
+}
+
+// Lookups without update don't add records.
+void test_lookupWithoutUpdate(void)
+{
+    PacketHistory history(kHistorySize);
+    meshtastic_MeshPacket p = makePacket(0x11223344, 1);
+
+    TEST_ASSERT_FALSE(history.wasSeenRecently(&p, false));
+    TEST_ASSERT_FALSE(history.wasSeenRecently(&p, false));
+    TEST_ASSERT_EQUAL(0, history.getNumRecentPackets());
+}
+
+// When full, the least recently stored record is the one evicted.
+void test_evictsOldest(void)
+{
+    PacketHistory history(kHistorySize);
+    for (PacketId id = 1; id <= kHistorySize; id++) {
+        meshtastic_MeshPacket p = makePacket(0x11223344, id);
+        history.wasSeenRecently(&p);
+    }
+
+    // Refresh the first packet, so the second becomes the oldest
+    meshtastic_MeshPacket first = makePacket(0x11223344, 1);
+    TEST_ASSERT_TRUE(history.wasSeenRecently(&first));
+
+    meshtastic_MeshPacket extra = makePacket(0x11223344, kHistorySize + 1);
+    TEST_ASSERT_FALSE(history.wasSeenRecently(&extra));
+    TEST_ASSERT_EQUAL(kHistorySize, history.getNumRecentPackets());
+
+    meshtastic_MeshPacket second = makePacket(0x11223344, 2);
+    TEST_ASSERT_TRUE(history.wasSeenRecently(&first, false));
+    TEST_ASSERT_FALSE(history.wasSeenRecently(&second, false));
+    TEST_ASSERT_TRUE(history.wasSeenRecently(&extra, false));
+}
+
+// Relayers stay attached to the record across lookups.
+void test_relayerTracking(void)
+{
+    PacketHistory history(kHistorySize);
+    uint8_t ourRelayID = nodeDB->getLastByteOfNodeNum(nodeDB->getNodeNum());
+    meshtastic_MeshPacket p = makePacket(0x11223344, 7);
+    p.relay_node = ourRelayID;
+    history.wasSeenRecently(&p);
+
+    bool wasSole = false;
+    TEST_ASSERT_TRUE(history.wasRelayer(ourRelayID, p.id, p.from, &wasSole));
+    TEST_ASSERT_TRUE(wasSole);
+    history.removeRelayer(ourRelayID, p.id, p.from);
+    TEST_ASSERT_FALSE(history.wasRelayer(ourRelayID, p.id, p.from));
+    TEST_ASSERT_TRUE(history.wasSeenRecently(&p, false));
+}
+
+// Replays kBenchmarkPackets synthetic packets, a third of them duplicates of recently heard ones, as during a flood storm.
+void test_benchmarkFlood(void)
+{
+    PacketHistory history(kHistorySize);
+    PacketId nextId[kNumSenders] = {0};
+    uint32_t duplicatesSent = 0, duplicatesSeen = 0;
+    uint32_t rng = 0x12345678;
+
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < kBenchmarkPackets; i++) {
+        rng = rng * 1664525 + 1013904223; // LCG, good enough for picking senders
+        uint32_t sender = (rng >> 8) % kNumSenders;
+        bool duplicate = (i % 3 == 0) && nextId[sender] > 0;
+        if (!duplicate)
+            nextId[sender]++;
+        meshtastic_MeshPacket p = makePacket(0x10000 + sender, nextId[sender]);
+        bool seen = history.wasSeenRecently(&p);
+        if (duplicate) {
+            duplicatesSent++;
+            if (seen)
+                duplicatesSeen++;
+        } else {
+            TEST_ASSERT_FALSE(seen);
+        }
+    }
+    uint32_t elapsed = micros() - start;
+
+    LOG_INFO("PacketHistory benchmark: %u packets in %u us (%u ns/packet), %u/%u duplicates caught", kBenchmarkPackets, elapsed,
+             (uint32_t)((uint64_t)elapsed * 1000 / kBenchmarkPackets), duplicatesSeen, duplicatesSent);
+    TEST_ASSERT_EQUAL(kHistorySize, history.getNumRecentPackets());
+    // Any sender's latest packet is far less than kHistorySize packets old most of the time
+    TEST_ASSERT_GREATER_THAN(duplicatesSent / 2, duplicatesSeen);
+}
+
+void setup()
+{
+    initializeTestEnvironment();
+    const std::unique_ptr<NodeDB> testNodeDB(new NodeDB());
+    nodeDB = testNodeDB.get();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_seenAfterInsert);
+    RUN_TEST(test_lookupWithoutUpdate);
+    RUN_TEST(test_evictsOldest);
+    RUN_TEST(test_relayerTracking);
+    RUN_TEST(test_benchmarkFlood);
+    exit(UNITY_END());
+}
+#else
+void setup()
+{
+    initializeTestEnvironment();
+    LOG_WARN("This test requires the ARCH_PORTDUINO variant");
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+void loop() {}
@@ -0,0 +1,368 @@
+#include "DebugConfiguration.h"
+#include "TestUtil.h"
+#include <unity.h>
+
+#ifdef ARCH_PORTDUINO
+#include "mesh/SerialLink.h"
+#include "serialization/cobs.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace
+{
+constexpr size_t kPayloads = 200;
+constexpr uint32_t kTimeoutMsec = 60 * 1000;
+
+/// One direction of a serial line: bytes come out latencyMsec after they went in, unless they get lost or corrupted
+class LossyLine : public Stream
+{
+  public:
+    uint32_t latencyMsec = 2;
+    uint32_t lossPerMillion = 0;    // Chance of each byte getting lost
+    uint32_t corruptPerMillion = 0; // Chance of each byte getting a bit flipped
+
+    explicit LossyLine(uint32_t seed) : rng(seed) {}
+
+    size_t write(uint8_t c) override
+    {
+        if (chance(lossPerMillion))
+            return 1;
+        if (chance(corruptPerMillion))
+            c ^= 1 << (nextRandom() % 8);
+        bytes.push_back({millis() + latencyMsec, c});
+        return 1;
+    }
+
+    int available() override
+    {
+        int n = 0;
+        for (auto &b : bytes) {
+            if ((int32_t)(millis() - b.arrivalMsec) < 0)
+                break;
+            n++;
+        }
+        return n;
+    }
+
+    int read() override
+    {
+        if (!available())
+            return -1;
+        uint8_t c = bytes.front().c;
+        bytes.pop_front();
+        return c;
+    }
+
+    int peek() override { return available() ? bytes.front().c : -1; }
+
+  private:
+    struct Byte {
+        uint32_t arrivalMsec;
+        uint8_t c;
+    };
+    std::deque<Byte> bytes;
+    uint32_t rng;
+
+    uint32_t nextRandom()
+    {
+        rng = rng * 1664525 + 1013904223; // LCG, good enough for picking bytes to break
+        return rng >> 8;
+    }
+    bool chance(uint32_t perMillion) { return perMillion && nextRandom() % 1000000 < perMillion; }
+};
+
+/// One side of the link: an ARQ writing to one line, and a COBS frame reader on the other
+class Endpoint
+{
+  public:
+    std::vector<uint32_t> received; // Payload numbers, in delivery order
+    uint32_t badFrames = 0;
+    uint32_t gaps = 0;   // Times the ARQ said payloads went missing
+    uint32_t txLost = 0; // Times the ARQ said the peer may have missed ours
+
+    Endpoint(LossyLine *out, LossyLine *_in, uint8_t epoch)
+        : in(_in), arq(
+                       out, [this](const uint8_t *payload, size_t len) { onPayload(payload, len); }, epoch,
+                       [this]() { txLost++; })
+    {
+    }
+
+    SerialLinkArq &getArq() { return arq; }
+
+    /// Payload n is 4 bytes of n followed by a pattern, its length depends on n
+    bool send(uint32_t n)
+    {
+        uint8_t payload[SLINK_ARQ_MAX_PAYLOAD];
+        size_t len = 4 + (n * 37) % 300;
+        for (size_t i = 0; i < len; i++)
+            payload[i] = i < 4 ? n >> (8 * i) : (uint8_t)(n + i);
+        return arq.send(payload, len);
+    }
+
+    void poll()
+    {
+        while (in->available()) {
+            uint8_t c = in->read();
+            if (c != 0) {
+                if (frame.size() < COBS_ENCODE_DST_BUF_LEN_MAX(SLINK_COBS_MAX_BODY))
+                    frame.push_back(c);
+                continue;
+            }
+            if (!frame.empty()) {
+                uint8_t body[SLINK_COBS_MAX_BODY];
+                int len = slinkDecodeFrame(frame.data(), frame.size(), body, sizeof(body));
+                if (len > 0)
+                    arq.handleFrame(body, len);
+                else
+                    badFrames++;
+            }
+            frame.clear();
+        }
+        arq.poll();
+    }
+
+  private:
+    LossyLine *in;
+    SerialLinkArq arq;
+    std::vector<uint8_t> frame;
+
+    void onPayload(const uint8_t *payload, size_t len)
+    {
+        if (!payload) {
+            gaps++;
+            return;
+        }
+        uint32_t n = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+        TEST_ASSERT_EQUAL(4 + (n * 37) % 300, len);
+        for (size_t i = 4; i < len; i++)
+            TEST_ASSERT_EQUAL((uint8_t)(n + i), payload[i]);
+        received.push_back(n);
+    }
+};
+
+/// Both sides send count payloads as fast as their windows allow, until everything arrived or time ran out
+void exchange(Endpoint &a, Endpoint &b, uint32_t first, uint32_t count)
+{
+    uint32_t nextA = first, nextB = first;
+    size_t wantA = b.received.size() + count, wantB = a.received.size() + count;
+    uint32_t start = millis();
+    while ((b.received.size() < wantA || a.received.size() < wantB) && millis() - start < kTimeoutMsec) {
+        while (nextA < first + count && a.getArq().canSend())
+            TEST_ASSERT_TRUE(a.send(nextA++));
+        while (nextB < first + count && b.getArq().canSend())
+            TEST_ASSERT_TRUE(b.send(nextB++));
+        a.poll();
+        b.poll();
+        delay(1);
+    }
+}
+
+/// Every payload in [first, first + count) arrived exactly once, and in order
+void assertReceivedOnce(const Endpoint &e, uint32_t first, uint32_t count)
+{
+    std::vector<uint32_t> inRange;
+    for (uint32_t n : e.received) {
+        if (n >= first && n < first + count)
+            inRange.push_back(n);
+    }
+    TEST_ASSERT_EQUAL(count, inRange.size());
+    for (uint32_t i = 0; i < count; i++)
+        TEST_ASSERT_EQUAL(first + i, inRange[i]);
+}
+
+void logStats(const char *name, const SerialLinkArq &arq)
+{
+    const SerialLinkArq::Stats &s = arq.getStats();
+    LOG_INFO("%s: %u frames, %u retransmitted, %u expired, %u duplicates, %u acks, RTT %u ms, RTO %u ms", name, s.framesSent,
+             s.retransmissions, s.expired, s.duplicates, s.acksSent, arq.getSrttMsec(), arq.getRtoMsec());
+}
+} // namespace
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Probes make both sides find out the other speaks ARQ, then a clean line delivers everything, sent once.
+void test_cleanLink(void)
+{
+    LossyLine ab(1), ba(2);
+    Endpoint a(&ab, &ba, 0x11), b(&ba, &ab, 0x22);
+
+    TEST_ASSERT_FALSE(a.getArq().peerSpeaksArq());
+    a.getArq().probe();
+    for (int i = 0; i < 20; i++) {
+        a.poll();
+        b.poll();
+        delay(1);
+    }
+    TEST_ASSERT_TRUE(a.getArq().peerSpeaksArq());
+    TEST_ASSERT_TRUE(b.getArq().peerSpeaksArq());
+
+    exchange(a, b, 0, kPayloads);
+    assertReceivedOnce(a, 0, kPayloads);
+    assertReceivedOnce(b, 0, kPayloads);
+    TEST_ASSERT_EQUAL(0, a.getArq().getStats().retransmissions);
+    TEST_ASSERT_EQUAL(0, b.getArq().getStats().retransmissions);
+    // Two line latencies plus the time to clock out a frame
+    TEST_ASSERT_LESS_THAN(50, a.getArq().getSrttMsec());
+    logStats("Clean link", a.getArq());
+}
+
+// A line that loses and corrupts bytes in both directions still gets every payload across exactly once, in order.
+void test_lossyLink(void)
+{
+    LossyLine ab(3), ba(4);
+    for (LossyLine *line : {&ab, &ba}) {
+        line->lossPerMillion = 500;
+        line->corruptPerMillion = 500;
+    }
+    Endpoint a(&ab, &ba, 0x33), b(&ba, &ab, 0x44);
+    a.getArq().probe();
+
+    exchange(a, b, 0, kPayloads);
+    assertReceivedOnce(a, 0, kPayloads);
+    assertReceivedOnce(b, 0, kPayloads);
+    TEST_ASSERT_GREATER_THAN(0, a.badFrames + b.badFrames);
+    TEST_ASSERT_GREATER_THAN(0, a.getArq().getStats().retransmissions);
+    TEST_ASSERT_EQUAL(0, a.getArq().getStats().expired);
+    TEST_ASSERT_EQUAL(0, b.getArq().getStats().expired);
+    logStats("Lossy link", a.getArq());
+}
+
+// When one side restarts with a new epoch the other resynchronizes instead of taking its frames for duplicates.
+void test_peerRestart(void)
+{
+    LossyLine ab(5), ba(6);
+    Endpoint a(&ab, &ba, 0x55);
+    std::unique_ptr<Endpoint> b(new Endpoint(&ba, &ab, 0x66));
+    a.getArq().probe();
+    exchange(a, *b, 0, kPayloads / 2);
+    assertReceivedOnce(*b, 0, kPayloads / 2);
+
+    b.reset(new Endpoint(&ba, &ab, 0x77));
+    exchange(a, *b, kPayloads / 2, kPayloads / 2);
+    assertReceivedOnce(*b, kPayloads / 2, kPayloads / 2);
+    assertReceivedOnce(a, kPayloads / 2, kPayloads / 2);
+}
+
+// Frames given up on while the line was dead don't keep the receiver from taking the ones sent after it came back.
+void test_expiredFrames(void)
+{
+    LossyLine ab(7), ba(8);
+    Endpoint a(&ab, &ba, 0x88), b(&ba, &ab, 0x99);
+    a.getArq().probe();
+    exchange(a, b, 0, 10);
+    assertReceivedOnce(b, 0, 10);
+    for (int i = 0; i < 100; i++) { // Let the last ACKs arrive
+        a.poll();
+        b.poll();
+        delay(1);
+    }
+
+    ab.lossPerMillion = 1000000;
+    for (uint32_t n = 10; n < 10 + SLINK_ARQ_WINDOW; n++)
+        TEST_ASSERT_TRUE(a.send(n));
+    uint32_t start = millis();
+    while (!a.getArq().canSend() && millis() - start < kTimeoutMsec) {
+        a.poll();
+        b.poll();
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(SLINK_ARQ_WINDOW, a.getArq().getStats().expired);
+    TEST_ASSERT_EQUAL(SLINK_ARQ_WINDOW, a.txLost - 1); // The first one was for meeting b
+
+    uint32_t gaps = b.gaps;
+    ab.lossPerMillion = 0;
+    exchange(a, b, 100, 3 * SLINK_ARQ_SACK_BITS);
+    assertReceivedOnce(b, 100, 3 * SLINK_ARQ_SACK_BITS);
+    TEST_ASSERT_EQUAL(SLINK_ARQ_WINDOW, b.gaps - gaps);
+}
+
+// A context fed the same NodeNums and ids on both ends decodes what it encoded, in the sizes it promises.
+void test_headerContext(void)
+{
+    SerialLinkContext tx, rx;
+    uint8_t buf[64];
+    NodeNum nodes[SLINK_CONTEXT_SIZE + 1];
+    PacketId ids[SLINK_CONTEXT_SIZE + 1];
+    for (size_t i = 0; i < SLINK_CONTEXT_SIZE + 1; i++) {
+        nodes[i] = 0xA0000000 + i * 0x1234567;
+        ids[i] = (0x2345 * i) << 10 | (1000 + i);
+    }
+
+    struct Step {
+        size_t node;
+        uint32_t counterStep; // 0 for a fresh random id
+        size_t bytes;         // Node and id
+    };
+    const Step steps[] = {
+        {0, 0, 5 + 4}, // Literal node, no id known yet
+        {0, 1, 1 + 3}, // Known node, counter stepped by 1
+        {0, 4, 1 + 3},
+        {0, 5, 1 + 4}, // Step too big
+        {1, 0, 5 + 4},
+        {0, 1, 1 + 3}, // Now at index 1, moves back to the front
+    };
+    for (const Step &step : steps) {
+        PacketId &id = ids[step.node];
+        id = step.counterStep ? ((id + step.counterStep) & ID_COUNTER_MASK) | (id * 7919 & ~ID_COUNTER_MASK) : id ^ 0x5A5A5C00;
+
+        size_t len = 0;
+        tx.putNode(buf, len, nodes[step.node]);
+        bool isStep = tx.putId(buf, len, id);
+        TEST_ASSERT_EQUAL(step.bytes, len);
+        TEST_ASSERT_EQUAL(len == 1 + 3 || len == 5 + 3, isStep);
+
+        size_t pos = 0;
+        NodeNum node;
+        PacketId decodedId;
+        TEST_ASSERT_TRUE(rx.getNode(buf, len, pos, node));
+        TEST_ASSERT_TRUE(rx.getId(buf, len, pos, isStep, decodedId));
+        TEST_ASSERT_EQUAL(len, pos);
+        TEST_ASSERT_EQUAL(nodes[step.node], node);
+        TEST_ASSERT_EQUAL(id, decodedId);
+    }
+
+    // One more node than fits: the least recent one, node 1, gets dropped
+    for (size_t i = 2; i < SLINK_CONTEXT_SIZE + 1; i++) {
+        size_t len = 0, pos = 0;
+        NodeNum node;
+        tx.putNode(buf, len, nodes[i]);
+        TEST_ASSERT_TRUE(rx.getNode(buf, len, pos, node));
+    }
+    size_t len = 0;
+    tx.putNode(buf, len, nodes[0]);
+    TEST_ASSERT_EQUAL(1, len);
+    tx.putNode(buf, len, nodes[1]);
+    TEST_ASSERT_EQUAL(1 + 5, len);
+
+    // A receiver that started over can't make sense of references into the old context
+    rx.reset();
+    size_t pos = 0;
+    NodeNum node;
+    TEST_ASSERT_FALSE(rx.getNode(buf, len, pos, node));
+}
+
+void setup()
+{
+    initializeTestEnvironment();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_cleanLink);
+    RUN_TEST(test_lossyLink);
+    RUN_TEST(test_peerRestart);
+    RUN_TEST(test_expiredFrames);
+    RUN_TEST(test_headerContext);
+    exit(UNITY_END());
+}
+#else
+void setup()
+{
+    initializeTestEnvironment();
+    LOG_WARN("This test requires the ARCH_PORTDUINO variant");
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+void loop() {}
@@ -0,0 +1,318 @@
+#include "DebugConfiguration.h"
+#include "TestUtil.h"
+#include <unity.h>
+
+#ifdef ARCH_PORTDUINO
+#include "FSCommon.h"
+#include "SPILock.h"
+#include "modules/StoreForwardHistory.h"
+
+#define TEST_DIR "/sftest"
+// Small segments, so a few dozen messages fill several
+#define TEST_SEGMENT_BYTES 1024
+
+static PacketHistoryStruct makeRecord(uint32_t id)
+{
+    PacketHistoryStruct r = {};
+    r.time = 1700000000 + id;
+    r.to = (id % 3) ? NODENUM_BROADCAST : 0x1234;
+    r.from = 0xa1b2c3d4;
+    r.id = id;
+    r.channel = 1;
+    r.reply_id = id / 2;
+    r.emoji = id & 1;
+    r.rx_rssi = -80 - (int32_t)(id % 20);
+    r.rx_snr = 6.25;
+    r.hop_start = 3;
+    r.hop_limit = 2;
+    r.via_mqtt = id & 2;
+    r.payload_size = snprintf((char *)r.payload, sizeof(r.payload), "message %u from the sump, all well", id);
+    return r;
+}
+
+static void assertRecord(const PacketHistoryStruct &expected, const PacketHistoryStruct &r)
+{
+    TEST_ASSERT_EQUAL(expected.id, r.id);
+    TEST_ASSERT_EQUAL(expected.time, r.time);
+    TEST_ASSERT_EQUAL(expected.to, r.to);
+    TEST_ASSERT_EQUAL(expected.emoji, r.emoji);
+    TEST_ASSERT_EQUAL(expected.via_mqtt, r.via_mqtt);
+    TEST_ASSERT_EQUAL(expected.rx_rssi, r.rx_rssi);
+    TEST_ASSERT_EQUAL(expected.payload_size, r.payload_size);
+    TEST_ASSERT_EQUAL_MEMORY(expected.payload, r.payload, expected.payload_size);
+}
+
+static void assertHeld(const StoreForwardHistory &history, uint32_t seq)
+{
+    PacketHistoryStruct r;
+    TEST_ASSERT_TRUE(history.get(seq, r));
+    assertRecord(makeRecord(seq), r);
+}
+
+static void appendGarbage(const char *path, size_t len)
+{
+    uint8_t garbage[32];
+    memset(garbage, 0x5a, sizeof(garbage));
+    concurrency::LockGuard g(spiLock);
+    File f = FSCom.open(path, FILE_O_APPEND);
+    f.write(garbage, len);
+    f.close();
+}
+
+void setUp()
+{
+    rmDir(TEST_DIR);
+}
+
+void test_recordRoundTrip()
+{
+    uint8_t buf[SF_LOG_MAX_RECORD];
+    size_t len = StoreForwardHistory::encodeRecord(7, makeRecord(7), buf);
+    uint32_t seq;
+    PacketHistoryStruct r;
+    TEST_ASSERT_EQUAL(len, StoreForwardHistory::decodeRecord(buf, len, seq, r));
+    TEST_ASSERT_EQUAL(7, seq);
+    assertRecord(makeRecord(7), r);
+
+    // Short or damaged records don't decode
+    TEST_ASSERT_EQUAL(0, StoreForwardHistory::decodeRecord(buf, len - 1, seq, r));
+    buf[len - 1] ^= 1;
+    TEST_ASSERT_EQUAL(0, StoreForwardHistory::decodeRecord(buf, len, seq, r));
+}
+
+void test_sequenceSurvivesWraparound()
+{
+    StoreForwardHistory history;
+    TEST_ASSERT_TRUE(history.init(64 * 1024, 4));
+    for (uint32_t id = 0; id < 10; id++)
+        TEST_ASSERT_EQUAL(id, history.add(makeRecord(id)));
+
+    // The oldest made room, the rest keep their numbers
+    TEST_ASSERT_EQUAL(6, history.getFirstSeq());
+    TEST_ASSERT_EQUAL(10, history.getNextSeq());
+    TEST_ASSERT_EQUAL(4, history.getCount());
+    TEST_ASSERT_NULL(history.getHeader(5));
+    TEST_ASSERT_NULL(history.getHeader(10));
+    PacketHistoryStruct r;
+    TEST_ASSERT_FALSE(history.get(10, r));
+    for (uint32_t seq = 6; seq < 10; seq++)
+        assertHeld(history, seq);
+}
+
+void test_textIsCompressed()
+{
+    StoreForwardHistory history;
+    TEST_ASSERT_TRUE(history.init(64 * 1024));
+    PacketHistoryStruct text = makeRecord(1);
+    history.add(text);
+    const PacketHistoryHeader *h = history.getHeader(0);
+    TEST_ASSERT_NOT_NULL(h);
+    TEST_ASSERT_TRUE(h->flags & SF_HISTORY_FLAG_COMPRESSED);
+    TEST_ASSERT_LESS_THAN(text.payload_size, h->size);
+    PacketHistoryStruct r;
+    TEST_ASSERT_TRUE(history.get(0, r));
+    assertRecord(text, r);
+
+    // What doesn't get smaller is kept as it is
+    PacketHistoryStruct binary = makeRecord(2);
+    for (uint32_t i = 0; i < meshtastic_Constants_DATA_PAYLOAD_LEN; i++)
+        binary.payload[i] = (i * 167 + 13) ^ (i >> 3);
+    binary.payload_size = meshtastic_Constants_DATA_PAYLOAD_LEN;
+    history.add(binary);
+    h = history.getHeader(1);
+    TEST_ASSERT_FALSE(h->flags & SF_HISTORY_FLAG_COMPRESSED);
+    TEST_ASSERT_EQUAL(meshtastic_Constants_DATA_PAYLOAD_LEN, h->size);
+    TEST_ASSERT_TRUE(history.get(1, r));
+    assertRecord(binary, r);
+}
+
+void test_packedArenaHoldsMore()
+{
+    // What used to hold 100 messages of fixed size
+    const uint32_t fixedSlots = 100;
+    StoreForwardHistory history;
+    TEST_ASSERT_TRUE(history.init(fixedSlots * sizeof(PacketHistoryStruct)));
+    uint32_t id = 0;
+    while (history.getFirstSeq() == 0)
+        history.add(makeRecord(id++));
+    // Some 35 characters each, a 60 byte record and offset instead of a full size slot
+    TEST_ASSERT_GREATER_THAN(4 * fixedSlots, history.getCount());
+    for (uint32_t seq = history.getFirstSeq(); seq < history.getNextSeq(); seq++)
+        assertHeld(history, seq);
+}
+
+void test_longMessagesMakeRoom()
+{
+    StoreForwardHistory history;
+    const uint32_t bytes = 4096;
+    TEST_ASSERT_TRUE(history.init(bytes, 32));
+    static PacketHistoryStruct expected[1000];
+    for (uint32_t id = 0; id < 1000; id++) {
+        // Lengths all over, so messages land at every offset and wrap around the end of the arena in all sorts of ways
+        expected[id] = makeRecord(id);
+        uint32_t len = (id * 37) % meshtastic_Constants_DATA_PAYLOAD_LEN;
+        for (uint32_t i = 0; i < len; i++)
+            expected[id].payload[i] = (id + i * 7) & 0xff;
+        expected[id].payload_size = len;
+        TEST_ASSERT_EQUAL(id, history.add(expected[id]));
+        TEST_ASSERT_LESS_THAN(bytes, history.getUsedBytes());
+        TEST_ASSERT_LESS_THAN(33, history.getCount());
+        TEST_ASSERT_GREATER_THAN(0, history.getCount());
+
+        for (uint32_t seq = history.getFirstSeq(); seq <= id; seq++) {
+            PacketHistoryStruct r;
+            TEST_ASSERT_TRUE(history.get(seq, r));
+            assertRecord(expected[seq], r);
+        }
+    }
+}
+
+void test_listsByDestination()
+{
+    StoreForwardHistory history;
+    TEST_ASSERT_TRUE(history.init(64 * 1024, 50));
+    const uint32_t destinations[] = {NODENUM_BROADCAST, 0x1234, 0x5678};
+    for (uint32_t id = 0; id < 200; id++) {
+        PacketHistoryStruct r = makeRecord(id);
+        r.to = destinations[(id * id) % 3];
+        history.add(r);
+
+        // Each list has what's held for its destination, oldest first, and nothing else
+        uint32_t found = 0;
+        for (uint32_t to : destinations) {
+            uint32_t expected = history.getFirstSeq();
+            for (uint32_t seq = history.getFirstTo(to); seq != SF_NO_SEQ; seq = history.getNextTo(seq)) {
+                while (history.getHeader(expected)->to != to)
+                    expected++;
+                TEST_ASSERT_EQUAL(expected++, seq);
+                found++;
+            }
+        }
+        TEST_ASSERT_EQUAL(history.getCount(), found);
+    }
+    TEST_ASSERT_EQUAL(SF_NO_SEQ, history.getFirstTo(0x9999));
+}
+
+void test_reloadAfterReboot()
+{
+    {
+        StoreForwardHistory history;
+        TEST_ASSERT_TRUE(history.init(64 * 1024, 100, TEST_DIR, TEST_SEGMENT_BYTES));
+        for (uint32_t id = 0; id < 30; id++)
+            history.add(makeRecord(id));
+    }
+
+    StoreForwardHistory history;
+    TEST_ASSERT_TRUE(history.init(64 * 1024, 100, TEST_DIR, TEST_SEGMENT_BYTES));
+    TEST_ASSERT_EQUAL(0, history.getFirstSeq());
+    TEST_ASSERT_EQUAL(30, history.getNextSeq());
+    for (uint32_t seq = 0; seq < 30; seq++)
+        assertHeld(history, seq);
+    TEST_ASSERT_EQUAL(30, history.add(makeRecord(30)));
+
+    // Only what fits in RAM comes back
+    StoreForwardHistory small;
+    TEST_ASSERT_TRUE(small.init(64 * 1024, 10, TEST_DIR, TEST_SEGMENT_BYTES));
+    TEST_ASSERT_EQUAL(21, small.getFirstSeq());
+    TEST_ASSERT_EQUAL(31, small.getNextSeq());
+    for (uint32_t seq = 21; seq < 31; seq++)
+        assertHeld(small, seq);
+}
+
+void test_tornRecordIsSkipped()
+{
+    {
+        StoreForwardHistory history;
+        TEST_ASSERT_TRUE(history.init(64 * 1024, 100, TEST_DIR, TEST_SEGMENT_BYTES));
+        for (uint32_t id = 0; id < 5; id++)
+            history.add(makeRecord(id));
+    }
+    // A reset halfway through writing the next record
+    appendGarbage(TEST_DIR "/0", 20);
+
+    {
+        StoreForwardHistory history;
+        TEST_ASSERT_TRUE(history.init(64 * 1024, 100, TEST_DIR, TEST_SEGMENT_BYTES));
+        TEST_ASSERT_EQUAL(5, history.getNextSeq());
+        TEST_ASSERT_EQUAL(5, history.add(makeRecord(5)));
+    }
+
+    // What came after went to a segment of its own, past the damage
+    StoreForwardHistory history;
+    TEST_ASSERT_TRUE(history.init(64 * 1024, 100, TEST_DIR, TEST_SEGMENT_BYTES));
+    TEST_ASSERT_EQUAL(0, history.getFirstSeq());
+    TEST_ASSERT_EQUAL(6, history.getNextSeq());
+    for (uint32_t seq = 0; seq < 6; seq++)
+        assertHeld(history, seq);
+}
+
+void test_fullLogDropsOldestSegment()
+{
+    const uint32_t total = 400;
+    {
+        StoreForwardHistory history;
+        TEST_ASSERT_TRUE(history.init(64 * 1024, total, TEST_DIR, TEST_SEGMENT_BYTES));
+        for (uint32_t id = 0; id < total; id++)
+            history.add(makeRecord(id));
+    }
+
+    StoreForwardHistory history;
+    TEST_ASSERT_TRUE(history.init(64 * 1024, total, TEST_DIR, TEST_SEGMENT_BYTES));
+    TEST_ASSERT_EQUAL(total, history.getNextSeq());
+    // Only the newest segments' worth is left, whole and in order
+    TEST_ASSERT_GREATER_THAN(0, history.getFirstSeq());
+    TEST_ASSERT_LESS_THAN(total / 2, history.getCount());
+    for (uint32_t seq = history.getFirstSeq(); seq < total; seq++)
+        assertHeld(history, seq);
+}
+
+void test_lostIndexIsRebuilt()
+{
+    {
+        StoreForwardHistory history;
+        TEST_ASSERT_TRUE(history.init(64 * 1024, 100, TEST_DIR, TEST_SEGMENT_BYTES));
+        for (uint32_t id = 0; id < 40; id++)
+            history.add(makeRecord(id));
+    }
+    {
+        concurrency::LockGuard g(spiLock);
+        FSCom.remove(TEST_DIR "/index");
+    }
+
+    StoreForwardHistory history;
+    TEST_ASSERT_TRUE(history.init(64 * 1024, 100, TEST_DIR, TEST_SEGMENT_BYTES));
+    TEST_ASSERT_EQUAL(0, history.getFirstSeq());
+    TEST_ASSERT_EQUAL(40, history.getNextSeq());
+    for (uint32_t seq = 0; seq < 40; seq++)
+        assertHeld(history, seq);
+}
+
+void setup()
+{
+    initializeTestEnvironment();
+    initSPI();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_recordRoundTrip);
+    RUN_TEST(test_sequenceSurvivesWraparound);
+    RUN_TEST(test_textIsCompressed);
+    RUN_TEST(test_packedArenaHoldsMore);
+    RUN_TEST(test_longMessagesMakeRoom);
+    RUN_TEST(test_listsByDestination);
+    RUN_TEST(test_reloadAfterReboot);
+    RUN_TEST(test_tornRecordIsSkipped);
+    RUN_TEST(test_fullLogDropsOldestSegment);
+    RUN_TEST(test_lostIndexIsRebuilt);
+    rmDir(TEST_DIR);
+    exit(UNITY_END());
+}
+#else
+void setup()
+{
+    initializeTestEnvironment();
+    LOG_WARN("This test requires the ARCH_PORTDUINO variant");
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+void loop() {}
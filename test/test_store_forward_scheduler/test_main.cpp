@@ -0,0 +1,87 @@
+#include "DebugConfiguration.h"
+#include "TestUtil.h"
+#include <unity.h>
+
+#ifdef ARCH_PORTDUINO
+#include "modules/StoreForwardScheduler.h"
+
+void test_intervalFollowsAirtime()
+{
+    // On a quiet channel replay takes up to the target utilization, a quarter of the airtime
+    TEST_ASSERT_EQUAL(400, StoreForwardScheduler::getInterval(100, 0, 0));
+    // Every hop repeats the message
+    TEST_ASSERT_EQUAL(1600, StoreForwardScheduler::getInterval(100, 3, 0));
+    // The busier the channel, the less is left for replay
+    TEST_ASSERT_EQUAL(1000, StoreForwardScheduler::getInterval(100, 0, 15));
+    TEST_ASSERT_EQUAL(100 * 100 / SF_REPLAY_MIN_SHARE_PERCENT, StoreForwardScheduler::getInterval(100, 0, 40));
+    TEST_ASSERT_EQUAL(SF_REPLAY_MAX_INTERVAL_MS, StoreForwardScheduler::getInterval(3000, 7, 20));
+}
+
+void test_sessionsTakeTurns()
+{
+    StoreForwardScheduler replay;
+    uint32_t now = 1000;
+    TEST_ASSERT_TRUE(replay.start(0xa, 0, 4, 1, now + 500));
+    TEST_ASSERT_TRUE(replay.start(0xb, 0, 2, 1, now + 500));
+    TEST_ASSERT_TRUE(replay.start(0xc, 0, 4, 1, now + 500));
+
+    // Nothing before the start
+    uint32_t wait;
+    TEST_ASSERT_NULL(replay.next(now, wait));
+    TEST_ASSERT_EQUAL(500, wait);
+
+    const uint32_t expected[] = {0xa, 0xb, 0xc, 0xa, 0xb, 0xc, 0xa, 0xc, 0xa, 0xc};
+    now += 500;
+    for (uint32_t to : expected) {
+        StoreForwardScheduler::Session *s = replay.next(now, wait);
+        TEST_ASSERT_NOT_NULL(s);
+        TEST_ASSERT_EQUAL(to, s->to);
+        replay.sent(*s, now, 300);
+
+        // Whoever is next waits for the last one's interval
+        TEST_ASSERT_NULL(replay.next(now + 100, wait));
+        TEST_ASSERT_EQUAL(replay.isIdle() ? 0 : 200, wait);
+        now += 300;
+    }
+    TEST_ASSERT_TRUE(replay.isIdle());
+    TEST_ASSERT_NULL(replay.next(now, wait));
+}
+
+void test_sessionsAreLimited()
+{
+    StoreForwardScheduler replay;
+    for (uint32_t to = 1; to <= SF_REPLAY_MAX_SESSIONS; to++)
+        TEST_ASSERT_TRUE(replay.start(to, 0, 5, 0, 0));
+    TEST_ASSERT_TRUE(replay.isFull());
+    TEST_ASSERT_FALSE(replay.canStart(0x99));
+    TEST_ASSERT_FALSE(replay.start(0x99, 0, 5, 0, 0));
+
+    // A client already being sent history can ask again, and one finishing makes room
+    TEST_ASSERT_TRUE(replay.canStart(1));
+    TEST_ASSERT_TRUE(replay.start(1, 100, 2, 0, 0));
+    replay.stop(2);
+    TEST_ASSERT_FALSE(replay.isActive(2));
+    TEST_ASSERT_TRUE(replay.start(0x99, 0, 5, 0, 0));
+    TEST_ASSERT_TRUE(replay.isFull());
+}
+
+void setup()
+{
+    initializeTestEnvironment();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_intervalFollowsAirtime);
+    RUN_TEST(test_sessionsTakeTurns);
+    RUN_TEST(test_sessionsAreLimited);
+    exit(UNITY_END());
+}
+#else
+void setup()
+{
+    initializeTestEnvironment();
+    LOG_WARN("This test requires the ARCH_PORTDUINO variant");
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+void loop() {}